@@ -0,0 +1,174 @@
+"""Hold many idle keep-alive connections on loopback (C10K/C100K).
+
+    python3 bench/idle_connections.py [connections] [client processes]
+
+Each connection sends one request and then stays open, idle. Reports the
+time to the first response of each new connection (accept latency) while
+the others stay open, the server's RSS per idle connection, and the
+latency of a request made with all of them open.
+
+Both ends need a descriptor per connection: the server raises its limit
+to worker_rlimit_nofile, and the clients are spread over processes that
+each raise theirs. A process can only go past its hard limit with
+CAP_SYS_RESOURCE; without it the run is capped to fit and says so. Each
+loopback source address (127.0.0.x) gives one ephemeral port range, so
+the clients take a new one every PORTS_PER_ADDRESS connections.
+"""
+
+import multiprocessing
+import os
+import resource
+import socket
+import struct
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "tests"))
+from harness import Server, free_port, percentile, read_response  # noqa: E402
+
+REQUEST = b"GET / HTTP/1.1\r\nHost: bench\r\n\r\n"
+SERVER_RESERVE = 256  # Listeners, logs, files
+CLIENT_RESERVE = 64
+PORTS_PER_ADDRESS = 20000
+
+
+def raise_open_file_limit(wanted):
+    """Raise RLIMIT_NOFILE towards wanted; returns the limit obtained."""
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if hard != resource.RLIM_INFINITY and hard < wanted:
+        try:
+            resource.setrlimit(resource.RLIMIT_NOFILE, (wanted, wanted))
+            return wanted
+        except (ValueError, OSError):
+            wanted = hard
+    resource.setrlimit(resource.RLIMIT_NOFILE, (wanted, hard))
+    return wanted
+
+
+def client(port, first, count, results, release):
+    """Open connections first..first+count-1 one by one, keep them idle."""
+    raise_open_file_limit(count + CLIENT_RESERVE)
+    sockets = []
+    latencies = []
+    failed = 0
+    for n in range(first, first + count):
+        source = "127.0.0.%d" % (2 + n // PORTS_PER_ADDRESS)
+        start = time.perf_counter()
+        try:
+            s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            s.bind((source, 0))
+            s.connect(("127.0.0.1", port))
+            s.sendall(REQUEST)
+            status, _, _, _ = read_response(s)
+            if status != 200:
+                raise ConnectionError("status %d" % status)
+        except OSError as error:
+            if not failed:
+                print("connection %d failed: %s" % (n, error))
+            failed += 1
+            s.close()
+            continue
+        latencies.append(time.perf_counter() - start)
+        sockets.append(s)
+    results.put((len(sockets), failed, latencies))
+    release.wait()
+    # Reset rather than close, so no TIME_WAIT holds the ports of a rerun
+    for s in sockets:
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER,
+                     struct.pack("ii", 1, 0))
+        s.close()
+
+
+def main():
+    wanted = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    processes = int(sys.argv[2]) if len(sys.argv) > 2 else 8
+
+    # The server inherits this process's limit and raises it from there
+    limit = raise_open_file_limit(wanted + SERVER_RESERVE)
+    connections = min(wanted, limit - SERVER_RESERVE)
+    if connections < wanted:
+        print("Open file limit is %d (hard) and this process cannot raise "
+              "it (needs CAP_SYS_RESOURCE, or a higher `ulimit -Hn`): "
+              "running %d connections instead of %d" %
+              (limit, connections, wanted))
+    per_process = (connections + processes - 1) // processes
+    if per_process + CLIENT_RESERVE > limit:
+        processes = (connections + limit - CLIENT_RESERVE - 1) // (
+            limit - CLIENT_RESERVE)
+        per_process = (connections + processes - 1) // processes
+
+    port = free_port()
+    config = """
+worker_connections %d;
+worker_rlimit_nofile %d;
+
+server {
+    listen %d;
+    keepalive_timeout 3600;
+    location / {
+        root {root}/www;
+        index index.html;
+        allow_methods GET;
+    }
+}
+""" % (connections + 16, connections + SERVER_RESERVE, port)
+    files = {"www/index.html": b"ok\n"}
+    with Server(config, port, files) as server:
+        rss_before = server.rss_kb()
+        results = multiprocessing.Queue()
+        release = multiprocessing.Event()
+        workers = []
+        start = time.time()
+        for i in range(processes):
+            first = i * per_process
+            count = min(per_process, connections - first)
+            if count <= 0:
+                break
+            worker = multiprocessing.Process(
+                target=client, args=(port, first, count, results, release))
+            worker.start()
+            workers.append(worker)
+
+        opened = 0
+        failed = 0
+        latencies = []
+        for _ in workers:
+            count, errors, times = results.get()
+            opened += count
+            failed += errors
+            latencies.extend(times)
+        elapsed = time.time() - start
+        time.sleep(1)  # Let the server settle before measuring
+        rss_idle = server.rss_kb()
+
+        probe = server.connect()
+        sent = time.perf_counter()
+        probe.sendall(REQUEST)
+        read_response(probe)
+        probe_latency = time.perf_counter() - sent
+        probe.close()
+
+        release.set()
+        for worker in workers:
+            worker.join()
+
+        latencies.sort()
+        print("%d idle keep-alive connections (%d failed) opened in %.1fs "
+              "by %d client processes" % (opened, failed, elapsed,
+                                          len(workers)))
+        if latencies:
+            print("accept latency (connect to first response): p50 %.0fus "
+                  "p99 %.0fus max %.0fus" %
+                  (percentile(latencies, 0.5) * 1e6,
+                   percentile(latencies, 0.99) * 1e6, latencies[-1] * 1e6))
+        print("server RSS %d kB -> %d kB: %.0f bytes per idle connection" %
+              (rss_before, rss_idle,
+               (rss_idle - rss_before) * 1024.0 / max(opened, 1)))
+        print("request with all connections open: %.0fus" %
+              (probe_latency * 1e6))
+        if failed:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
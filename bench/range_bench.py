@@ -0,0 +1,76 @@
+"""Random 64 KB byte-range reads from a large file over keep-alive.
+
+    python3 bench/range_bench.py [file MB] [requests]
+
+Reports throughput and latency percentiles; every response is checked
+against the file.
+"""
+
+import os
+import random
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "tests"))
+from harness import Server, free_port, percentile, read_response  # noqa: E402
+
+RANGE_SIZE = 64 * 1024
+
+
+def main():
+    file_mb = int(sys.argv[1]) if len(sys.argv) > 1 else 256
+    requests = int(sys.argv[2]) if len(sys.argv) > 2 else 5000
+    port = free_port()
+    config = """
+server {
+    listen %d;
+    location / {
+        root {root}/www;
+        allow_methods GET;
+    }
+}
+""" % port
+    with Server(config, port) as server:
+        os.makedirs(server.path("www"))
+        path = server.path("www/large.bin")
+        with open(path, "wb") as f:
+            for _ in range(file_mb):
+                f.write(os.urandom(1024 * 1024))
+        size = file_mb * 1024 * 1024
+
+        rng = random.Random(42)
+        sock = server.connect()
+        fd = os.open(path, os.O_RDONLY)
+        latencies = []
+        buffer = b""
+        start = time.perf_counter()
+        for _ in range(requests):
+            first = rng.randrange(0, size - RANGE_SIZE)
+            last = first + RANGE_SIZE - 1
+            request = ("GET /large.bin HTTP/1.1\r\nHost: bench\r\n"
+                       "Range: bytes=%d-%d\r\n\r\n" % (first, last))
+            sent = time.perf_counter()
+            sock.sendall(request.encode())
+            status, headers, body, buffer = read_response(sock, buffer)
+            latencies.append(time.perf_counter() - sent)
+            if headers.get("connection") == "close":
+                sock.close()  # keepalive_requests reached
+                sock = server.connect()
+            if status != 206 or body != os.pread(fd, RANGE_SIZE, first):
+                sys.exit("wrong response for bytes=%d-%d: %d" %
+                         (first, last, status))
+        elapsed = time.perf_counter() - start
+        os.close(fd)
+        sock.close()
+
+        latencies.sort()
+        print("%d x 64 KB ranges of a %d MB file: %.0f req/s, %.0f MB/s" %
+              (requests, file_mb, requests / elapsed,
+               requests * RANGE_SIZE / elapsed / 1e6))
+        print("latency p50 %.0fus p99 %.0fus, server RSS %d kB" %
+              (percentile(latencies, 0.5) * 1e6,
+               percentile(latencies, 0.99) * 1e6, server.rss_kb()))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,109 @@
+// Location lookup cost with 1, 100 and 5000 locations per server: the
+// LocationTree against the linear scan it replaced. Run with make bench.
+
+#include "../includes/http/location_tree.hpp"
+#include "../tests/linear_location_match.hpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Keeps the lookups from being optimized away
+volatile long sink;
+
+// Locations shaped like real configs: sections, versioned APIs, assets
+std::vector<LocationConfig> make_locations(size_t count) {
+  std::vector<LocationConfig> locations(count);
+  locations[0].path = "/";
+  for (size_t i = 1; i < count; ++i) {
+    std::string id = std::to_string(i);
+    switch (i % 3) {
+    case 0:
+      locations[i].path = "/section" + id;
+      break;
+    case 1:
+      locations[i].path = "/api/v" + id + "/users";
+      break;
+    default:
+      locations[i].path = "/static/app" + id + "/";
+      break;
+    }
+  }
+  return locations;
+}
+
+// Request paths under random locations, plus some that only match "/"
+std::vector<std::string> make_uris(const std::vector<LocationConfig> &locations,
+                                   size_t count) {
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<size_t> pick(0, locations.size() - 1);
+  std::vector<std::string> uris;
+  for (size_t i = 0; i < count; ++i) {
+    const std::string &path = locations[pick(rng)].path;
+    if (i % 4 == 3)
+      uris.push_back(path + "x/missing.html");
+    else if (path[path.size() - 1] == '/')
+      uris.push_back(path + "js/main.js");
+    else
+      uris.push_back(path + "/page/index.html");
+  }
+  return uris;
+}
+
+// Nanoseconds per lookup, repeating until the run is long enough to time
+template <typename Find>
+double time_lookups(const std::vector<std::string> &uris, Find find,
+                    long &checksum) {
+  typedef std::chrono::steady_clock clock;
+  size_t rounds = 1;
+  while (true) {
+    clock::time_point start = clock::now();
+    for (size_t round = 0; round < rounds; ++round) {
+      for (size_t i = 0; i < uris.size(); ++i)
+        checksum += find(uris[i]);
+    }
+    double elapsed =
+        std::chrono::duration<double>(clock::now() - start).count();
+    if (elapsed >= 0.2)
+      return elapsed * 1e9 / (rounds * uris.size());
+    rounds *= 2;
+  }
+}
+
+} // namespace
+
+int main() {
+  static const size_t counts[] = {1, 100, 5000};
+  std::printf("%10s %14s %14s %9s\n", "locations", "linear ns/op",
+              "tree ns/op", "speedup");
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+    std::vector<LocationConfig> locations = make_locations(counts[c]);
+    std::vector<std::string> uris = make_uris(locations, 1000);
+    LocationTree tree(locations);
+
+    long linear_sum = 0;
+    long tree_sum = 0;
+    double linear_ns = time_lookups(
+        uris,
+        [&](const std::string &uri) {
+          return linear_find_location(locations, uri);
+        },
+        linear_sum);
+    double tree_ns = time_lookups(
+        uris, [&](const std::string &uri) { return tree.find(uri); },
+        tree_sum);
+    sink = linear_sum + tree_sum;
+    for (size_t i = 0; i < uris.size(); ++i) {
+      if (tree.find(uris[i]) != linear_find_location(locations, uris[i])) {
+        std::fprintf(stderr, "lookups disagree on %s\n", uris[i].c_str());
+        return 1;
+      }
+    }
+    std::printf("%10zu %14.1f %14.1f %8.1fx\n", counts[c], linear_ns, tree_ns,
+                linear_ns / tree_ns);
+  }
+  return 0;
+}
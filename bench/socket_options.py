@@ -0,0 +1,203 @@
+"""Listener socket options, each measured against the defaults.
+
+    python3 bench/socket_options.py
+
+Runs the server once per configuration and reports:
+- silent: of SILENT connections that send nothing for a while, how many
+  the server was woken to accept (TCP_DEFER_ACCEPT keeps them queued)
+- keep-alive p50/p99 for a small file and for a 100 KB file sent with
+  sendfile() after the headers (where Nagle can delay the tail)
+- new-connection p50: connect, request, response, close; the client
+  sends its request in the SYN when Fast Open is available
+- tfo: connections the kernel accepted with data in the SYN
+- burst: of BURST simultaneous connects, how many needed a SYN
+  retransmission (the accept queue was full)
+- 1 MB: time to download a 1 MB file (socket buffer sizes)
+
+Fast Open needs the server bit (2) of net.ipv4.tcp_fastopen; without it
+the fastopen row measures the normal handshake, as its tfo count shows.
+"""
+
+import os
+import select
+import socket
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "tests"))
+from harness import Server, free_port, percentile, read_response  # noqa: E402
+
+SILENT = 200
+BURST = 1000
+SAMPLES = 500
+
+CONFIGURATIONS = [
+    ("defaults", "", ""),
+    ("tcp_nodelay off", "", "tcp_nodelay off;"),
+    ("deferred", "deferred", ""),
+    ("fastopen=256", "fastopen=256", ""),
+    ("backlog=16", "backlog=16", ""),
+    ("rcvbuf/sndbuf=8k", "rcvbuf=8k sndbuf=8k", ""),
+    ("reuseport", "reuseport", ""),
+]
+
+FILES = {
+    "www/small.html": b"<p>small</p>\n",
+    "www/page.bin": os.urandom(100 * 1024),
+    "www/large.bin": os.urandom(1024 * 1024),
+}
+
+
+def tcp_counters():
+    """TcpExt counters from /proc/net/netstat."""
+    with open("/proc/net/netstat") as f:
+        lines = f.read().splitlines()
+    for names, values in zip(lines[::2], lines[1::2]):
+        if names.startswith("TcpExt:"):
+            return dict(zip(names.split()[1:], map(int, values.split()[1:])))
+    return {}
+
+
+def request(path):
+    return ("GET %s HTTP/1.1\r\nHost: bench\r\n\r\n" % path).encode()
+
+
+def keepalive_latency(server, path):
+    sock = server.connect()
+    latencies = []
+    for _ in range(SAMPLES):
+        start = time.perf_counter()
+        sock.sendall(request(path))
+        read_response(sock)
+        latencies.append(time.perf_counter() - start)
+    sock.close()
+    latencies.sort()
+    return percentile(latencies, 0.5), percentile(latencies, 0.99)
+
+
+def new_connection_latency(port):
+    latencies = []
+    data = ("GET /small.html HTTP/1.1\r\nHost: bench\r\n"
+            "Connection: close\r\n\r\n").encode()
+    for _ in range(SAMPLES):
+        start = time.perf_counter()
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        # Connect and send at once: in the SYN once a cookie is cached
+        sock.sendto(data, socket.MSG_FASTOPEN, ("127.0.0.1", port))
+        while sock.recv(65536):
+            pass
+        sock.close()
+        latencies.append(time.perf_counter() - start)
+    latencies.sort()
+    return percentile(latencies, 0.5)
+
+
+def count_accepted(server):
+    with open(server.path("server.log"), "rb") as f:
+        return f.read().count(b"New client connected")
+
+
+def silent_accepts(server):
+    before = count_accepted(server)
+    sockets = [server.connect() for _ in range(SILENT)]
+    time.sleep(0.5)
+    accepted = count_accepted(server) - before
+    for sock in sockets:
+        sock.sendall(request("/small.html"))
+    for sock in sockets:
+        read_response(sock)
+        sock.close()
+    return accepted
+
+
+def burst_retransmits(port):
+    """Connect BURST sockets at once; count those slower than a SYN
+    retransmission (1 s)."""
+    pending = {}
+    start = time.perf_counter()
+    for _ in range(BURST):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.setblocking(False)
+        sock.connect_ex(("127.0.0.1", port))
+        pending[sock.fileno()] = sock
+    poller = select.poll()
+    for fd in pending:
+        poller.register(fd, select.POLLOUT)
+    slow = 0
+    deadline = start + 10
+    established = []
+    while pending and time.perf_counter() < deadline:
+        for fd, _ in poller.poll(100):
+            poller.unregister(fd)
+            sock = pending.pop(fd)
+            if time.perf_counter() - start >= 1.0:
+                slow += 1
+            established.append(sock)
+    slow += len(pending)
+    for sock in established + list(pending.values()):
+        sock.close()
+    return slow
+
+
+def download_time(server):
+    sock = server.connect()
+    times = []
+    for _ in range(20):
+        start = time.perf_counter()
+        sock.sendall(request("/large.bin"))
+        read_response(sock)
+        times.append(time.perf_counter() - start)
+    sock.close()
+    times.sort()
+    return percentile(times, 0.5)
+
+
+def run(name, listen_options, main_directives):
+    port = free_port()
+    config = """
+%s
+worker_connections 4096;
+mmap_cache_size 1;
+
+server {
+    listen %d %s;
+    keepalive_requests 100000;
+    location / {
+        root {root}/www;
+        allow_methods GET;
+    }
+}
+""" % (main_directives, port, listen_options)
+    with Server(config, port, FILES) as server:
+        small = keepalive_latency(server, "/small.html")
+        page = keepalive_latency(server, "/page.bin")
+        # After the requests above, so the harness's own check connection
+        # has been accepted (or, deferred, dropped) and is not counted
+        silent = silent_accepts(server)
+        counters = tcp_counters()
+        new_connection = new_connection_latency(port)
+        fastopen = (tcp_counters().get("TCPFastOpenPassive", 0) -
+                    counters.get("TCPFastOpenPassive", 0))
+        burst = burst_retransmits(port)
+        large = download_time(server)
+    print("%-17s %6d/%d %8.0f %8.0f %8.0f %8.0f %8.0f %6d %6d/%d %7.1f" %
+          (name, silent, SILENT, small[0] * 1e6, small[1] * 1e6,
+           page[0] * 1e6, page[1] * 1e6, new_connection * 1e6, fastopen,
+           burst, BURST, large * 1e3))
+
+
+def main():
+    with open("/proc/sys/net/ipv4/tcp_fastopen") as f:
+        print("net.ipv4.tcp_fastopen = %s" % f.read().strip())
+    print("%-17s %8s %8s %8s %8s %8s %8s %6s %8s %7s" %
+          ("", "silent", "small", "small", "100K", "100K", "new conn",
+           "tfo", "burst", "1 MB"))
+    print("%-17s %8s %8s %8s %8s %8s %8s %6s %8s %7s" %
+          ("configuration", "accepted", "p50 us", "p99 us", "p50 us",
+           "p99 us", "p50 us", "", "retrans", "ms"))
+    for name, listen_options, main_directives in CONFIGURATIONS:
+        run(name, listen_options, main_directives)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,101 @@
+"""The same server over loopback TCP and over a Unix domain socket.
+
+    python3 bench/unix_socket.py [requests]
+
+Reports p50/p99 latency for keep-alive requests and for new connections
+(connect, request, response, close) on each transport.
+"""
+
+import os
+import socket
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "tests"))
+from harness import Server, free_port, percentile, read_response  # noqa: E402
+
+KEEPALIVE = b"GET /small.html HTTP/1.1\r\nHost: bench\r\n\r\n"
+CLOSE = (b"GET /small.html HTTP/1.1\r\nHost: bench\r\n"
+         b"Connection: close\r\n\r\n")
+
+
+def keepalive_latency(connect, requests):
+    sock = connect()
+    latencies = []
+    for _ in range(requests):
+        start = time.perf_counter()
+        sock.sendall(KEEPALIVE)
+        status, headers, _, _ = read_response(sock)
+        latencies.append(time.perf_counter() - start)
+        if status != 200:
+            sys.exit("unexpected status %d" % status)
+        if headers.get("connection") == "close":
+            sock.close()  # keepalive_requests reached
+            sock = connect()
+    sock.close()
+    latencies.sort()
+    return latencies
+
+
+def new_connection_latency(connect, requests):
+    latencies = []
+    for _ in range(requests):
+        start = time.perf_counter()
+        sock = connect()
+        sock.sendall(CLOSE)
+        status, _, _, _ = read_response(sock)
+        sock.close()
+        latencies.append(time.perf_counter() - start)
+        if status != 200:
+            sys.exit("unexpected status %d" % status)
+    latencies.sort()
+    return latencies
+
+
+def main():
+    requests = int(sys.argv[1]) if len(sys.argv) > 1 else 5000
+    port = free_port()
+    config = """
+server {
+    listen %d;
+    keepalive_requests 100000;
+    location / {
+        root {root}/www;
+        allow_methods GET;
+    }
+}
+
+server {
+    listen unix:{root}/webserv.sock;
+    keepalive_requests 100000;
+    location / {
+        root {root}/www;
+        allow_methods GET;
+    }
+}
+""" % port
+    files = {"www/small.html": b"<p>small</p>\n"}
+    with Server(config, port, files) as server:
+        unix_path = server.path("webserv.sock")
+
+        def connect_tcp():
+            return socket.create_connection(("127.0.0.1", port))
+
+        def connect_unix():
+            s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            s.connect(unix_path)
+            return s
+
+        print("%-14s %-10s %8s %8s" % ("", "transport", "p50 us", "p99 us"))
+        for name, measure in (("keep-alive", keepalive_latency),
+                              ("new connection", new_connection_latency)):
+            for transport, connect in (("tcp", connect_tcp),
+                                       ("unix", connect_unix)):
+                latencies = measure(connect, requests)
+                print("%-14s %-10s %8.0f %8.0f" %
+                      (name, transport, percentile(latencies, 0.5) * 1e6,
+                       percentile(latencies, 0.99) * 1e6))
+
+
+if __name__ == "__main__":
+    main()
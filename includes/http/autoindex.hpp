@@ -0,0 +1,107 @@
+#ifndef AUTOINDEX_HPP
+#define AUTOINDEX_HPP
+
+#include "body_segment.hpp"
+#include <cstddef>
+#include <ctime>
+#include <dirent.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+enum AutoindexFormat { AUTOINDEX_HTML, AUTOINDEX_JSON };
+
+// What to list: one page (or all) of a directory, in one format
+struct AutoindexRequest {
+  std::string directory_path; // On disk
+  std::string uri;            // As requested, used for links
+  AutoindexFormat format;
+  size_t page;      // 1-based
+  size_t page_size; // 0 = everything on one page
+};
+
+// Rendered listings keyed by URI/format/page and validated against the
+// directory's mtime, within a fixed byte budget (LRU eviction)
+class AutoindexCache {
+private:
+  struct Entry {
+    std::shared_ptr<const std::string> body;
+    ino_t inode;
+    time_t mtime;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  static const size_t MAX_CACHED_BYTES = 16 * 1024 * 1024;
+
+  std::map<std::string, Entry> entries;
+  std::list<std::string> lru; // Most recently used first
+  size_t cached_bytes;
+
+  AutoindexCache();
+  AutoindexCache(const AutoindexCache &);
+  AutoindexCache &operator=(const AutoindexCache &);
+
+public:
+  // Listings bigger than this are streamed every time
+  static const size_t MAX_LISTING_BYTES = 1024 * 1024;
+
+  static AutoindexCache &instance();
+
+  static std::string make_key(const AutoindexRequest &request);
+  std::shared_ptr<const std::string> get(const std::string &key, ino_t inode,
+                                         time_t mtime);
+  void put(const std::string &key, ino_t inode, time_t mtime,
+           const std::shared_ptr<const std::string> &body);
+
+private:
+  void remove(std::map<std::string, Entry>::iterator it);
+};
+
+// Generates a listing batch by batch while the response is being sent, so
+// huge directories never sit in memory as one page. Entry types come from
+// d_type; only files (and unknown types) on the page cost an fstatat() on
+// the directory fd, and earlier pages are skipped a batch at a time. A
+// listing that stays small is handed to the cache when complete.
+class AutoindexStream : public BodyStream {
+private:
+  AutoindexRequest request;
+  DIR *dir;
+  bool started;
+  size_t entry_index; // Entries seen so far (for paging)
+  size_t emitted;     // Entries written on this page
+  bool has_more;      // Entries exist beyond this page
+
+  std::string cache_key;
+  ino_t dir_inode;
+  time_t dir_mtime;
+  std::string capture; // Copy of the output while it may still be cached
+  bool capturing;
+
+  static const size_t BATCH_ENTRIES = 256;
+
+  AutoindexStream(const AutoindexStream &);
+  AutoindexStream &operator=(const AutoindexStream &);
+
+public:
+  AutoindexStream(const AutoindexRequest &request, ino_t dir_inode,
+                  time_t dir_mtime);
+  ~AutoindexStream();
+
+  // Opens the directory; errno is set on failure
+  bool open();
+
+  bool read(std::string &output, size_t max_bytes, bool &done);
+
+private:
+  bool skip_entry();
+  bool next_entry(std::string &name, bool &is_dir, off_t &size);
+  void write_header(std::string &output);
+  void write_entry(std::string &output, const std::string &name, bool is_dir,
+                   off_t size);
+  void write_footer(std::string &output);
+  std::string page_uri(size_t page) const;
+};
+
+#endif // AUTOINDEX_HPP
@@ -0,0 +1,60 @@
+#ifndef BODY_SEGMENT_HPP
+#define BODY_SEGMENT_HPP
+
+#include "file_cache.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Pull-based body source for output that is produced while the response is
+// being sent, so its length is not known when the headers go out.
+class BodyStream {
+public:
+  virtual ~BodyStream() {}
+
+  // Append the next piece of the body (at most max_bytes) to output and set
+  // done once nothing is left. Appending nothing without done means no data
+  // is ready yet. Returning false aborts the response.
+  virtual bool read(std::string &output, size_t max_bytes, bool &done) = 0;
+
+  // Descriptor that becomes readable when more data is ready, or -1 if the
+  // stream never has to wait
+  virtual int wait_fd() const { return -1; }
+};
+
+enum BodySourceType {
+  BODY_DATA,    // Bytes owned by the segment
+  BODY_BUFFER,  // Shared, immutable buffer (caches)
+  BODY_MAPPING, // Slice of a shared file mapping
+  BODY_FILE,    // File range sent with sendfile()
+  BODY_STREAM   // Pull-based stream of unknown length
+};
+
+// One piece of a response body. Segments are sent after the headers without
+// being copied into the connection buffer.
+struct BodySegment {
+  BodySourceType type;
+  std::string data;
+  std::shared_ptr<const std::string> buffer;
+  std::shared_ptr<const MappedFile> mapping;
+  std::shared_ptr<const OpenFile> file;
+  std::shared_ptr<BodyStream> stream;
+  size_t offset; // Position inside the source of the next byte to send
+  size_t length; // Bytes left to send (unknown, and unused, for streams)
+
+  static BodySegment from_data(const std::string &data);
+  static BodySegment from_buffer(const std::shared_ptr<const std::string> &b);
+  static BodySegment from_mapping(const std::shared_ptr<const MappedFile> &m,
+                                  size_t offset, size_t length);
+  static BodySegment from_file(const std::shared_ptr<const OpenFile> &file,
+                               size_t offset, size_t length);
+  static BodySegment from_stream(const std::shared_ptr<BodyStream> &stream);
+
+  // Append the bytes left in this segment to output, or count of them
+  // starting skip bytes in. Fails for streams and for file ranges that can
+  // no longer be read.
+  bool read_into(std::string &output) const;
+  bool read_into(std::string &output, size_t skip, size_t count) const;
+};
+
+#endif // BODY_SEGMENT_HPP
@@ -0,0 +1,57 @@
+#ifndef ERROR_PAGES_HPP
+#define ERROR_PAGES_HPP
+
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+
+// Error page bodies of one server, rendered once and sent as shared buffers.
+// Configured error_page files are loaded at startup and re-read only when
+// the file cache sees them change; generated pages are built on first use.
+class ErrorPageCache {
+private:
+  struct CustomPage {
+    std::string path;
+    std::shared_ptr<const std::string> body; // NULL while unreadable
+    ino_t inode;
+    time_t mtime;
+    off_t size;
+  };
+
+  typedef std::pair<int, std::string> GeneratedKey; // status, message
+
+  // Generated pages are only kept for this many status/message pairs
+  static const size_t MAX_GENERATED_PAGES = 128;
+
+  std::map<int, CustomPage> custom_pages;
+  std::map<GeneratedKey, std::shared_ptr<const std::string> > generated_pages;
+
+  ErrorPageCache(const ErrorPageCache &);
+  ErrorPageCache &operator=(const ErrorPageCache &);
+
+public:
+  ErrorPageCache();
+  ~ErrorPageCache();
+
+  // Register (and load) the file configured for a status code
+  void add_custom_page(int status_code, const std::string &path);
+
+  // Configured page for the status, or NULL if there is none (or it cannot
+  // be read right now)
+  std::shared_ptr<const std::string> get_custom_page(int status_code);
+
+  // Built-in page for the status and message
+  std::shared_ptr<const std::string>
+  get_generated_page(int status_code, const std::string &message);
+
+  static std::string render_default_page(int status_code,
+                                         const std::string &message);
+
+private:
+  void load_custom_page(CustomPage &page);
+};
+
+#endif // ERROR_PAGES_HPP
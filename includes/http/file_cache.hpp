@@ -0,0 +1,136 @@
+#ifndef FILE_CACHE_HPP
+#define FILE_CACHE_HPP
+
+#include <cstddef>
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+// Read-only mapping of a whole file. Responses hold it through a shared_ptr,
+// so the pages stay valid until the last in-flight send is done with them.
+// The kernel copies from the pages for send(); copies made in userspace go
+// through the descriptor kept open with it, since touching a page past the
+// end of a file truncated since the mapping was made raises SIGBUS.
+class MappedFile {
+private:
+  void *data;
+  size_t length;
+  int fd;
+
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+
+public:
+  MappedFile(void *data, size_t length, int fd);
+  ~MappedFile();
+
+  const char *get_data() const;
+  size_t get_length() const;
+  int get_fd() const;
+};
+
+// Read-only file descriptor shared by the responses sending ranges from it
+class OpenFile {
+private:
+  int fd;
+
+  OpenFile(const OpenFile &);
+  OpenFile &operator=(const OpenFile &);
+
+public:
+  explicit OpenFile(int fd);
+  ~OpenFile();
+
+  int get_fd() const;
+};
+
+// Result of a (possibly cached) stat() call
+struct FileInfo {
+  bool exists;
+  bool is_directory;
+  off_t size;
+  time_t mtime;
+  ino_t inode;
+  dev_t device;
+  std::string etag;          // Strong validator built from inode/mtime/size
+  std::string last_modified; // mtime as an HTTP-date
+  const std::string *mime_type; // From MimeTypes, resolved once per lookup
+};
+
+class FileCache {
+private:
+  struct InfoEntry {
+    FileInfo info;
+    time_t checked_at;
+  };
+
+  struct MappingEntry {
+    std::shared_ptr<const MappedFile> mapping;
+    ino_t inode;
+    dev_t device;
+    time_t mtime;
+    off_t size;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  static const size_t MAX_INFO_ENTRIES = 16384;
+
+  std::map<std::string, InfoEntry> info_entries;
+  std::map<std::string, MappingEntry> mappings;
+  std::list<std::string> lru; // Most recently used mapping first
+  size_t mapped_bytes;
+
+  size_t max_mapped_bytes;
+  size_t min_mmap_size;
+  time_t valid_seconds;
+
+  FileCache();
+  FileCache(const FileCache &);
+  FileCache &operator=(const FileCache &);
+
+public:
+  ~FileCache();
+
+  static FileCache &instance();
+
+  // Limits come from the main config; called at startup and on reload
+  // (after MimeTypes, whose strings the cached entries point to)
+  void configure(size_t max_mapped_bytes, size_t min_mmap_size,
+                 time_t valid_seconds);
+
+  // stat() the path, reusing the result for valid_seconds
+  FileInfo get_info(const std::string &path);
+
+  // True if the file is big enough to be worth serving from a mapping
+  bool should_map(const FileInfo &info) const;
+
+  // True if the file is small enough to be copied into the response
+  bool should_copy(const FileInfo &info) const;
+
+  // Shared mapping of the file, or NULL if it could not be mapped
+  std::shared_ptr<const MappedFile> map_file(const std::string &path,
+                                             const FileInfo &info);
+
+  // Descriptor for sendfile(), or NULL if the file cannot be opened
+  std::shared_ptr<const OpenFile> open_file(const std::string &path);
+
+  // Whole contents of a file too small to map, read straight from its
+  // descriptor; false if it cannot be opened or read
+  bool read_file(const std::string &path, std::string &contents);
+
+  // Forget what is known about a path the server itself changed (upload,
+  // DELETE), so the next lookup sees it at once
+  void invalidate(const std::string &path);
+
+  size_t get_mapped_bytes() const;
+
+private:
+  void evict_mappings(size_t needed_bytes);
+  void remove_mapping(std::map<std::string, MappingEntry>::iterator it);
+  void prune_info_entries(time_t now);
+};
+
+#endif // FILE_CACHE_HPP
@@ -0,0 +1,132 @@
+#ifndef GZIP_FILTER_HPP
+#define GZIP_FILTER_HPP
+
+#include "../structs/server_config.hpp"
+#include "http_request.hpp"
+#include "http_response.hpp"
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// Quality the client gave a content-coding in Accept-Encoding (0 = refused)
+double accepted_encoding_quality(const std::string &accept_encoding,
+                                 const std::string &coding);
+
+// Incremental zlib deflate producing a gzip or zlib ("deflate") stream.
+// Output is produced as input arrives, so bodies of unknown length can be
+// encoded chunk by chunk.
+class GzipStream {
+private:
+  z_stream stream;
+  bool initialized;
+  bool finished;
+
+  GzipStream(const GzipStream &);
+  GzipStream &operator=(const GzipStream &);
+
+public:
+  GzipStream(int level, bool gzip_wrapper);
+  ~GzipStream();
+
+  bool is_valid() const;
+
+  // Compress input and append whatever zlib emits to output; finish=true
+  // flushes the trailer. Returns false on a zlib error.
+  bool write(const char *data, size_t length, std::string &output,
+             bool finish);
+
+  // Emit everything compressed so far (Z_SYNC_FLUSH), so a streamed body
+  // reaches the client as soon as its source produces it
+  bool flush(std::string &output);
+};
+
+// Compresses a body while it is being sent: streams of unknown length, and
+// bodies too big for (or not eligible to) the compression cache. Fixed
+// segments are read a piece at a time, so a large file is never held in
+// memory whole nor compressed in one go on the event loop.
+class GzipBodyStream : public BodyStream {
+private:
+  std::vector<BodySegment> source;
+  size_t position; // Segment being consumed
+  size_t consumed; // Bytes of it already compressed (fixed segments)
+  GzipStream encoder;
+  bool finished;
+
+  // Input compressed per read(), in units of its max_bytes
+  static const size_t INPUT_PIECES = 8;
+
+public:
+  GzipBodyStream(const std::vector<BodySegment> &source, int level,
+                 bool gzip_wrapper);
+  ~GzipBodyStream();
+
+  bool read(std::string &output, size_t max_bytes, bool &done);
+  int wait_fd() const;
+};
+
+// Compressed static bodies keyed by coding, level and ETag, so each version
+// of a file is compressed only once. Bounded by a byte budget with LRU eviction.
+class CompressionCache {
+private:
+  struct Entry {
+    std::shared_ptr<const std::string> body;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  std::map<std::string, Entry> entries;
+  std::list<std::string> lru; // Most recently used first
+  size_t cached_bytes;
+  size_t max_bytes;
+
+  CompressionCache();
+  CompressionCache(const CompressionCache &);
+  CompressionCache &operator=(const CompressionCache &);
+
+public:
+  static CompressionCache &instance();
+
+  void configure(size_t max_bytes);
+  std::shared_ptr<const std::string> get(const std::string &key);
+  void put(const std::string &key,
+           const std::shared_ptr<const std::string> &body);
+  size_t get_max_bytes() const;
+
+private:
+  void evict(size_t needed_bytes);
+};
+
+// Applies the server's gzip settings to a finished response: picks a coding
+// from Accept-Encoding, compresses the body and rewrites the headers.
+class GzipFilter {
+private:
+  const ServerConfig *server_config;
+
+  // Uncached bodies up to this size are still compressed in one go, so
+  // they keep a Content-Length
+  static const size_t MAX_INLINE_LENGTH = 64 * 1024;
+
+public:
+  explicit GzipFilter(const ServerConfig *server_config);
+  ~GzipFilter();
+
+  // Rewrites headers and body in place when compression applies. cacheable
+  // marks static file responses whose ETag identifies the body. Streamed
+  // bodies are compressed on the fly as they are sent. Call it after
+  // set_header_only(): a HEAD answer without a body gets GET's headers.
+  void apply(const HttpRequest &request, HttpResponse &response,
+             bool cacheable);
+
+private:
+  std::string select_coding(const HttpRequest &request);
+  bool is_compressible_type(const std::string &content_type);
+  std::string compress(const std::string &body, const std::string &coding);
+  void compress_while_sending(HttpResponse &response,
+                              const std::string &coding);
+  void mark_encoded(HttpResponse &response, const std::string &coding);
+};
+
+#endif // GZIP_FILTER_HPP
@@ -0,0 +1,34 @@
+#ifndef HEADER_WRITER_HPP
+#define HEADER_WRITER_HPP
+
+#include <cstddef>
+#include <string>
+
+// Standard reason phrase for a status code, or NULL if it is not registered
+const char *status_reason(int status_code);
+
+// Formats a status line and header fields straight into a caller-owned
+// buffer. The buffer is reused between responses, so once it has grown to
+// fit a typical header block serialization does not allocate.
+class HeaderWriter {
+private:
+  std::string &buffer;
+
+public:
+  explicit HeaderWriter(std::string &buffer);
+  ~HeaderWriter();
+
+  // reason = NULL uses the standard phrase (precomputed status line)
+  void status_line(int status_code, const char *reason = NULL);
+  void header(const std::string &name, const std::string &value);
+  void header(const char *name, size_t name_length, const char *value,
+              size_t value_length);
+  void header(const char *name, size_t name_length, unsigned long long value);
+  void date_header();
+  void end();
+
+private:
+  void append_number(unsigned long long value);
+};
+
+#endif // HEADER_WRITER_HPP
@@ -17,34 +17,89 @@
 #include <map>
 #include <vector>
 #include <iostream>
+#include <ctime>
+#include <memory>
+#include <sys/types.h>
+#include "body_segment.hpp"
 #include "http_request.hpp"
-#include "http_response_handling.hpp"
+#include "http_response.hpp"
 #include "../structs/location_config.hpp"
 
+// Output of a CGI script. Until the response starts, the event loop feeds
+// the request body to the script and collects its header block with
+// read_headers(); the rest is the response body, read from the pipe while
+// it is being sent. Owns the pipes and the child: an abandoned response
+// kills the script. Children are reaped without waiting, on SIGCHLD.
+class CgiOutputStream : public BodyStream {
+    private:
+        int fd;       // Script's stdout
+        pid_t pid;
+        int input_fd; // Script's stdin until the request body is written
+        std::string input;
+        size_t input_sent;
+        std::string head; // Output read before the response started
+        bool head_complete;
+        bool eof;
+
+        // Output without a header terminator this far in is sent as body
+        static const size_t MAX_HEADER_SIZE = 65536;
+        // Scripts that had not exited when their stream was done
+        static std::vector<pid_t> exiting;
+
+        CgiOutputStream(const CgiOutputStream&);
+        CgiOutputStream& operator=(const CgiOutputStream&);
+        void write_input();
+        void close_input();
+        void finish_process(bool kill_running);
+    public:
+        CgiOutputStream(int fd, pid_t pid, int input_fd, const std::string& input);
+        ~CgiOutputStream();
+
+        // Write what the script accepts of the request body and read what it
+        // has output. True once the header block is in (or the output ended
+        // without one); never blocks.
+        bool read_headers();
+        const std::string& get_head() const;
+        bool at_eof() const;
+        // Descriptors read_headers() waits on: readable output, and the
+        // script's stdin while it has room for more of the body (-1: none)
+        int output_fd() const;
+        int input_wait_fd() const;
+
+        bool read(std::string& output, size_t max_bytes, bool& done);
+        int wait_fd() const;
+
+        // Collect the scripts that have exited since (on SIGCHLD)
+        static void reap_children();
+};
+
 class CgiHandler {
     private:
         static const int PIPE_READ = 0;
         static const int PIPE_WRITE = 1;
         static const size_t MAX_ENV_SIZE = 8192;
-        static const int CGI_TIMEOUT = 30; // seconds
     public:
         CgiHandler();
         ~CgiHandler();
-        std::string execute_cgi(const HttpRequest& request, const LocationConfig& location, const std::string& script_path);
+        // Start the script. On success output is set and the response is
+        // built with build_response() once its headers are in; otherwise
+        // the error response is returned. remote_port is -1 for a client on
+        // a Unix socket (no REMOTE_PORT).
+        HttpResponse execute_cgi(const HttpRequest& request, const LocationConfig& location, const std::string& script_path, const std::string& remote_addr, int remote_port, std::shared_ptr<CgiOutputStream>& output);
+        HttpResponse build_response(const std::shared_ptr<CgiOutputStream>& output);
+        // The script stayed silent for cgi_timeout
+        HttpResponse build_timeout_response();
         
     private:
-        std::vector<std::string> build_cgi_environment(const HttpRequest& request, const LocationConfig& location, const std::string& script_path);
+        std::vector<std::string> build_cgi_environment(const HttpRequest& request, const LocationConfig& location, const std::string& script_path, const std::string& remote_addr, int remote_port);
         char** create_env_array(const std::vector<std::string>& env_vars);
         void cleanup_env_array(char** env_array, size_t size);
         
         pid_t fork_cgi_process(const std::string& cgi_binary, const std::string& script_path, char ** env_array, int input_pipe[2], int output_pipe[2]);
-        std::string read_cgi_output(int output_fd, pid_t cgi_pid);
-        void write_cgi_input(int input_fd, const std::string& input_data);
 
-        std::string build_http_response(const std::string& cgi_output);
-        bool wait_for_process(pid_t pid, int timeout_seconds);
+        HttpResponse build_http_response(const std::string& cgi_output);
         
-        std::string create_cgi_errror(int error_code, const std::string& message);
+        HttpResponse create_cgi_errror(int error_code, const std::string& message);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef HTTP_DATE_HPP
+#define HTTP_DATE_HPP
+
+#include <ctime>
+#include <string>
+
+// IMF-fixdate as used by Date, Last-Modified and If-Modified-Since,
+// e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string format_http_date(time_t value);
+
+// The current time as an IMF-fixdate, formatted at most once per second
+const std::string &current_http_date();
+
+// Accepts IMF-fixdate plus the obsolete RFC 850 and asctime() forms
+bool parse_http_date(const std::string &text, time_t &value);
+
+#endif // HTTP_DATE_HPP
@@ -17,7 +17,7 @@
 #include <string>
 #include <vector>
 
-enum HttpMethod { GET, POST, DELETE, UNKNOWN };
+enum HttpMethod { GET, POST, DELETE, HEAD, OPTIONS, UNKNOWN };
 
 enum RequestState {
   PARSING_REQUEST_LINE,
@@ -78,6 +78,11 @@ public:
   bool has_header(const std::string &name) const;
   size_t get_content_length() const;
   bool is_chunked() const;
+  // Connection header holds the option (token list, case-insensitive)
+  bool has_connection_option(const std::string &option) const;
+  // RFC 7230 6.3: HTTP/1.1 persists unless "close", HTTP/1.0 only with
+  // "keep-alive"
+  bool is_keep_alive() const;
 
   // Setters
   void set_method(HttpMethod method);
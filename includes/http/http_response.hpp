@@ -0,0 +1,65 @@
+#ifndef HTTP_RESPONSE_HPP
+#define HTTP_RESPONSE_HPP
+
+#include "body_segment.hpp"
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A response before serialization: status, headers and a body made of
+// segments (inline data, shared buffers, file slices or streams). Handlers
+// build one of these; ResponseWriter turns it into bytes on the socket.
+class HttpResponse {
+public:
+  typedef std::vector<std::pair<std::string, std::string> > HeaderList;
+
+private:
+  int status_code;
+  std::string reason_phrase; // Empty: standard phrase for the code
+  HeaderList headers;        // Insertion order, names as given
+  std::vector<BodySegment> body;
+  bool header_only; // HEAD: headers as for GET, body never sent
+
+public:
+  explicit HttpResponse(int status_code = 200);
+  ~HttpResponse();
+
+  // Status line
+  int get_status_code() const;
+  const char *get_reason_phrase() const;
+  bool has_reason_phrase() const; // Set explicitly (e.g. by a CGI Status:)
+  void set_status(int status_code, const std::string &reason_phrase = "");
+  static const char *get_status_message(int status_code);
+
+  // Headers (names compare case-insensitively)
+  const HeaderList &get_headers() const;
+  bool has_header(const std::string &name) const;
+  std::string get_header(const std::string &name) const;
+  void set_header(const std::string &name, const std::string &value);
+  void add_header(const std::string &name, const std::string &value);
+  void remove_header(const std::string &name);
+
+  // Body
+  const std::vector<BodySegment> &get_body() const;
+  void set_body(const std::string &content);
+  void set_body(const BodySegment &segment);
+  void append_body(const BodySegment &segment);
+  void clear_body();
+  bool has_body() const;
+
+  // Answer to a HEAD request. A body, if any, only determines the length;
+  // without one, a Content-Length header set by the handler is kept.
+  void set_header_only(bool header_only);
+  bool is_header_only() const;
+
+  // False once a stream segment is involved
+  bool has_known_length() const;
+  size_t get_content_length() const;
+
+  // Copy the whole body into output (not for streams). Returns false if a
+  // file-backed segment could not be read.
+  bool read_body(std::string &output) const;
+};
+
+#endif // HTTP_RESPONSE_HPP
@@ -14,41 +14,78 @@
 #define HTTP_RESPONSE_HANDLING_HPP
 
 #include "../structs/server_config.hpp"
+#include "body_segment.hpp"
+#include "file_cache.hpp"
 #include "http_request.hpp"
+#include "http_response.hpp"
 #include "routing.hpp"
+#include <utility>
+#include <vector>
 
 class HttpResponseHandling {
 private:
     const ServerConfig* server_config;
 
+    // Beyond this many ranges the Range header is ignored
+    static const size_t MAX_RANGES = 16;
+
 public:
   explicit HttpResponseHandling(const ServerConfig *server_config);
   ~HttpResponseHandling();
 
-  std::string handle_request(const HttpRequest &request,
-                             const RouteResult &route_result);
-  std::string build_error_response(int status_code, const std::string &message);
+  HttpResponse handle_request(const HttpRequest &request,
+                              const RouteResult &route_result);
+  HttpResponse build_error_response(int status_code,
+                                    const std::string &message);
+
+  // Load every server's error_page files once, before the servers are
+  // handed to the socket manager
+  static void preload_error_pages(std::vector<ServerConfig> &servers);
 
 private:
-  std::string handle_get_request(const HttpRequest &request,
-                                 const RouteResult &route_result);
-  std::string handle_post_request(const HttpRequest &request,
+  HttpResponse handle_get_request(const HttpRequest &request,
                                   const RouteResult &route_result);
-  std::string handle_delete_request(const HttpRequest &request,
-                                    const RouteResult &route_result);
+  HttpResponse handle_post_request(const HttpRequest &request,
+                                   const RouteResult &route_result);
+  HttpResponse handle_delete_request(const HttpRequest &request,
+                                     const RouteResult &route_result);
+  HttpResponse handle_options_request(const RouteResult &route_result);
+
+  HttpResponse serve_file(const std::string &file_path,
+                          const HttpRequest &request,
+                          const LocationConfig *location);
+  HttpResponse serve_directory_listing(const std::string &directory_path,
+                                       const HttpRequest &request,
+                                       const LocationConfig *location);
+  std::string get_query_parameter(const HttpRequest &request,
+                                  const std::string &name);
+  std::string select_static_encoding(const HttpRequest &request,
+                                     const std::string &file_path,
+                                     std::string &variant_path);
 
-  std::string serve_file(const std::string &file_path);
-  std::string serve_directory_listing(const std::string &directory_path,
-                                      const std::string &uri);
+  HttpResponse build_response(int status_code, const std::string &content_type,
+                              const std::string &content);
+  // Response for (part of) a file: Content-Type plus validators
+  HttpResponse build_file_response(int status_code,
+                                   const std::string &content_type,
+                                   const FileInfo &file_info,
+                                   const HttpResponse::HeaderList &extra_headers);
+  HttpResponse
+  build_not_modified_response(const FileInfo &file_info,
+                              const HttpResponse::HeaderList &extra_headers);
 
-  std::string build_response(int status_code, const std::string &content_type,
-                             const std::string &content);
+  // Conditional GET (If-None-Match / If-Modified-Since)
+  bool is_not_modified(const HttpRequest &request, const FileInfo &file_info);
 
-  std::string get_mime_type(const std::string &file_path);
-  std::string get_status_message(int status_code);
-  bool file_exists(const std::string &path);
-  bool is_directory(const std::string &path);
-  std::string read_file(const std::string &path);
+  // Byte ranges (Range / If-Range)
+  bool range_applies(const HttpRequest &request, const FileInfo &file_info);
+  bool parse_byte_ranges(const std::string &header, off_t file_size,
+                         std::vector<std::pair<off_t, off_t> > &ranges);
+  HttpResponse
+  serve_file_ranges(const std::string &file_path, const FileInfo &file_info,
+                    const std::string &mime_type,
+                    const std::vector<std::pair<off_t, off_t> > &ranges,
+                    const HttpResponse::HeaderList &extra_headers);
 
   // Error page helpers
   std::string resolve_error_page_path(int status_code);
@@ -0,0 +1,45 @@
+#ifndef LOCATION_TREE_HPP
+#define LOCATION_TREE_HPP
+
+#include "../structs/location_config.hpp"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A server's location prefixes compiled into a radix tree when the config
+// is loaded. Lookups walk the URI once, without allocating, and return the
+// longest location path that matches on a path boundary (the nginx prefix
+// rule). The tree holds indices, so copies of a ServerConfig can share it.
+class LocationTree {
+private:
+  // Nodes are stored breadth-first: the children of a node are contiguous
+  // and sorted by the first byte of their label
+  struct Node {
+    size_t label_offset; // Edge label leading here, in labels
+    size_t label_length;
+    size_t first_child;
+    size_t child_count;
+    int location; // Index into the locations, or -1
+  };
+
+  std::vector<Node> nodes;
+  std::string labels;
+
+  LocationTree(const LocationTree &);
+  LocationTree &operator=(const LocationTree &);
+
+public:
+  static const int NO_LOCATION = -1;
+
+  explicit LocationTree(const std::vector<LocationConfig> &locations);
+  ~LocationTree();
+
+  // Index of the best location for the path, or NO_LOCATION
+  int find(std::string_view path) const;
+
+private:
+  const Node *find_child(const Node &node, unsigned char first) const;
+};
+
+#endif // LOCATION_TREE_HPP
@@ -0,0 +1,36 @@
+#ifndef MIME_TYPES_HPP
+#define MIME_TYPES_HPP
+
+#include <string>
+#include <unordered_map>
+
+// Extension -> MIME type table, filled once at startup from the `types`
+// blocks of the config (usually `include mime.types;`). Returned references
+// stay valid until the next configure(), so callers may keep pointers.
+class MimeTypes {
+public:
+  typedef std::unordered_map<std::string, std::string> TypeMap;
+
+private:
+  TypeMap types; // Keys are lowercase extensions without the dot
+  std::string default_type;
+
+  MimeTypes();
+  MimeTypes(const MimeTypes &);
+  MimeTypes &operator=(const MimeTypes &);
+
+public:
+  static MimeTypes &instance();
+
+  // An empty map keeps the small built-in table
+  void configure(const TypeMap &types, const std::string &default_type);
+
+  // Type for the extension of path, or the default type
+  const std::string &lookup(const std::string &path) const;
+  const std::string &get_default_type() const;
+
+private:
+  void load_builtin_types();
+};
+
+#endif // MIME_TYPES_HPP
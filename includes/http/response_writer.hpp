@@ -0,0 +1,65 @@
+#ifndef RESPONSE_WRITER_HPP
+#define RESPONSE_WRITER_HPP
+
+#include "body_segment.hpp"
+#include "http_response.hpp"
+#include <deque>
+#include <string>
+#include <sys/types.h>
+
+// Serializes an HttpResponse and drains it to a non-blocking socket a piece
+// at a time: the header block first, then each body segment straight from
+// its source (no copy for shared buffers, mappings or sendfile() ranges).
+class ResponseWriter {
+private:
+  std::string head; // Serialized headers; capacity is kept across responses
+                    // until the connection goes idle
+  size_t head_sent;
+  std::deque<BodySegment> body;
+  std::string stream_chunk; // Last piece pulled from a stream segment
+  size_t stream_chunk_sent;
+  bool close_after;
+  bool chunked;   // Transfer-Encoding: chunked framing applied
+  int waiting_fd; // Set when the last write waited on a stream
+
+  static const size_t STREAM_CHUNK_SIZE = 16384;
+  static const size_t INITIAL_HEAD_CAPACITY = 1024;
+  static const int MAX_HEAD_IOV = 16; // Head plus body segments per sendmsg
+
+public:
+  ResponseWriter();
+  ~ResponseWriter();
+
+  // Replace whatever is pending with a new response. A body of unknown
+  // length is sent chunked if allow_chunked (HTTP/1.1 client).
+  void start(const HttpResponse &response, bool allow_chunked);
+  void clear();
+
+  // Hand buffer storage back to the pool while the connection is idle
+  void release_buffers();
+
+  bool has_pending_output() const;
+
+  // True if the connection is closed once the response is sent: the body
+  // is delimited by the close, or the response says "Connection: close"
+  bool should_close() const;
+
+  // After write_to() failed with EAGAIN because a body stream had no data:
+  // the descriptor to poll for input before writing again (-1 otherwise)
+  int get_wait_fd() const;
+
+  // Send as much as the socket takes in one call. Returns the number of
+  // bytes sent, 0 when nothing is left, or -1 with errno set (EAGAIN means
+  // try again on the next POLLOUT).
+  ssize_t write_to(int fd);
+
+private:
+  void serialize_head(const HttpResponse &response);
+  ssize_t send_head(int fd);
+  static const char *segment_data(const BodySegment &segment);
+  ssize_t send_segment(int fd, BodySegment &segment);
+  ssize_t send_stream(int fd, BodySegment &segment);
+  static std::string chunk_size_line(size_t length);
+};
+
+#endif // RESPONSE_WRITER_HPP
@@ -17,6 +17,7 @@
 #include "../structs/server_config.hpp"
 #include "http_request.hpp"
 #include <string>
+#include <string_view>
 
 enum RouteStatus {
   ROUTE_OK,                 // Route found and valid
@@ -47,10 +48,19 @@ public:
   RouteResult route_request(const ServerConfig &server,
                             const HttpRequest &request);
 
+  // Allow header value for a location: its allow_methods, plus HEAD with
+  // GET, plus OPTIONS
+  static std::string allowed_methods(const LocationConfig &location);
+
+  // allow_methods as a bit mask of (1 << HttpMethod), with the implied
+  // HEAD and OPTIONS
+  static unsigned int method_mask(const std::vector<std::string> &methods);
+
+  // Longest-prefix location for a path, from the server's compiled tree
+  static const LocationConfig *
+  find_matching_location(const ServerConfig &server, std::string_view uri);
+
 private:
-  // Location matching
-  const LocationConfig *find_matching_location(const ServerConfig &server,
-                                               const std::string &uri);
 
   // Method validation
   bool is_method_allowed(const LocationConfig &location, HttpMethod method);
@@ -62,9 +72,7 @@ private:
   // Utility methods
   std::string normalize_path(const std::string &path);
   std::string join_paths(const std::string &root, const std::string &path);
-  bool path_exists(const std::string &path);
-  bool is_directory(const std::string &path);
-  std::string method_to_string(HttpMethod method);
+  static std::string method_to_string(HttpMethod method);
 
   // Error handling
   RouteResult create_error_result(RouteStatus status, int http_code,
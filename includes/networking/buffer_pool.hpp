@@ -0,0 +1,35 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Spare string storage shared by all connections. Idle keep-alive
+// connections hand their buffers back here, so thousands of them cost a
+// socket each rather than a socket plus several kilobytes of heap.
+class BufferPool {
+private:
+  std::vector<std::string> buffers;
+
+  // Larger buffers (a big request or header block) are freed instead
+  static const size_t MAX_POOLED_CAPACITY = 64 * 1024;
+  static const size_t MAX_POOLED_BUFFERS = 256;
+
+  BufferPool();
+  BufferPool(const BufferPool &);
+  BufferPool &operator=(const BufferPool &);
+
+public:
+  ~BufferPool();
+
+  static BufferPool &instance();
+
+  // Give buffer (empty) at least capacity bytes, reusing pooled storage
+  void acquire(std::string &buffer, size_t capacity);
+
+  // Take buffer's storage; buffer is left empty and unallocated
+  void release(std::string &buffer);
+};
+
+#endif // BUFFER_POOL_HPP
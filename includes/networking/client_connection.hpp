@@ -15,7 +15,12 @@
 
 #include "../http/http_request.hpp"
 #include "../http/request_parser.hpp"
+#include "../http/response_writer.hpp"
+#include "../runtime_config.hpp"
+#include "../structs/server_config.hpp"
+#include <memory>
 #include <string>
+#include <string_view>
 #include <sys/time.h>
 
 enum ConnectionState { READING, WRITING, CLOSING };
@@ -27,11 +32,35 @@ private:
   time_t last_activity;
   std::string buffer;
   int server_socket_fd;         // Which server this client belongs to
+  std::string listen_address;   // Address of that listener (outlives it)
+  std::string local_address;    // Address the client connected to, or ""
+  std::string remote_address;   // Client IP, "unix:" for a Unix socket peer
+  int remote_port;              // -1 for a Unix socket peer
+  // Per-address limits: the client's key (none for a Unix socket peer),
+  // the limit_conn zone it is counted in until it closes, and the status
+  // to answer with instead of serving it (0: none)
+  ClientKey client_key;
+  bool has_client_key;
+  std::shared_ptr<LimitZone> counted_in;
+  int rejected_status;
   HttpRequest http_request;     // HTTP request being parsed
   RequestParser request_parser; // Each client has its own parser
+  ResponseWriter response_writer; // Response being sent
+  // Persistent connection state
+  size_t requests_served;
+  bool idle;                // Waiting for the next request on a kept-alive
+  time_t keepalive_timeout; // connection, for at most this many seconds
+  // Config snapshot of the current request, and the virtual host resolved
+  // in it for the last Host value seen on this connection
+  std::shared_ptr<const RuntimeConfig> config;
+  std::string cached_host;
+  const ServerConfig *cached_server;
+
+  static const size_t INITIAL_BUFFER_CAPACITY = 8192;
 
 public:
-  ClientConnection(int fd, int server_fd);
+  ClientConnection(int fd, int server_fd, const std::string &listen_address,
+                   const struct sockaddr *peer);
   ~ClientConnection();
 
   // Getters
@@ -40,12 +69,42 @@ public:
   time_t get_last_activity() const;
   const std::string &get_buffer() const;
   int get_server_socket_fd() const;
+  const std::string &get_listen_address() const;
+  // Looked up on first use: only needed when a wildcard listener accepts
+  // for specific addresses too
+  const std::string &get_local_address();
+  const std::string &get_remote_address() const;
+  int get_remote_port() const;
+  const ClientKey *get_client_key() const; // NULL for a Unix socket peer
+  int get_rejected_status() const;
 
   // Setters
   void set_state(ConnectionState new_state);
   void update_activity();
   void append_to_buffer(const std::string &data);
   void clear_buffer();
+  void count_in(const std::shared_ptr<LimitZone> &zone);
+  void reject(int status);
+
+  // Outgoing response, drained by the event loop on POLLOUT
+  void send_response(const HttpResponse &response, bool allow_chunked);
+  ResponseWriter &get_response_writer();
+  bool has_pending_output() const;
+
+  // Keep-alive: count a request, and park the connection between requests
+  size_t count_request();
+  void set_keepalive_timeout(time_t timeout_seconds);
+  void begin_keepalive();
+  bool is_idle() const;
+  time_t get_keepalive_timeout() const;
+
+  // Snapshot requests are served from; replacing it drops the memo below
+  const std::shared_ptr<const RuntimeConfig> &get_config() const;
+  void set_config(const std::shared_ptr<const RuntimeConfig> &config);
+
+  // Virtual host memo: the server for host if it was the last one resolved
+  const ServerConfig *get_cached_server(std::string_view host) const;
+  void cache_server(std::string_view host, const ServerConfig *server);
 
   // Utility
   bool is_timed_out(time_t timeout_seconds) const;
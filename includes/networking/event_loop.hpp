@@ -13,55 +13,156 @@
 #ifndef EVENT_LOOP_HPP
 #define EVENT_LOOP_HPP
 
+#include "../http/http_cgi_handler.hpp"
 #include "../http/routing.hpp"
+#include "../runtime_config.hpp"
 #include "client_connection.hpp"
 #include "socket_manager.hpp"
+#include <csignal>
 #include <cstring>
+#include <functional>
 #include <map>
 #include <poll.h>
+#include <string>
 #include <sys/socket.h>
+#include <sys/types.h>
 #include <unistd.h>
 #include <vector>
 
 class EventLoop {
 private:
   std::vector<struct pollfd> poll_fds;
+  std::vector<int> poll_slots; // fd -> index in poll_fds (-1: not polled)
   std::map<int, ClientConnection *> clients;
+  // Body stream descriptors (CGI pipes) a client's write is waiting on
+  std::map<int, int> stream_waiters; // stream fd -> client fd
+  // CGI scripts whose headers a client waits for before its response can
+  // start, and the script pipes polled meanwhile
+  struct PendingCgi {
+    std::shared_ptr<CgiOutputStream> output;
+    const ServerConfig *server_config;
+    time_t timeout; // cgi_timeout: longest the script may stay silent
+  };
+  std::map<int, PendingCgi> pending_cgi; // client fd -> script
+  std::map<int, int> cgi_waiters;        // pipe fd -> client fd
   SocketManager &socket_manager;
+  std::shared_ptr<const RuntimeConfig> config; // Snapshot for new requests
+  // Builds the next snapshot on reload (NULL if the config is invalid)
+  std::function<std::shared_ptr<const RuntimeConfig>()> config_loader;
+  // Hot binary upgrade: argv to exec, and the new process while it starts.
+  // It writes a byte to upgrade_ready_fd once it is listening.
+  std::vector<std::string> upgrade_command;
+  pid_t upgrade_pid;
+  int upgrade_ready_fd;
+  // Draining: no longer accepting; exit once the clients are done or at
+  // the deadline, whichever comes first
+  bool draining;
+  time_t drain_deadline;
+  // Out of descriptors: listeners are not polled until accept_resume_at
+  bool accept_paused;
+  time_t accept_resume_at;
+  time_t next_timeout_at; // Earliest a client may time out (-1: none)
   bool running;
-  time_t timeout_seconds;
   Router router;
+  // recv() target, client_header_buffer_size bytes
+  std::vector<char> read_buffer;
 
-  // Maximum buffer size for reading
-  static const size_t MAX_BUFFER_SIZE = 8192;
+  // Self-pipe: signal handlers write the signal number, the loop reads it
+  static int signal_pipe[2];
 
-  // Maximum number of clients
-  static const int MAX_CLIENTS = 1000;
+  // Connections accepted per listener wakeup
+  static const int ACCEPT_BATCH = 64;
+  // Reads of client_header_buffer_size spent discarding a rejected request
+  static const int DISCARD_READS = 8;
 
 public:
-  EventLoop(SocketManager &sm, time_t timeout = 60);
+  // Environment variable naming the descriptor a new binary signals on
+  static const char *const UPGRADE_READY_ENV;
+
+  // Limits and timeouts come from the config snapshot's top level
+  EventLoop(SocketManager &sm,
+            const std::shared_ptr<const RuntimeConfig> &config);
   ~EventLoop();
 
   // Main event loop
   void run();
   void stop();
+  // Stop accepting and let the requests in progress finish, for at most
+  // the configured shutdown_timeout
   void shutdown_gracefully();
 
   // Check if the event loop is running
   bool is_running() const;
 
+  // Hand a signal to the loop. Async-signal-safe: this is all a signal
+  // handler should do; the loop acts on it before its next poll().
+  static void post_signal(int sig);
+
+  // Configuration reload (SIGHUP)
+  void set_config_loader(
+      const std::function<std::shared_ptr<const RuntimeConfig>()> &loader);
+
+  // Hot binary upgrade (SIGUSR2): exec upgrade_command with the listeners
+  // inherited, and drain this process once the new one is ready
+  void set_upgrade_command(const std::vector<std::string> &command);
+
+  // In an upgraded process: tell the old one it can stop accepting
+  static void notify_upgrade_ready();
+
 private:
   // Event handling methods
   void handle_events(int poll_result);
   void handle_new_connection(int server_fd);
+  void pause_accepting();
+  void resume_accepting();
   void handle_client_read(int client_fd);
   void handle_client_write(int client_fd);
+  void send_response(int client_fd, const HttpResponse &response,
+                     bool allow_chunked = false);
+  void set_persistence(ClientConnection *client, const HttpRequest &request,
+                       const ServerConfig &server_config,
+                       HttpResponse &response);
+  void respond(ClientConnection *client, HttpRequest &request,
+               const ServerConfig &server_config, HttpResponse &response,
+               bool cacheable);
+  void wait_for_stream(int client_fd, int stream_fd);
+  void resume_stream_waiter(int stream_fd);
   void handle_client_error(int client_fd);
 
+  // CGI: the client's socket is not polled until the script's headers are
+  // in, or until cgi_timeout answers 504 instead
+  void start_cgi(int client_fd, const std::shared_ptr<CgiOutputStream> &output,
+                 const ServerConfig *server_config, time_t timeout);
+  void handle_cgi_event(int pipe_fd);
+  void finish_cgi(int client_fd, HttpResponse &response);
+  void watch_cgi(int client_fd);
+  void unwatch_cgi(int client_fd);
+
+  // Per-address limits, checked before anything is parsed: limit_conn as
+  // a connection is accepted, limit_req as each request starts
+  void limit_connection(ClientConnection *client);
+  void limit_request(ClientConnection *client);
+  void reject_client(ClientConnection *client, int status);
+  void discard_input(int client_fd);
+  void handle_signals();
+
+  // Swap in a new snapshot, opening and closing listeners to match it
+  void reload_config();
+
+  // Upgrade steps: start the new binary, then hand over or give up
+  void start_upgrade();
+  void handle_upgrade_ready();
+  void end_upgrade();
+  void begin_drain();
+  void close_idle_clients();
+
   // Client management
-  void add_client(int client_fd, int server_fd);
+  ClientConnection *add_client(int client_fd, int server_fd,
+                               const struct sockaddr *peer);
   void remove_client(int client_fd);
-  void cleanup_timed_out_clients();
+  int cleanup_timed_out_clients();
+  time_t client_timeout(const ClientConnection *client) const;
+  void schedule_timeout(int client_fd);
 
   // Poll management
   void setup_poll_fds();
@@ -70,6 +171,7 @@ private:
   void update_poll_events(int fd, short events);
 
   // Utility methods
+  void report_connection_budget() const;
   bool is_server_socket(int fd) const;
   void log_error(const std::string &message);
 
@@ -0,0 +1,78 @@
+#ifndef LIMIT_ZONE_HPP
+#define LIMIT_ZONE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+// Client IP as limits count it: IPv6, with IPv4 as ::ffff:a.b.c.d
+struct ClientKey {
+  unsigned char bytes[16];
+
+  bool operator==(const ClientKey &other) const;
+};
+
+// Key for a peer address; false for peers without an IP (Unix sockets)
+bool make_client_key(const struct sockaddr *address, ClientKey &key);
+
+// Per-client state of a limit_conn_zone (open connections) or a
+// limit_req_zone (leaky bucket, as in nginx). An open addressing table in
+// a fixed block of memory: a client is looked for at most MAX_PROBES slots
+// from its hash, so every check is O(1) and never allocates. Slots of
+// clients that no longer count (no connection left, bucket drained) are
+// reused in place; when none is free a client is refused, like nginx does
+// when a zone runs out of memory.
+class LimitZone {
+private:
+  struct Slot {
+    ClientKey key;
+    uint32_t value; // Connections, or bucket level in 1/1000 requests
+    uint32_t used;
+    uint64_t last_ms; // Last accepted request (limit_req)
+  };
+
+  static const size_t MAX_PROBES = 8;
+  static const uint64_t MAX_ELAPSED_MS = 100000000; // Keeps products in range
+
+  std::string name;
+  size_t size;
+  uint64_t rate; // Requests per second x 1000; 0 for a connection zone
+  std::vector<Slot> slots;
+  size_t mask;
+  uint64_t seed; // Per zone, so clients cannot aim at one probe sequence
+
+  LimitZone(const std::string &name, size_t size, uint64_t rate);
+  LimitZone(const LimitZone &);
+  LimitZone &operator=(const LimitZone &);
+
+public:
+  ~LimitZone();
+
+  // The zone of that name, reused across reloads while its size and rate
+  // stay the same, so the counts carry over
+  static std::shared_ptr<LimitZone> obtain(const std::string &name,
+                                           size_t size, uint64_t rate);
+
+  // limit_conn: count a connection unless the client has limit already
+  bool acquire_connection(const ClientKey &key, size_t limit);
+  void release_connection(const ClientKey &key);
+
+  // limit_req: true if a request now fits the rate plus burst requests
+  bool allow_request(const ClientKey &key, size_t burst, uint64_t now_ms);
+
+  const std::string &get_name() const;
+  size_t get_size() const;
+  uint64_t get_rate() const;
+  size_t get_capacity() const;
+
+private:
+  Slot *find(const ClientKey &key, uint64_t now_ms, bool claim,
+             bool &claimed);
+  bool is_reusable(const Slot &slot, uint64_t now_ms) const;
+  size_t hash(const ClientKey &key) const;
+};
+
+#endif // LIMIT_ZONE_HPP
@@ -0,0 +1,45 @@
+#ifndef SOCKET_ADDRESS_HPP
+#define SOCKET_ADDRESS_HPP
+
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+
+// Listen addresses are known by their canonical text form, which is what
+// listeners, sockets and connections are keyed on: "0.0.0.0:8080",
+// "10.0.0.5:80", "[::]:80", "[::1]:8080", "unix:/run/webserv.sock".
+
+// Canonical form of a listen value: "8080" and "*:8080" (every IPv4
+// address), "10.0.0.5:80", "[::]:80", "unix:/path". Only numeric addresses
+// are taken. Returns false if the value is neither an address and a port
+// 1-65535 nor a Unix socket path that fits in sockaddr_un.
+bool normalize_listen_address(const std::string &value,
+                              std::string &canonical);
+
+// Socket address for a canonical listen address
+bool resolve_listen_address(const std::string &canonical,
+                            struct sockaddr_storage &address,
+                            socklen_t &length);
+
+// Canonical form of a socket address; IPv4-mapped IPv6 addresses (IPv4
+// clients of a dual-stack socket) come out as IPv4. Empty if unsupported.
+std::string format_socket_address(const struct sockaddr *address);
+
+// Address family and port (-1 for a Unix socket) of a canonical address
+bool is_ipv6_listen_address(const std::string &canonical);
+bool is_unix_listen_address(const std::string &canonical);
+int listen_address_port(const std::string &canonical);
+
+// File system path of a "unix:" address
+std::string unix_socket_path(const std::string &canonical);
+
+// Client side of a connection for logs and CGI: the IP ("10.0.0.5",
+// "::1") and port, or "unix:" and -1 for a Unix socket peer
+std::string format_socket_host(const struct sockaddr *address);
+int socket_address_port(const struct sockaddr *address);
+
+// The wildcard address of the same family and port ("0.0.0.0:80" for
+// "10.0.0.5:80"); a wildcard or Unix socket address is its own
+std::string wildcard_listen_address(const std::string &canonical);
+
+#endif // SOCKET_ADDRESS_HPP
@@ -22,53 +22,110 @@
 #include <unistd.h>
 #include <errno.h>// IWYU pragma: keep.
 #include <iostream>// IWYU pragma: keep.
-#include "structs/server_config.hpp"
+#include "../structs/server_config.hpp"
 
 class SocketManager {
 private:
     std::vector<int> server_sockets;
-    std::map<int, ServerConfig> socket_to_config;
-    std::map<int, std::vector<ServerConfig>> socket_to_server_list;
-    std::map<int, int> port_to_socket_fd; // listen_port -> socket fd
+    // Keyed by canonical listen address (see socket_address.hpp)
+    std::map<std::string, int> address_to_socket_fd;
+    std::map<int, std::string> socket_fd_to_address;
+    std::map<std::string, ListenOptions> address_options; // As last applied
+    // Listeners handed over by the binary that exec'd this one, by address;
+    // adopted instead of bound so no connection is refused during upgrades
+    std::map<std::string, int> inherited_sockets;
     bool initialized;
 
+    // How long the kernel holds a connection that has not sent any data
+    // before handing it over anyway ("listen ... deferred")
+    static const int DEFER_ACCEPT_SECONDS = 30;
+
 public:
+    // Environment variable carrying "address:fd;address:fd" across an
+    // upgrade exec
+    static const char *const LISTENERS_ENV;
+
     SocketManager();
     ~SocketManager();
     
-    // Initialize sockets for all servers in the configuration
-    bool initialize_sockets(const std::vector<ServerConfig>& servers);
+    // Open a listening socket for each address. Which servers answer on an
+    // address is up to the runtime config, not the sockets.
+    bool initialize_sockets(
+        const std::map<std::string, ListenOptions>& listeners);
     
+    // Add or drop the listener for one address (configuration reload). The
+    // new socket is appended to get_server_sockets(); a dropped Unix socket
+    // listener also removes its file.
+    bool open_listener(const std::string& address,
+                       const ListenOptions& options);
+    void close_listener(const std::string& address);
+
+    // Apply changed options to an open listener where the socket allows it
+    void update_listener(const std::string& address,
+                         const ListenOptions& options);
+
+    // Addresses with an open listener
+    std::vector<std::string> get_addresses() const;
+
+    // Hot binary upgrade. adopt_inherited_sockets() takes over the sockets
+    // named in LISTENERS_ENV (call before initialize_sockets); the others
+    // prepare the listeners to survive execve() in the forked child.
+    void adopt_inherited_sockets();
+    std::string describe_listeners() const;
+    void set_inheritable(bool inheritable);
+
     // Get all server socket file descriptors
     const std::vector<int>& get_server_sockets() const;
     
-    // Get configuration for a specific socket
-    const ServerConfig* get_config_for_socket(int socket_fd) const;
-    
-    // Close all sockets
+    // Close all sockets. Unix socket files stay: after an upgrade the new
+    // process serves them.
     void close_all_sockets();
+
+    // Unlink the files of the Unix socket listeners (shutting down)
+    void remove_socket_files() const;
     
     // Check if initialization was successful
     bool is_initialized() const;
     
-    // Get servers for a specific socket
-    const std::vector<ServerConfig> *get_servers_for_socket(int socket_fd) const;
-    
-    // Get socket fd for a specific port
-    int get_socket_fd_for_port(int port) const;
+    // Get socket fd for a listen address
+    int get_socket_fd_for_address(const std::string& address) const;
+
+    // Address a listening socket is bound to (empty if unknown)
+    std::string get_address_for_socket(int socket_fd) const;
 
 private:
     // Create and setup a single server socket
-    bool setup_server_socket(const ServerConfig& server);
+    bool setup_server_socket(const std::string& address,
+                             const ListenOptions& options);
+
+    // Socket options from the listen directive; previous (NULL for a new
+    // listener) holds those already applied
+    void apply_listen_options(int socket_fd, const std::string& address,
+                              const ListenOptions& options,
+                              const ListenOptions* previous);
+    void apply_tcp_options(int socket_fd, const std::string& address,
+                           const ListenOptions& options,
+                           const ListenOptions* previous);
+    void log_listen_options(int socket_fd, const std::string& address,
+                            const ListenOptions& options) const;
+    bool set_socket_file_mode(const std::string& address, int mode);
+    bool remove_stale_socket_file(const std::string& address);
+
+    // Validate an inherited descriptor: a listening socket bound to address
+    bool is_listener_for_address(int socket_fd,
+                                 const std::string& address) const;
+    void close_inherited_sockets();
     
     // Set socket to non-blocking mode
     bool set_non_blocking(int socket_fd);
     
     // Bind socket to address and port
-    bool bind_socket(int socket_fd, int port);
+    bool bind_socket(int socket_fd, const std::string& address,
+                     const struct sockaddr_storage& server_addr,
+                     socklen_t server_addr_len);
     
     // Start listening on socket
-    bool listen_socket(int socket_fd);
+    bool listen_socket(int socket_fd, int backlog);
 };
 
 #endif // SOCKET_MANAGER_HPP 
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef VIRTUAL_HOSTS_HPP
+#define VIRTUAL_HOSTS_HPP
+
+#include "../structs/server_config.hpp"
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Name-based virtual hosts of one listening socket, indexed at startup.
+// Resolution order follows nginx: exact name, longest "*.suffix" wildcard,
+// longest "prefix.*" wildcard, then the first server of the listener.
+class VirtualHostTable {
+private:
+  // Keys view the names stored in the ServerConfigs, which outlive the table
+  typedef std::unordered_map<std::string_view, const ServerConfig *> NameMap;
+
+  NameMap exact;
+  NameMap suffixes; // "*.example.com" stored as ".example.com"
+  NameMap prefixes; // "www.*" stored as "www."
+  const ServerConfig *default_server;
+
+  // Longer Host values cannot be valid DNS names
+  static const size_t MAX_HOST_LENGTH = 255;
+
+public:
+  VirtualHostTable();
+  explicit VirtualHostTable(const std::vector<const ServerConfig *> &servers);
+  ~VirtualHostTable();
+
+  // Server for a Host header value (port, trailing dot and case ignored)
+  const ServerConfig *resolve(std::string_view host) const;
+
+private:
+  void add_name(const std::string &name, const ServerConfig *server);
+  static void add_unique(NameMap &map, std::string_view key,
+                         const ServerConfig *server);
+};
+
+#endif // VIRTUAL_HOSTS_HPP
@@ -0,0 +1,80 @@
+#ifndef RUNTIME_CONFIG_HPP
+#define RUNTIME_CONFIG_HPP
+
+#include "networking/limit_zone.hpp"
+#include "networking/virtual_hosts.hpp"
+#include "structs/main_config.hpp"
+#include <map>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// The servers sharing one listen address
+struct Listener {
+  std::string address; // Canonical, see socket_address.hpp
+  ListenOptions options; // From the server that set them, else defaults
+  std::vector<const ServerConfig *> servers; // Config order; first is default
+  VirtualHostTable hosts;
+  // A specific address whose port is also listened on by a wildcard can
+  // not be bound beside it: the wildcard socket accepts for both, and the
+  // connection's local address tells them apart
+  std::string socket_address; // Address bound for this listener
+  bool serves_specific;       // Wildcard accepting for specific addresses
+};
+
+// Everything the request path reads, compiled once from a parsed MainConfig
+// and never modified afterwards: location trees, method masks, Allow
+// values, error pages and per-port virtual host tables. Connections hold
+// the snapshot they started a request with, so a new one can be swapped in
+// at any time.
+class RuntimeConfig {
+private:
+  MainConfig config;
+  std::map<std::string, Listener> listeners; // By address
+  // The zones limit_conn and limit_req use (NULL if off). Their counts are
+  // the one mutable part, shared with other snapshots using the same zone.
+  std::shared_ptr<LimitZone> conn_limit_zone;
+  std::shared_ptr<LimitZone> req_limit_zone;
+
+  explicit RuntimeConfig(const MainConfig &config);
+  RuntimeConfig(const RuntimeConfig &);
+  RuntimeConfig &operator=(const RuntimeConfig &);
+
+public:
+  ~RuntimeConfig();
+
+  static std::shared_ptr<const RuntimeConfig> compile(const MainConfig &config);
+
+  const MainConfig &get_main_config() const;
+  const std::vector<ServerConfig> &get_servers() const;
+  // Addresses to bind a socket to, with their socket options
+  std::map<std::string, ListenOptions> get_listen_options() const;
+
+  // Apply the process-wide settings (MIME types, cache limits, open file
+  // limit). Done once the snapshot is about to be used: at startup or when
+  // a reload commits.
+  void apply_process_settings() const;
+
+  // True if connections accepted on the socket bound to address need their
+  // local address to find their listener
+  bool serves_specific_addresses(const std::string &address) const;
+
+  // Virtual host for a Host value on a connection accepted on the socket
+  // bound to socket_address. local_address (empty if not needed, see
+  // above) selects a specific-address listener sharing that socket. NULL
+  // if neither address has a listener.
+  const ServerConfig *resolve_server(const std::string &socket_address,
+                                     const std::string &local_address,
+                                     std::string_view host) const;
+
+  const std::shared_ptr<LimitZone> &get_conn_limit_zone() const;
+  const std::shared_ptr<LimitZone> &get_req_limit_zone() const;
+
+private:
+  void assign_listener_sockets();
+  void apply_open_file_limit() const;
+  static void compile_server(ServerConfig &server);
+  static void compile_location(LocationConfig &location);
+};
+
+#endif // RUNTIME_CONFIG_HPP
@@ -1,6 +1,8 @@
 #ifndef LOCATION_CONFIG_HPP
 #define LOCATION_CONFIG_HPP
 
+#include <cstddef>
+#include <ctime>
 #include <string>
 #include <vector>
 
@@ -12,9 +14,16 @@ struct LocationConfig {
     std::vector<std::string> allow_methods;
     std::string upload_store;
     std::string cgi_pass;
+    time_t cgi_timeout;         // Seconds to wait for the script's headers
     // Optional redirection: "return <3xx> <url>;"
     int return_code;            // e.g., 301, 302, 307, 308
     std::string return_url;     // absolute or relative URL
+    bool gzip_static;           // Serve file.br / file.gz when accepted
+    bool autoindex_json;        // Default listing format is JSON, not HTML
+    size_t autoindex_page_size; // Entries per listing page (0 = all)
+    // Filled in when the config is compiled (RuntimeConfig)
+    unsigned int methods;       // Bit (1 << HttpMethod) per allowed method
+    std::string allow_header;   // Allow header value for 405 and OPTIONS
 };
 
 #endif // LOCATION_CONFIG_HPP 
\ No newline at end of file
@@ -2,10 +2,46 @@
 #define MAIN_CONFIG_HPP
 
 #include <vector>
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <unordered_map>
 #include "server_config.hpp"
 
+// limit_conn_zone / limit_req_zone: per-client-address state of a limit
+struct LimitZoneConfig {
+    std::string name;
+    size_t size;    // Memory for the client table
+    size_t rate;    // Requests per second x 1000; 0 for limit_conn_zone
+};
+
 struct MainConfig {
     std::vector<ServerConfig> servers;
+    // File serving cache limits (top-level directives)
+    size_t mmap_cache_size;     // Max bytes kept mapped by the file cache
+    size_t mmap_min_size;       // Smaller files are read instead of mapped
+    time_t file_cache_valid;    // Seconds a cached stat() result is trusted
+    size_t gzip_cache_size;     // Budget for compressed static file bodies
+    time_t shutdown_timeout;    // Max seconds to drain connections on exit
+    // Connection handling limits (top-level directives)
+    size_t worker_connections;        // Max simultaneous client connections
+    size_t worker_rlimit_nofile;      // RLIMIT_NOFILE to set (0 = inherit)
+    bool tcp_nodelay;                 // TCP_NODELAY on accepted connections
+    size_t client_header_buffer_size; // Bytes read from a client at a time
+    time_t client_header_timeout;     // Silence allowed while headers arrive
+    time_t client_body_timeout;       // ... while the body arrives
+    time_t send_timeout;              // ... while a response is being sent
+    // Per-client-address limits (top-level directives)
+    std::vector<LimitZoneConfig> limit_zones; // Declared zones
+    std::string limit_conn_zone;  // Zone counting connections ("" = off)
+    size_t limit_conn;            // Connections allowed per address
+    int limit_conn_status;        // Answer to connections over the limit
+    std::string limit_req_zone;   // Zone metering requests ("" = off)
+    size_t limit_req_burst;       // Requests allowed above the rate
+    int limit_req_status;         // Answer to requests over the rate
+    // MIME types from `types` blocks: lowercase extension -> type
+    std::unordered_map<std::string, std::string> mime_types;
+    std::string default_type;   // For extensions not in mime_types
 };
 
-#endif // MAIN_CONFIG_HPP 
\ No newline at end of file
+#endif // MAIN_CONFIG_HPP 
@@ -5,14 +5,48 @@
 #include <vector>
 #include <map>
 #include <cstddef>
+#include <ctime>
+#include <memory>
 #include "location_config.hpp"
 
+class ErrorPageCache;
+class LocationTree;
+
+// Socket settings given as parameters of a listen directive
+struct ListenOptions {
+    bool configured; // Set explicitly; only one server per address may
+                     // do so
+    int backlog;     // Pending connection queue length (listen())
+    bool reuseport;  // SO_REUSEPORT: other sockets may bind the port too
+    bool deferred;   // TCP_DEFER_ACCEPT: wake up once the client sent data
+    int fastopen;    // TCP_FASTOPEN queue length (0: off)
+    int rcvbuf;      // SO_RCVBUF / SO_SNDBUF in bytes (0: system default)
+    int sndbuf;
+    bool ipv6only;   // IPV6_V6ONLY: an IPv6 wildcard takes no IPv4 clients
+    int mode;        // Permissions of a Unix socket file
+};
+
 struct ServerConfig {
+    std::string listen_address; // Canonical "0.0.0.0:80", "[::1]:80"
     int listen_port;
-    std::string server_name;
+    ListenOptions listen_options;
+    std::string server_name;               // First of server_names
+    std::vector<std::string> server_names; // Lowercase; "*.a.com", "www.*"
     std::map<int, std::string> error_pages;
     size_t client_max_body_size;
     std::vector<LocationConfig> locations;
+    // locations compiled for longest-prefix lookup (see Router)
+    std::shared_ptr<const LocationTree> location_tree;
+    // Persistent connections
+    time_t keepalive_timeout;            // Idle seconds kept open (0 = off)
+    size_t keepalive_requests;           // Requests served per connection
+    // On-the-fly compression of responses
+    bool gzip;
+    int gzip_comp_level;                 // zlib level 1-9
+    size_t gzip_min_length;              // Smaller bodies are sent as-is
+    std::vector<std::string> gzip_types; // MIME types to compress ("*" = all)
+    // Rendered error pages, shared by all copies of this server
+    std::shared_ptr<ErrorPageCache> error_page_cache;
 };
 
 #endif // SERVER_CONFIG_HPP 
\ No newline at end of file
@@ -31,6 +31,10 @@
 #include <vector> // IWYU pragma: keep
 
 // headers
+#include "http/file_cache.hpp"              // IWYU pragma: keep
+#include "http/gzip_filter.hpp"             // IWYU pragma: keep
+#include "http/http_response_handling.hpp"  // IWYU pragma: keep
+#include "http/mime_types.hpp"              // IWYU pragma: keep
 #include "http/routing.hpp"                 // IWYU pragma: keep
 #include "networking/client_connection.hpp" // IWYU pragma: keep
 #include "networking/event_loop.hpp"        // IWYU pragma: keep
@@ -52,5 +56,6 @@ int parse_config(std::string config_file, std::vector<ServerConfig>& servers);
 
 // parsing.cpp
 int parse_config(std::string config_file, std::vector<ServerConfig> &servers);
+int parse_config(std::string config_file, MainConfig &config);
 
 #endif
@@ -0,0 +1,353 @@
+#include "../../includes/http/autoindex.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------- AutoindexCache -----------------
+
+AutoindexCache::AutoindexCache() : cached_bytes(0) {}
+
+AutoindexCache &AutoindexCache::instance() {
+  static AutoindexCache cache;
+  return cache;
+}
+
+std::string AutoindexCache::make_key(const AutoindexRequest &request) {
+  std::ostringstream key;
+  key << (request.format == AUTOINDEX_JSON ? "json " : "html ")
+      << request.page << "/" << request.page_size << " "
+      << request.directory_path << " " << request.uri;
+  return key.str();
+}
+
+std::shared_ptr<const std::string>
+AutoindexCache::get(const std::string &key, ino_t inode, time_t mtime) {
+  std::map<std::string, Entry>::iterator it = entries.find(key);
+  if (it == entries.end())
+    return std::shared_ptr<const std::string>();
+  if (it->second.inode != inode || it->second.mtime != mtime) {
+    remove(it); // Directory changed since the listing was rendered
+    return std::shared_ptr<const std::string>();
+  }
+  lru.splice(lru.begin(), lru, it->second.lru_position);
+  return it->second.body;
+}
+
+void AutoindexCache::put(const std::string &key, ino_t inode, time_t mtime,
+                         const std::shared_ptr<const std::string> &body) {
+  if (body->size() > MAX_LISTING_BYTES)
+    return;
+  std::map<std::string, Entry>::iterator existing = entries.find(key);
+  if (existing != entries.end())
+    remove(existing);
+  while (!lru.empty() && cached_bytes + body->size() > MAX_CACHED_BYTES)
+    remove(entries.find(lru.back()));
+  lru.push_front(key);
+  Entry entry;
+  entry.body = body;
+  entry.inode = inode;
+  entry.mtime = mtime;
+  entry.lru_position = lru.begin();
+  entries[key] = entry;
+  cached_bytes += body->size();
+}
+
+void AutoindexCache::remove(std::map<std::string, Entry>::iterator it) {
+  cached_bytes -= it->second.body->size();
+  lru.erase(it->second.lru_position);
+  entries.erase(it);
+}
+
+// ---------------- AutoindexStream -----------------
+
+static void append_html_escaped(std::string &output, const std::string &text) {
+  for (size_t i = 0; i < text.size(); ++i) {
+    switch (text[i]) {
+    case '&':
+      output += "&amp;";
+      break;
+    case '<':
+      output += "&lt;";
+      break;
+    case '>':
+      output += "&gt;";
+      break;
+    case '"':
+      output += "&quot;";
+      break;
+    default:
+      output += text[i];
+    }
+  }
+}
+
+static void append_url_escaped(std::string &output, const std::string &text) {
+  static const char hex[] = "0123456789ABCDEF";
+  for (size_t i = 0; i < text.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' ||
+        c == '/') {
+      output += static_cast<char>(c);
+    } else {
+      output += '%';
+      output += hex[c >> 4];
+      output += hex[c & 15];
+    }
+  }
+}
+
+static void append_json_escaped(std::string &output, const std::string &text) {
+  for (size_t i = 0; i < text.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if (c == '"' || c == '\\') {
+      output += '\\';
+      output += static_cast<char>(c);
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      output += escaped;
+    } else {
+      output += static_cast<char>(c);
+    }
+  }
+}
+
+static std::string format_size(off_t size) {
+  std::ostringstream ss;
+  if (size < 1024)
+    ss << size << " B";
+  else if (size < 1024 * 1024)
+    ss << (size / 1024) << " KB";
+  else
+    ss << (size / (1024 * 1024)) << " MB";
+  return ss.str();
+}
+
+AutoindexStream::AutoindexStream(const AutoindexRequest &request,
+                                 ino_t dir_inode, time_t dir_mtime)
+    : request(request), dir(NULL), started(false), entry_index(0),
+      emitted(0), has_more(false), dir_inode(dir_inode), dir_mtime(dir_mtime),
+      capturing(true) {
+  cache_key = AutoindexCache::make_key(request);
+}
+
+AutoindexStream::~AutoindexStream() {
+  if (dir)
+    closedir(dir);
+}
+
+bool AutoindexStream::open() {
+  int fd = ::open(request.directory_path.c_str(),
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  dir = fdopendir(fd);
+  if (!dir) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return false;
+  }
+  return true;
+}
+
+bool AutoindexStream::read(std::string &output, size_t max_bytes,
+                           bool &done) {
+  size_t start = output.size();
+  if (!started) {
+    write_header(output);
+    started = true;
+  }
+
+  // Entries of earlier pages are skipped without a stat, but count toward
+  // the batch so that reaching a late page is spread over several calls
+  size_t first = (request.page - 1) * request.page_size;
+  bool finished = false;
+  std::string name;
+  bool is_dir;
+  off_t size;
+  for (size_t batch = 0;
+       batch < BATCH_ENTRIES && output.size() - start < max_bytes; ++batch) {
+    if (entry_index < first) {
+      if (!skip_entry()) {
+        finished = true;
+        break;
+      }
+      ++entry_index;
+      continue;
+    }
+    if (request.page_size > 0 && emitted == request.page_size) {
+      // Page full: one more entry tells whether there is a next page
+      has_more = skip_entry();
+      finished = true;
+      break;
+    }
+    if (!next_entry(name, is_dir, size)) {
+      finished = true;
+      break;
+    }
+    ++entry_index;
+    write_entry(output, name, is_dir, size);
+    ++emitted;
+  }
+  if (finished) {
+    write_footer(output);
+    closedir(dir);
+    dir = NULL;
+  }
+
+  if (capturing) {
+    capture.append(output, start, std::string::npos);
+    if (capture.size() > AutoindexCache::MAX_LISTING_BYTES) {
+      capturing = false;
+      std::string().swap(capture);
+    } else if (finished && dir_mtime != 0) {
+      AutoindexCache::instance().put(
+          cache_key, dir_inode, dir_mtime,
+          std::shared_ptr<const std::string>(new std::string(capture)));
+    }
+  }
+  done = finished;
+  return true;
+}
+
+// Next entry other than . and .., without looking it up
+bool AutoindexStream::skip_entry() {
+  if (!dir)
+    return false;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char *d_name = entry->d_name;
+    if (d_name[0] == '.' &&
+        (d_name[1] == '\0' || (d_name[1] == '.' && d_name[2] == '\0')))
+      continue;
+    return true;
+  }
+  return false;
+}
+
+// Next entry other than . and .., with its type and (for files) size
+bool AutoindexStream::next_entry(std::string &name, bool &is_dir,
+                                 off_t &size) {
+  if (!dir)
+    return false;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char *d_name = entry->d_name;
+    if (d_name[0] == '.' &&
+        (d_name[1] == '\0' || (d_name[1] == '.' && d_name[2] == '\0')))
+      continue;
+
+    size = 0;
+    is_dir = entry->d_type == DT_DIR;
+    if (!is_dir) {
+      // Files need their size; links and unknown types need resolving
+      struct stat st;
+      if (fstatat(dirfd(dir), d_name, &st, 0) != 0)
+        continue;
+      is_dir = S_ISDIR(st.st_mode);
+      size = st.st_size;
+    }
+    name = d_name;
+    return true;
+  }
+  return false;
+}
+
+void AutoindexStream::write_header(std::string &output) {
+  if (request.format == AUTOINDEX_JSON) {
+    output += "{\"path\":\"";
+    append_json_escaped(output, request.uri);
+    output += "\",\"page\":";
+    output += std::to_string(request.page);
+    output += ",\"entries\":[";
+    return;
+  }
+
+  output += "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\">"
+            "<title>Index of ";
+  append_html_escaped(output, request.uri);
+  output += "</title><style>body{font-family:sans-serif;margin:2em}"
+            "table{border-collapse:collapse}th,td{padding:.2em 1.5em .2em 0;"
+            "text-align:left}td+td{text-align:right}</style></head>\n"
+            "<body><h1>Index of ";
+  append_html_escaped(output, request.uri);
+  output += "</h1><table><tr><th>Name</th><th>Size</th></tr>\n";
+
+  // Add parent directory link if not root
+  if (request.uri != "/") {
+    std::string parent_uri = request.uri;
+    if (parent_uri.size() > 1 && parent_uri[parent_uri.size() - 1] == '/')
+      parent_uri = parent_uri.substr(0, parent_uri.size() - 1);
+    size_t last_slash = parent_uri.find_last_of('/');
+    if (last_slash != std::string::npos)
+      parent_uri = parent_uri.substr(0, last_slash + 1);
+    else
+      parent_uri = "/";
+    output += "<tr><td><a href=\"";
+    append_url_escaped(output, parent_uri);
+    output += "\">../</a></td><td>-</td></tr>\n";
+  }
+}
+
+void AutoindexStream::write_entry(std::string &output, const std::string &name,
+                                  bool is_dir, off_t size) {
+  if (request.format == AUTOINDEX_JSON) {
+    if (emitted > 0)
+      output += ',';
+    output += "{\"name\":\"";
+    append_json_escaped(output, name);
+    output += is_dir ? "\",\"type\":\"directory\"}" : "\",\"type\":\"file\"";
+    if (!is_dir) {
+      output += ",\"size\":";
+      output += std::to_string(size);
+      output += '}';
+    }
+    return;
+  }
+
+  output += "<tr><td><a href=\"";
+  append_url_escaped(output, request.uri);
+  if (request.uri[request.uri.size() - 1] != '/')
+    output += '/';
+  append_url_escaped(output, name);
+  if (is_dir)
+    output += '/';
+  output += "\">";
+  append_html_escaped(output, name);
+  if (is_dir)
+    output += "/</a></td><td>-</td></tr>\n";
+  else
+    output += "</a></td><td>" + format_size(size) + "</td></tr>\n";
+}
+
+void AutoindexStream::write_footer(std::string &output) {
+  if (request.format == AUTOINDEX_JSON) {
+    output += "]";
+    if (has_more)
+      output += ",\"next_page\":" + std::to_string(request.page + 1);
+    output += "}";
+    return;
+  }
+
+  output += "</table>\n";
+  if (request.page > 1 || has_more) {
+    output += "<p>";
+    if (request.page > 1)
+      output += "<a href=\"" + page_uri(request.page - 1) + "\">&laquo; prev</a> ";
+    output += "page " + std::to_string(request.page);
+    if (has_more)
+      output += " <a href=\"" + page_uri(request.page + 1) + "\">next &raquo;</a>";
+    output += "</p>\n";
+  }
+  output += "<hr><p>webserv/1.0</p></body></html>\n";
+}
+
+std::string AutoindexStream::page_uri(size_t page) const {
+  std::string uri;
+  append_url_escaped(uri, request.uri);
+  return uri + "?page=" + std::to_string(page);
+}
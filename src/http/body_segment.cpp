@@ -0,0 +1,97 @@
+#include "../../includes/http/body_segment.hpp"
+#include <unistd.h>
+
+// Copy a file range through its descriptor; fails if the file has become
+// shorter than the range
+static bool read_range(int fd, size_t offset, size_t length,
+                       std::string &output) {
+  size_t done = 0;
+  char chunk[16384];
+  while (done < length) {
+    size_t want = length - done;
+    if (want > sizeof(chunk))
+      want = sizeof(chunk);
+    ssize_t got = pread(fd, chunk, want, static_cast<off_t>(offset + done));
+    if (got <= 0)
+      return false;
+    output.append(chunk, got);
+    done += got;
+  }
+  return true;
+}
+
+BodySegment BodySegment::from_data(const std::string &data) {
+  BodySegment segment;
+  segment.type = BODY_DATA;
+  segment.data = data;
+  segment.offset = 0;
+  segment.length = data.size();
+  return segment;
+}
+
+BodySegment
+BodySegment::from_buffer(const std::shared_ptr<const std::string> &b) {
+  BodySegment segment;
+  segment.type = BODY_BUFFER;
+  segment.buffer = b;
+  segment.offset = 0;
+  segment.length = b->size();
+  return segment;
+}
+
+BodySegment
+BodySegment::from_mapping(const std::shared_ptr<const MappedFile> &m,
+                          size_t offset, size_t length) {
+  BodySegment segment;
+  segment.type = BODY_MAPPING;
+  segment.mapping = m;
+  segment.offset = offset;
+  segment.length = length;
+  return segment;
+}
+
+BodySegment BodySegment::from_file(const std::shared_ptr<const OpenFile> &file,
+                                   size_t offset, size_t length) {
+  BodySegment segment;
+  segment.type = BODY_FILE;
+  segment.file = file;
+  segment.offset = offset;
+  segment.length = length;
+  return segment;
+}
+
+BodySegment
+BodySegment::from_stream(const std::shared_ptr<BodyStream> &stream) {
+  BodySegment segment;
+  segment.type = BODY_STREAM;
+  segment.stream = stream;
+  segment.offset = 0;
+  segment.length = 0;
+  return segment;
+}
+
+bool BodySegment::read_into(std::string &output) const {
+  return read_into(output, 0, length);
+}
+
+bool BodySegment::read_into(std::string &output, size_t skip,
+                            size_t count) const {
+  if (skip > length || count > length - skip)
+    return false;
+  size_t start = offset + skip;
+  switch (type) {
+  case BODY_DATA:
+    output.append(data, start, count);
+    return true;
+  case BODY_BUFFER:
+    output.append(*buffer, start, count);
+    return true;
+  case BODY_MAPPING:
+    // Not from the pages: the file may have been truncated under them
+    return read_range(mapping->get_fd(), start, count, output);
+  case BODY_FILE:
+    return read_range(file->get_fd(), start, count, output);
+  default:
+    return false;
+  }
+}
@@ -0,0 +1,83 @@
+#include "../../includes/http/error_pages.hpp"
+#include "../../includes/http/file_cache.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+ErrorPageCache::ErrorPageCache() {}
+
+ErrorPageCache::~ErrorPageCache() {}
+
+void ErrorPageCache::add_custom_page(int status_code, const std::string &path) {
+  CustomPage &page = custom_pages[status_code];
+  page.path = path;
+  page.inode = 0;
+  page.mtime = 0;
+  page.size = -1;
+  load_custom_page(page);
+  if (!page.body)
+    std::cerr << "Warning: error_page for " << status_code
+              << " not readable: " << path << std::endl;
+}
+
+std::shared_ptr<const std::string>
+ErrorPageCache::get_custom_page(int status_code) {
+  std::map<int, CustomPage>::iterator it = custom_pages.find(status_code);
+  if (it == custom_pages.end())
+    return std::shared_ptr<const std::string>();
+
+  // Stat results come from the file cache, so this costs no syscall in the
+  // common case; a changed file is re-read once
+  CustomPage &page = it->second;
+  FileInfo info = FileCache::instance().get_info(page.path);
+  if (!info.exists || info.is_directory) {
+    page.body.reset();
+  } else if (!page.body || info.inode != page.inode ||
+             info.mtime != page.mtime || info.size != page.size) {
+    load_custom_page(page);
+  }
+  return page.body;
+}
+
+std::shared_ptr<const std::string>
+ErrorPageCache::get_generated_page(int status_code,
+                                   const std::string &message) {
+  GeneratedKey key(status_code, message);
+  std::map<GeneratedKey, std::shared_ptr<const std::string> >::iterator it =
+      generated_pages.find(key);
+  if (it != generated_pages.end())
+    return it->second;
+
+  std::shared_ptr<const std::string> body(
+      new std::string(render_default_page(status_code, message)));
+  if (generated_pages.size() < MAX_GENERATED_PAGES)
+    generated_pages[key] = body;
+  return body;
+}
+
+std::string ErrorPageCache::render_default_page(int status_code,
+                                                const std::string &message) {
+  std::ostringstream body;
+  body << "<!DOCTYPE html>\n";
+  body << "<html><head><title>" << status_code << " " << message
+       << "</title></head>\n";
+  body << "<body><h1>" << status_code << " " << message << "</h1>\n";
+  body << "<hr><p>webserv/1.0</p></body></html>\n";
+  return body.str();
+}
+
+void ErrorPageCache::load_custom_page(CustomPage &page) {
+  page.body.reset();
+  FileInfo info = FileCache::instance().get_info(page.path);
+  if (!info.exists || info.is_directory)
+    return;
+  std::ifstream file(page.path.c_str(), std::ios::binary);
+  if (!file.is_open())
+    return;
+  std::ostringstream content;
+  content << file.rdbuf();
+  page.body.reset(new std::string(content.str()));
+  page.inode = info.inode;
+  page.mtime = info.mtime;
+  page.size = info.size;
+}
@@ -0,0 +1,238 @@
+#include "../../includes/http/file_cache.hpp"
+#include "../../includes/http/http_date.hpp"
+#include "../../includes/http/mime_types.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(void *data, size_t length, int fd)
+    : data(data), length(length), fd(fd) {}
+
+MappedFile::~MappedFile() {
+  if (data != NULL && data != MAP_FAILED)
+    munmap(data, length);
+  if (fd >= 0)
+    close(fd);
+}
+
+const char *MappedFile::get_data() const {
+  return static_cast<const char *>(data);
+}
+
+size_t MappedFile::get_length() const { return length; }
+
+int MappedFile::get_fd() const { return fd; }
+
+OpenFile::OpenFile(int fd) : fd(fd) {}
+
+OpenFile::~OpenFile() {
+  if (fd >= 0)
+    close(fd);
+}
+
+int OpenFile::get_fd() const { return fd; }
+
+FileCache::FileCache()
+    : mapped_bytes(0), max_mapped_bytes(64 * 1024 * 1024),
+      min_mmap_size(64 * 1024), valid_seconds(1) {}
+
+FileCache::~FileCache() {}
+
+FileCache &FileCache::instance() {
+  static FileCache cache;
+  return cache;
+}
+
+void FileCache::configure(size_t max_mapped_bytes, size_t min_mmap_size,
+                          time_t valid_seconds) {
+  this->max_mapped_bytes = max_mapped_bytes;
+  this->min_mmap_size = min_mmap_size;
+  this->valid_seconds = valid_seconds;
+  evict_mappings(0);
+  // Entries point at MIME types of the previous configuration
+  info_entries.clear();
+}
+
+FileInfo FileCache::get_info(const std::string &path) {
+  time_t now = time(NULL);
+  std::map<std::string, InfoEntry>::iterator it = info_entries.find(path);
+  if (it != info_entries.end() && now - it->second.checked_at < valid_seconds)
+    return it->second.info;
+
+  FileInfo info;
+  info.mime_type = &MimeTypes::instance().lookup(path);
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0) {
+    info.exists = true;
+    info.is_directory = S_ISDIR(st.st_mode);
+    info.size = st.st_size;
+    info.mtime = st.st_mtime;
+    info.inode = st.st_ino;
+    info.device = st.st_dev;
+    std::ostringstream etag;
+    etag << std::hex << '"' << st.st_ino << '-' << st.st_mtime << '-'
+         << st.st_size << '"';
+    info.etag = etag.str();
+    info.last_modified = format_http_date(st.st_mtime);
+  } else {
+    info.exists = false;
+    info.is_directory = false;
+    info.size = 0;
+    info.mtime = 0;
+    info.inode = 0;
+    info.device = 0;
+  }
+
+  if (valid_seconds > 0) {
+    if (it == info_entries.end() && info_entries.size() >= MAX_INFO_ENTRIES)
+      prune_info_entries(now);
+    InfoEntry &entry = info_entries[path];
+    entry.info = info;
+    entry.checked_at = now;
+  }
+  return info;
+}
+
+bool FileCache::should_map(const FileInfo &info) const {
+  if (!info.exists || info.is_directory || info.size <= 0)
+    return false;
+  size_t size = static_cast<size_t>(info.size);
+  return size >= min_mmap_size && size <= max_mapped_bytes;
+}
+
+bool FileCache::should_copy(const FileInfo &info) const {
+  if (!info.exists || info.is_directory || info.size < 0)
+    return false;
+  return static_cast<size_t>(info.size) < min_mmap_size;
+}
+
+std::shared_ptr<const MappedFile>
+FileCache::map_file(const std::string &path, const FileInfo &info) {
+  std::map<std::string, MappingEntry>::iterator it = mappings.find(path);
+  if (it != mappings.end()) {
+    MappingEntry &entry = it->second;
+    if (entry.inode == info.inode && entry.device == info.device &&
+        entry.mtime == info.mtime && entry.size == info.size) {
+      lru.splice(lru.begin(), lru, entry.lru_position);
+      return entry.mapping;
+    }
+    // File changed on disk: in-flight responses keep the old pages
+    remove_mapping(it);
+  }
+
+  if (!should_map(info))
+    return std::shared_ptr<const MappedFile>();
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::shared_ptr<const MappedFile>();
+  size_t length = static_cast<size_t>(info.size);
+  void *data = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    std::cerr << "mmap failed for " << path << ": " << strerror(errno)
+              << std::endl;
+    return std::shared_ptr<const MappedFile>();
+  }
+  madvise(data, length, MADV_SEQUENTIAL);
+  madvise(data, length, MADV_WILLNEED);
+
+  evict_mappings(length);
+
+  MappingEntry entry;
+  entry.mapping.reset(new MappedFile(data, length, fd));
+  entry.inode = info.inode;
+  entry.device = info.device;
+  entry.mtime = info.mtime;
+  entry.size = info.size;
+  lru.push_front(path);
+  entry.lru_position = lru.begin();
+  mappings[path] = entry;
+  mapped_bytes += length;
+  return entry.mapping;
+}
+
+std::shared_ptr<const OpenFile> FileCache::open_file(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::shared_ptr<const OpenFile>();
+  return std::shared_ptr<const OpenFile>(new OpenFile(fd));
+}
+
+bool FileCache::read_file(const std::string &path, std::string &contents) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return false;
+  }
+  // The size as of now, not as cached. A file that grows meanwhile is cut
+  // at this size; one that shrinks ends at the early EOF.
+  contents.resize(static_cast<size_t>(st.st_size));
+  size_t total = 0;
+  while (total < contents.size()) {
+    ssize_t bytes_read = pread(fd, &contents[total], contents.size() - total,
+                               static_cast<off_t>(total));
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+    if (bytes_read < 0) {
+      close(fd);
+      return false;
+    }
+    if (bytes_read == 0)
+      break;
+    total += static_cast<size_t>(bytes_read);
+  }
+  close(fd);
+  contents.resize(total);
+  return true;
+}
+
+void FileCache::invalidate(const std::string &path) {
+  info_entries.erase(path);
+  std::map<std::string, MappingEntry>::iterator it = mappings.find(path);
+  if (it != mappings.end())
+    remove_mapping(it);
+}
+
+size_t FileCache::get_mapped_bytes() const { return mapped_bytes; }
+
+// Drop least recently used mappings until needed_bytes fits under the cap.
+// Evicted mappings stay alive for as long as a response still references them.
+void FileCache::evict_mappings(size_t needed_bytes) {
+  while (!lru.empty() && mapped_bytes + needed_bytes > max_mapped_bytes) {
+    std::map<std::string, MappingEntry>::iterator it = mappings.find(lru.back());
+    if (it == mappings.end()) {
+      lru.pop_back();
+      continue;
+    }
+    remove_mapping(it);
+  }
+}
+
+void FileCache::remove_mapping(
+    std::map<std::string, MappingEntry>::iterator it) {
+  mapped_bytes -= it->second.mapping->get_length();
+  lru.erase(it->second.lru_position);
+  mappings.erase(it);
+}
+
+void FileCache::prune_info_entries(time_t now) {
+  for (std::map<std::string, InfoEntry>::iterator it = info_entries.begin();
+       it != info_entries.end();) {
+    if (now - it->second.checked_at >= valid_seconds)
+      info_entries.erase(it++);
+    else
+      ++it;
+  }
+  // Everything is fresh (e.g. a 404 storm): start over rather than grow
+  if (info_entries.size() >= MAX_INFO_ENTRIES)
+    info_entries.clear();
+}
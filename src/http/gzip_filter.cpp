@@ -0,0 +1,353 @@
+#include "../../includes/http/gzip_filter.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+double accepted_encoding_quality(const std::string &accept_encoding,
+                                 const std::string &coding) {
+  double coding_q = -1;
+  double star_q = -1;
+  size_t pos = 0;
+  while (pos < accept_encoding.size()) {
+    size_t comma = accept_encoding.find(',', pos);
+    if (comma == std::string::npos)
+      comma = accept_encoding.size();
+    std::string item = accept_encoding.substr(pos, comma - pos);
+    pos = comma + 1;
+
+    double q = 1;
+    size_t semi = item.find(';');
+    if (semi != std::string::npos) {
+      size_t q_pos = item.find("q=", semi);
+      if (q_pos != std::string::npos)
+        q = std::strtod(item.c_str() + q_pos + 2, NULL);
+      item = item.substr(0, semi);
+    }
+    size_t start = item.find_first_not_of(" \t");
+    if (start == std::string::npos)
+      continue;
+    item = item.substr(start, item.find_last_not_of(" \t") - start + 1);
+    for (size_t i = 0; i < item.size(); ++i)
+      item[i] = tolower(item[i]);
+
+    if (item == coding || (coding == "gzip" && item == "x-gzip"))
+      coding_q = q;
+    else if (item == "*")
+      star_q = q;
+  }
+  if (coding_q >= 0)
+    return coding_q;
+  return star_q > 0 ? star_q : 0;
+}
+
+// ---------------- GzipStream -----------------
+
+GzipStream::GzipStream(int level, bool gzip_wrapper)
+    : initialized(false), finished(false) {
+  stream.zalloc = Z_NULL;
+  stream.zfree = Z_NULL;
+  stream.opaque = Z_NULL;
+  // windowBits 15 gives a zlib stream; +16 wraps it in a gzip header
+  int window_bits = gzip_wrapper ? 15 + 16 : 15;
+  initialized = deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8,
+                             Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+GzipStream::~GzipStream() {
+  if (initialized)
+    deflateEnd(&stream);
+}
+
+bool GzipStream::is_valid() const { return initialized; }
+
+bool GzipStream::write(const char *data, size_t length, std::string &output,
+                       bool finish) {
+  if (!initialized || finished)
+    return false;
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  stream.avail_in = static_cast<uInt>(length);
+  int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+  char buffer[16384];
+  int result;
+  do {
+    stream.next_out = reinterpret_cast<Bytef *>(buffer);
+    stream.avail_out = sizeof(buffer);
+    result = deflate(&stream, flush);
+    if (result == Z_STREAM_ERROR)
+      return false;
+    output.append(buffer, sizeof(buffer) - stream.avail_out);
+  } while (stream.avail_out == 0 || (finish && result != Z_STREAM_END));
+  if (finish)
+    finished = true;
+  return true;
+}
+
+bool GzipStream::flush(std::string &output) {
+  if (!initialized || finished)
+    return false;
+  stream.next_in = Z_NULL;
+  stream.avail_in = 0;
+  char buffer[16384];
+  do {
+    stream.next_out = reinterpret_cast<Bytef *>(buffer);
+    stream.avail_out = sizeof(buffer);
+    // Z_BUF_ERROR only means there was nothing new to flush
+    if (deflate(&stream, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+      return false;
+    output.append(buffer, sizeof(buffer) - stream.avail_out);
+  } while (stream.avail_out == 0);
+  return true;
+}
+
+// ---------------- GzipBodyStream -----------------
+
+GzipBodyStream::GzipBodyStream(const std::vector<BodySegment> &source,
+                               int level, bool gzip_wrapper)
+    : source(source), position(0), consumed(0),
+      encoder(level, gzip_wrapper), finished(false) {}
+
+GzipBodyStream::~GzipBodyStream() {}
+
+bool GzipBodyStream::read(std::string &output, size_t max_bytes, bool &done) {
+  done = false;
+  if (finished) {
+    done = true;
+    return true;
+  }
+  size_t start = output.size();
+  size_t budget = max_bytes * INPUT_PIECES;
+  while (position < source.size()) {
+    // Hand over what is ready; an empty result brings the writer back on
+    // the next POLLOUT, so big bodies are compressed a slice at a time
+    if (output.size() > start || budget == 0)
+      return true;
+    const BodySegment &segment = source[position];
+    std::string input;
+    if (segment.type == BODY_STREAM) {
+      bool input_done = false;
+      if (!segment.stream->read(input, max_bytes, input_done))
+        return false;
+      if (input_done)
+        ++position;
+      else if (input.empty())
+        return true; // Source not ready: wait on its descriptor
+    } else {
+      size_t piece = std::min(max_bytes, segment.length - consumed);
+      if (!segment.read_into(input, consumed, piece))
+        return false;
+      consumed += piece;
+      budget -= std::min(budget, piece);
+      if (consumed == segment.length) {
+        ++position;
+        consumed = 0;
+      }
+    }
+    if (!encoder.write(input.data(), input.size(), output, false))
+      return false;
+    // Pass data on as soon as the source produced it
+    if (segment.type == BODY_STREAM && !input.empty())
+      return encoder.flush(output);
+  }
+  finished = true;
+  done = true;
+  return encoder.write(NULL, 0, output, true);
+}
+
+int GzipBodyStream::wait_fd() const {
+  if (position < source.size() && source[position].type == BODY_STREAM)
+    return source[position].stream->wait_fd();
+  return -1;
+}
+
+// ---------------- CompressionCache -----------------
+
+CompressionCache::CompressionCache()
+    : cached_bytes(0), max_bytes(16 * 1024 * 1024) {}
+
+CompressionCache &CompressionCache::instance() {
+  static CompressionCache cache;
+  return cache;
+}
+
+// Called at startup and on reload: keeps what still fits the new budget
+void CompressionCache::configure(size_t max_bytes) {
+  this->max_bytes = max_bytes;
+  evict(0);
+}
+
+std::shared_ptr<const std::string>
+CompressionCache::get(const std::string &key) {
+  std::map<std::string, Entry>::iterator it = entries.find(key);
+  if (it == entries.end())
+    return std::shared_ptr<const std::string>();
+  lru.splice(lru.begin(), lru, it->second.lru_position);
+  return it->second.body;
+}
+
+void CompressionCache::put(const std::string &key,
+                           const std::shared_ptr<const std::string> &body) {
+  if (body->size() > max_bytes || entries.count(key))
+    return;
+  evict(body->size());
+  lru.push_front(key);
+  Entry entry;
+  entry.body = body;
+  entry.lru_position = lru.begin();
+  entries[key] = entry;
+  cached_bytes += body->size();
+}
+
+size_t CompressionCache::get_max_bytes() const { return max_bytes; }
+
+// Drop least recently used bodies until needed_bytes more fit the budget
+void CompressionCache::evict(size_t needed_bytes) {
+  while (!lru.empty() && cached_bytes + needed_bytes > max_bytes) {
+    std::map<std::string, Entry>::iterator oldest = entries.find(lru.back());
+    cached_bytes -= oldest->second.body->size();
+    entries.erase(oldest);
+    lru.pop_back();
+  }
+}
+
+// ---------------- GzipFilter -----------------
+
+static std::string lowercase(const std::string &str) {
+  std::string result = str;
+  for (size_t i = 0; i < result.size(); ++i)
+    result[i] = tolower(result[i]);
+  return result;
+}
+
+GzipFilter::GzipFilter(const ServerConfig *server_config)
+    : server_config(server_config) {}
+
+GzipFilter::~GzipFilter() {}
+
+void GzipFilter::apply(const HttpRequest &request, HttpResponse &response,
+                       bool cacheable) {
+  if (!server_config || !server_config->gzip)
+    return;
+
+  // Only complete 2xx-5xx representations; never ranges or revalidations
+  int status = response.get_status_code();
+  if (status < 200 || status == 204 || status == 206 || status == 304)
+    return;
+  if (response.has_header("Content-Encoding") ||
+      response.has_header("Content-Range"))
+    return;
+  if (!is_compressible_type(response.get_header("Content-Type")))
+    return;
+  std::string coding = select_coding(request);
+  if (coding.empty())
+    return;
+
+  // HEAD answered from metadata: decide from the stated length and send
+  // the headers a GET would get. The compressed length is not known.
+  if (response.is_header_only() && !response.has_body()) {
+    size_t stated = static_cast<size_t>(
+        strtoull(response.get_header("Content-Length").c_str(), NULL, 10));
+    if (stated < server_config->gzip_min_length)
+      return;
+    mark_encoded(response, coding);
+    response.remove_header("Content-Length");
+    return;
+  }
+
+  // Streamed body: compress while sending, no size check and no caching
+  if (!response.has_known_length()) {
+    compress_while_sending(response, coding);
+    return;
+  }
+  size_t length = response.get_content_length();
+  if (length < server_config->gzip_min_length)
+    return;
+
+  // Static files carry an ETag: reuse the compressed body of that version.
+  // The cache is shared by all servers, so the key includes the level.
+  std::string etag = response.get_header("ETag");
+  std::string cache_key;
+  CompressionCache &cache = CompressionCache::instance();
+  std::shared_ptr<const std::string> compressed;
+  if (cacheable && !etag.empty()) {
+    cache_key = coding + " " +
+                std::to_string(server_config->gzip_comp_level) + " " + etag;
+    compressed = cache.get(cache_key);
+  }
+  // Compressing in one go only pays off when the result is kept; other
+  // bodies of some size are compressed a slice at a time while sending
+  bool keep = !cache_key.empty() && length <= cache.get_max_bytes();
+  if (!compressed && !keep && length > MAX_INLINE_LENGTH) {
+    compress_while_sending(response, coding);
+    return;
+  }
+  if (!compressed) {
+    std::string body;
+    if (!response.read_body(body))
+      return;
+    std::shared_ptr<std::string> output(
+        new std::string(compress(body, coding)));
+    if (output->empty() || output->size() >= body.size())
+      return; // Not worth it (or zlib failed): send the original
+    compressed = output;
+    if (!cache_key.empty())
+      cache.put(cache_key, compressed);
+  }
+
+  mark_encoded(response, coding);
+  response.set_body(BodySegment::from_buffer(compressed));
+}
+
+void GzipFilter::compress_while_sending(HttpResponse &response,
+                                        const std::string &coding) {
+  std::shared_ptr<BodyStream> stream(new GzipBodyStream(
+      response.get_body(), server_config->gzip_comp_level, coding == "gzip"));
+  mark_encoded(response, coding);
+  response.set_body(BodySegment::from_stream(stream));
+}
+
+void GzipFilter::mark_encoded(HttpResponse &response,
+                              const std::string &coding) {
+  response.remove_header("Accept-Ranges");
+  // The encoded bytes differ, so the validator can only be weak
+  std::string etag = response.get_header("ETag");
+  if (!etag.empty() && etag.compare(0, 2, "W/") != 0)
+    response.set_header("ETag", "W/" + etag);
+  response.set_header("Content-Encoding", coding);
+  if (!response.has_header("Vary"))
+    response.set_header("Vary", "Accept-Encoding");
+}
+
+std::string GzipFilter::select_coding(const HttpRequest &request) {
+  std::string accept_encoding = request.get_header("Accept-Encoding");
+  if (accept_encoding.empty())
+    return "";
+  double gzip_q = accepted_encoding_quality(accept_encoding, "gzip");
+  double deflate_q = accepted_encoding_quality(accept_encoding, "deflate");
+  if (gzip_q > 0 && gzip_q >= deflate_q)
+    return "gzip";
+  if (deflate_q > 0)
+    return "deflate";
+  return "";
+}
+
+bool GzipFilter::is_compressible_type(const std::string &content_type) {
+  std::string type = lowercase(content_type.substr(0, content_type.find(';')));
+  size_t end = type.find_last_not_of(" \t");
+  type = end == std::string::npos ? "" : type.substr(0, end + 1);
+  const std::vector<std::string> &types = server_config->gzip_types;
+  for (size_t i = 0; i < types.size(); ++i) {
+    if (types[i] == "*" || types[i] == type)
+      return true;
+  }
+  return false;
+}
+
+std::string GzipFilter::compress(const std::string &body,
+                                 const std::string &coding) {
+  GzipStream stream(server_config->gzip_comp_level, coding == "gzip");
+  std::string output;
+  if (!stream.is_valid() ||
+      !stream.write(body.data(), body.size(), output, true))
+    return "";
+  return output;
+}
@@ -0,0 +1,172 @@
+#include "../../includes/http/header_writer.hpp"
+#include "../../includes/http/http_date.hpp"
+#include <charconv>
+
+namespace {
+
+struct StatusEntry {
+  int code;
+  const char *reason;
+  const char *line; // Complete "HTTP/1.1 <code> <reason>\r\n"
+  size_t line_length;
+};
+
+#define STATUS_ENTRY(code, reason)                                             \
+  {code, reason, "HTTP/1.1 " #code " " reason "\r\n",                          \
+   sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1}
+
+// IANA HTTP status code registry
+constexpr StatusEntry STATUS_TABLE[] = {
+    STATUS_ENTRY(100, "Continue"),
+    STATUS_ENTRY(101, "Switching Protocols"),
+    STATUS_ENTRY(102, "Processing"),
+    STATUS_ENTRY(103, "Early Hints"),
+    STATUS_ENTRY(200, "OK"),
+    STATUS_ENTRY(201, "Created"),
+    STATUS_ENTRY(202, "Accepted"),
+    STATUS_ENTRY(203, "Non-Authoritative Information"),
+    STATUS_ENTRY(204, "No Content"),
+    STATUS_ENTRY(205, "Reset Content"),
+    STATUS_ENTRY(206, "Partial Content"),
+    STATUS_ENTRY(207, "Multi-Status"),
+    STATUS_ENTRY(208, "Already Reported"),
+    STATUS_ENTRY(226, "IM Used"),
+    STATUS_ENTRY(300, "Multiple Choices"),
+    STATUS_ENTRY(301, "Moved Permanently"),
+    STATUS_ENTRY(302, "Found"),
+    STATUS_ENTRY(303, "See Other"),
+    STATUS_ENTRY(304, "Not Modified"),
+    STATUS_ENTRY(305, "Use Proxy"),
+    STATUS_ENTRY(307, "Temporary Redirect"),
+    STATUS_ENTRY(308, "Permanent Redirect"),
+    STATUS_ENTRY(400, "Bad Request"),
+    STATUS_ENTRY(401, "Unauthorized"),
+    STATUS_ENTRY(402, "Payment Required"),
+    STATUS_ENTRY(403, "Forbidden"),
+    STATUS_ENTRY(404, "Not Found"),
+    STATUS_ENTRY(405, "Method Not Allowed"),
+    STATUS_ENTRY(406, "Not Acceptable"),
+    STATUS_ENTRY(407, "Proxy Authentication Required"),
+    STATUS_ENTRY(408, "Request Timeout"),
+    STATUS_ENTRY(409, "Conflict"),
+    STATUS_ENTRY(410, "Gone"),
+    STATUS_ENTRY(411, "Length Required"),
+    STATUS_ENTRY(412, "Precondition Failed"),
+    STATUS_ENTRY(413, "Payload Too Large"),
+    STATUS_ENTRY(414, "URI Too Long"),
+    STATUS_ENTRY(415, "Unsupported Media Type"),
+    STATUS_ENTRY(416, "Range Not Satisfiable"),
+    STATUS_ENTRY(417, "Expectation Failed"),
+    STATUS_ENTRY(418, "I'm a teapot"),
+    STATUS_ENTRY(421, "Misdirected Request"),
+    STATUS_ENTRY(422, "Unprocessable Content"),
+    STATUS_ENTRY(423, "Locked"),
+    STATUS_ENTRY(424, "Failed Dependency"),
+    STATUS_ENTRY(425, "Too Early"),
+    STATUS_ENTRY(426, "Upgrade Required"),
+    STATUS_ENTRY(428, "Precondition Required"),
+    STATUS_ENTRY(429, "Too Many Requests"),
+    STATUS_ENTRY(431, "Request Header Fields Too Large"),
+    STATUS_ENTRY(451, "Unavailable For Legal Reasons"),
+    STATUS_ENTRY(500, "Internal Server Error"),
+    STATUS_ENTRY(501, "Not Implemented"),
+    STATUS_ENTRY(502, "Bad Gateway"),
+    STATUS_ENTRY(503, "Service Unavailable"),
+    STATUS_ENTRY(504, "Gateway Timeout"),
+    STATUS_ENTRY(505, "HTTP Version Not Supported"),
+    STATUS_ENTRY(506, "Variant Also Negotiates"),
+    STATUS_ENTRY(507, "Insufficient Storage"),
+    STATUS_ENTRY(508, "Loop Detected"),
+    STATUS_ENTRY(510, "Not Extended"),
+    STATUS_ENTRY(511, "Network Authentication Required"),
+};
+
+#undef STATUS_ENTRY
+
+constexpr size_t STATUS_COUNT = sizeof(STATUS_TABLE) / sizeof(STATUS_TABLE[0]);
+constexpr int FIRST_STATUS = 100;
+constexpr int LAST_STATUS = 599;
+constexpr unsigned char NO_ENTRY = 0xFF;
+
+// Code -> table slot, built at compile time so lookups are one array read
+struct StatusIndex {
+  unsigned char slot[LAST_STATUS - FIRST_STATUS + 1];
+
+  constexpr StatusIndex() : slot() {
+    for (int i = 0; i <= LAST_STATUS - FIRST_STATUS; ++i)
+      slot[i] = NO_ENTRY;
+    for (size_t i = 0; i < STATUS_COUNT; ++i)
+      slot[STATUS_TABLE[i].code - FIRST_STATUS] =
+          static_cast<unsigned char>(i);
+  }
+};
+
+constexpr StatusIndex STATUS_INDEX;
+static_assert(STATUS_COUNT < NO_ENTRY, "status table too large for index");
+
+const StatusEntry *find_status(int status_code) {
+  if (status_code < FIRST_STATUS || status_code > LAST_STATUS)
+    return NULL;
+  unsigned char slot = STATUS_INDEX.slot[status_code - FIRST_STATUS];
+  return slot == NO_ENTRY ? NULL : &STATUS_TABLE[slot];
+}
+
+} // namespace
+
+const char *status_reason(int status_code) {
+  const StatusEntry *entry = find_status(status_code);
+  return entry ? entry->reason : NULL;
+}
+
+HeaderWriter::HeaderWriter(std::string &buffer) : buffer(buffer) {}
+
+HeaderWriter::~HeaderWriter() {}
+
+void HeaderWriter::status_line(int status_code, const char *reason) {
+  const StatusEntry *entry = find_status(status_code);
+  if (reason == NULL && entry) {
+    buffer.append(entry->line, entry->line_length);
+    return;
+  }
+  if (reason == NULL)
+    reason = "Unknown Status";
+  buffer.append("HTTP/1.1 ", 9);
+  append_number(static_cast<unsigned long long>(status_code));
+  buffer.push_back(' ');
+  buffer.append(reason);
+  buffer.append("\r\n", 2);
+}
+
+void HeaderWriter::header(const std::string &name, const std::string &value) {
+  header(name.data(), name.size(), value.data(), value.size());
+}
+
+void HeaderWriter::header(const char *name, size_t name_length,
+                          const char *value, size_t value_length) {
+  buffer.append(name, name_length);
+  buffer.append(": ", 2);
+  buffer.append(value, value_length);
+  buffer.append("\r\n", 2);
+}
+
+void HeaderWriter::header(const char *name, size_t name_length,
+                          unsigned long long value) {
+  buffer.append(name, name_length);
+  buffer.append(": ", 2);
+  append_number(value);
+  buffer.append("\r\n", 2);
+}
+
+void HeaderWriter::date_header() {
+  const std::string &date = current_http_date();
+  header("Date", 4, date.data(), date.size());
+}
+
+void HeaderWriter::end() { buffer.append("\r\n", 2); }
+
+void HeaderWriter::append_number(unsigned long long value) {
+  char digits[24];
+  std::to_chars_result result =
+      std::to_chars(digits, digits + sizeof(digits), value);
+  buffer.append(digits, result.ptr - digits);
+}
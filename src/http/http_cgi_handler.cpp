@@ -12,7 +12,9 @@
 
 #include "../../includes/http/http_cgi_handler.hpp"
 #include "../includes/webserv.hpp"
+#include <fcntl.h>
 #include <signal.h>
+#include <strings.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -20,9 +22,12 @@
 
 CgiHandler::CgiHandler() {}
 CgiHandler::~CgiHandler() {}
-std::string CgiHandler::execute_cgi(const HttpRequest &request,
-                                    const LocationConfig &location,
-                                    const std::string &script_path) {
+HttpResponse CgiHandler::execute_cgi(const HttpRequest &request,
+                                     const LocationConfig &location,
+                                     const std::string &script_path,
+                                     const std::string &remote_addr,
+                                     int remote_port,
+                                     std::shared_ptr<CgiOutputStream> &output) {
   std::cout << "Executing CGI script: " << location.cgi_pass << " "
             << script_path << std::endl;
 
@@ -37,14 +42,18 @@ std::string CgiHandler::execute_cgi(const HttpRequest &request,
     std::cerr << "CGI script is not executable: " << script_path << std::endl;
     return create_cgi_errror(403, "CGI script is not executable");
   }
+  // Close-on-exec: dup2() clears it on the script's stdin/stdout, and no
+  // other process (another script, an upgraded binary) inherits the pipes
   int input_pipe[2], output_pipe[2];
-  if (pipe(input_pipe) == -1 || pipe(output_pipe) == -1) {
+  if (pipe2(input_pipe, O_CLOEXEC) == -1 ||
+      pipe2(output_pipe, O_CLOEXEC) == -1) {
     std::cerr << "Failed to create pipes for CGI execution" << std::endl;
     return create_cgi_errror(500, "Failed to create pipes for CGI execution");
   }
 
   std::vector<std::string> env_vars =
-      build_cgi_environment(request, location, script_path);
+      build_cgi_environment(request, location, script_path, remote_addr,
+                            remote_port);
   char **env_array = create_env_array(env_vars);
 
   pid_t cgi_pid = fork_cgi_process(location.cgi_pass, script_path, env_array,
@@ -60,39 +69,46 @@ std::string CgiHandler::execute_cgi(const HttpRequest &request,
   close(input_pipe[0]);
   close(output_pipe[1]);
 
+  cleanup_env_array(env_array, env_vars.size());
+
+  // The request body is written, and the headers read, as the pipes become
+  // ready: the event loop keeps serving other clients meanwhile
   if (request.get_method() == POST && !request.get_body().empty()) {
-    write_cgi_input(input_pipe[1], request.get_body());
-  }
-  close(input_pipe[1]);
-
-  std::string cgi_output = read_cgi_output(output_pipe[0], cgi_pid);
-  close(output_pipe[0]);
-  if (!wait_for_process(cgi_pid, CGI_TIMEOUT)) {
-    std::cerr << "CGI process timed out, killing process" << std::endl;
-    kill(cgi_pid, SIGKILL);
-    waitpid(cgi_pid, NULL, 0);
-    cleanup_env_array(env_array, env_vars.size());
-    return create_cgi_errror(504, "CGI process timed out");
+    output.reset(new CgiOutputStream(output_pipe[0], cgi_pid, input_pipe[1],
+                                     request.get_body()));
+  } else {
+    close(input_pipe[1]);
+    output.reset(new CgiOutputStream(output_pipe[0], cgi_pid, -1, ""));
   }
+  return HttpResponse();
+}
 
-  int status;
-  waitpid(cgi_pid, &status, 0);
-  cleanup_env_array(env_array, env_vars.size());
-  // Prefer successful output if present, even if exit code != 0
-  if (!cgi_output.empty()) {
-    return build_http_response(cgi_output);
+HttpResponse
+CgiHandler::build_response(const std::shared_ptr<CgiOutputStream> &output) {
+  const std::string &cgi_output = output->get_head();
+  if (!output->at_eof()) {
+    HttpResponse response = build_http_response(cgi_output);
+    response.append_body(BodySegment::from_stream(output));
+    return response;
   }
-  if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-    return build_http_response(cgi_output);
+  if (cgi_output.empty()) {
+    std::cerr << "CGI script exited without output" << std::endl;
+    return create_cgi_errror(500, "CGI script execution failed");
   }
-  std::cerr << "CGI script exited with error and no output" << std::endl;
-  return create_cgi_errror(500, "CGI script execution failed");
+  return build_http_response(cgi_output);
+}
+
+HttpResponse CgiHandler::build_timeout_response() {
+  std::cerr << "CGI process timed out, killing process" << std::endl;
+  return create_cgi_errror(504, "CGI process timed out");
 }
 
 std::vector<std::string>
 CgiHandler::build_cgi_environment(const HttpRequest &request,
                                   const LocationConfig &location,
-                                  const std::string &script_path) {
+                                  const std::string &script_path,
+                                  const std::string &remote_addr,
+                                  int remote_port) {
   (void)location;
   std::vector<std::string> env_vars;
 
@@ -103,6 +119,8 @@ CgiHandler::build_cgi_environment(const HttpRequest &request,
     method_str = "POST";
   } else if (request.get_method() == DELETE) {
     method_str = "DELETE";
+  } else if (request.get_method() == HEAD) {
+    method_str = "HEAD";
   } else {
     method_str = "UNKNOWN";
   }
@@ -115,6 +133,10 @@ CgiHandler::build_cgi_environment(const HttpRequest &request,
   env_vars.push_back("REQUEST_URI=" + request.get_uri());
   env_vars.push_back("SCRIPT_NAME=" + script_path);
   env_vars.push_back("QUERY_STRING=" + request.get_query_string());
+  // Clients on a Unix socket have no IP: "unix:" and no port, as in nginx
+  env_vars.push_back("REMOTE_ADDR=" + remote_addr);
+  if (remote_port >= 0)
+    env_vars.push_back("REMOTE_PORT=" + std::to_string(remote_port));
 
   // Content lenght for POST request
   if (request.get_method() == POST) {
@@ -200,89 +222,29 @@ pid_t CgiHandler::fork_cgi_process(const std::string &cgi_binary,
   }
   return pid;
 }
-std::string CgiHandler::read_cgi_output(int output_fd, pid_t cgi_pid) {
-  std::string output;
-  char buffer[BUFFER_SIZE];
-
-  // set non-blocking mode for reading
-  int flags = fcntl(output_fd, F_GETFL, 0);
-  fcntl(output_fd, F_SETFL, flags | O_NONBLOCK);
-  time_t start_time = time(NULL);
-
-  while (time(NULL) - start_time < CGI_TIMEOUT) {
-    ssize_t bytes_read = read(output_fd, buffer, sizeof(buffer) - 1);
-
-    if (bytes_read > 0) {
-      buffer[bytes_read] = '\0';
-      output += buffer;
-      start_time = time(NULL);
-    } else if (bytes_read == 0) {
-      break;
-    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-      std::cerr << "Error reading CGI output: " << strerror(errno) << std::endl;
-      break;
-    }
-
-    // Check if the process is still running
-    if (kill(cgi_pid, 0) != 0) {
-      break;
-    }
-    usleep(10000); // 10ms
-  }
-  return output;
+// End of the header block in the script's output, npos if not in yet
+static size_t find_header_end(const std::string &cgi_output) {
+  size_t header_end = cgi_output.find("\r\n\r\n");
+  if (header_end != std::string::npos)
+    return header_end + 4;
+  header_end = cgi_output.find("\n\n");
+  if (header_end != std::string::npos)
+    return header_end + 2;
+  return std::string::npos;
 }
 
-void CgiHandler::write_cgi_input(int input_fd, const std::string &input_data) {
-  size_t total_written = 0;
-  const char *data = input_data.c_str();
-  size_t data_size = input_data.length();
-
-  while (total_written < data_size) {
-    ssize_t bytes_written =
-        write(input_fd, data + total_written, data_size - total_written);
-
-    if (bytes_written < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        continue;
-      } else {
-        std::cerr << "Error writing to CGI input: " << strerror(errno)
-                  << std::endl;
-        return;
-      }
-    } else if (bytes_written == 0) {
-      break;
-    }
-    total_written += bytes_written;
-  }
-}
+HttpResponse CgiHandler::build_http_response(const std::string &cgi_output) {
+  HttpResponse response(200);
 
-std::string CgiHandler::build_http_response(const std::string &cgi_output) {
   // find the separator between headers and body
-  size_t header_end = cgi_output.find("\r\n\r\n");
+  size_t header_end = find_header_end(cgi_output);
   if (header_end == std::string::npos) {
-    header_end = cgi_output.find("\n\n");
-    if (header_end == std::string::npos) {
-      std::ostringstream response;
-      response << "HTTP/1.1 200 OK\r\n";
-      response << "Content-Type: text/html\r\n";
-      response << "Content-Lenght: " << cgi_output.length() << "\r\n";
-      response << "\r\n";
-      response << cgi_output;
-      return response.str();
-    }
-    header_end += 2;
-  } else {
-    header_end += 4;
+    response.set_header("Content-Type", "text/html");
+    response.set_body(cgi_output);
+    return response;
   }
 
   std::string headers = cgi_output.substr(0, header_end);
-  std::string body = cgi_output.substr(header_end);
-
-  // Parse CGI headers
-  bool has_status = false;
-  bool has_content_type = false;
-  std::string status = "200 OK";
-
   std::istringstream header_stream(headers);
   std::string line;
 
@@ -304,97 +266,184 @@ std::string CgiHandler::build_http_response(const std::string &cgi_output) {
         header_value.erase(header_value.length() - 1);
       }
 
-      if (header_name == "Status") {
-        status = header_value;
-        has_status = true;
-      } else if (header_name == "Content-Type" ||
-                 header_name == "Content-type") {
-        has_content_type = true;
+      if (strcasecmp(header_name.c_str(), "Status") == 0) {
+        // "Status: 404 Not Found"
+        int code = std::atoi(header_value.c_str());
+        size_t reason_pos = header_value.find(' ');
+        if (code >= 100 && code <= 999)
+          response.set_status(code, reason_pos == std::string::npos
+                                        ? ""
+                                        : header_value.substr(reason_pos + 1));
+      } else if (strcasecmp(header_name.c_str(), "Content-Length") != 0) {
+        // The length is recomputed from the body when the response is sent
+        response.add_header(header_name, header_value);
       }
     }
   }
 
-  // Build HTTP response
-  std::ostringstream response;
-  if (!has_status) {
-    response << "HTTP/1.1 " << status << "\r\n";
-  } else {
-    response << "HTTP/1.1 " << status << "\r\n";
+  if (!response.has_header("Content-Type")) {
+    response.set_header("Content-Type", "text/html");
   }
 
-  // Add CGI headers
-  std::istringstream header_stream2(headers);
-  while (std::getline(header_stream2, line)) {
-    if (line.empty() || line == "\r")
-      break;
+  response.set_body(cgi_output.substr(header_end));
+  return response;
+}
+HttpResponse CgiHandler::create_cgi_errror(int error_code,
+                                           const std::string &message) {
+  std::string status_message = HttpResponse::get_status_message(error_code);
+  std::ostringstream body;
+  body << "<!DOCTYPE html>\n";
+  body << "<html><head><title>" << error_code << " " << status_message
+       << "      </title></head>\n";
+  body << "<body><h1>" << error_code << " " << status_message << "</h1>\n";
+  body << "<p>" << message << "</p>\n";
+  body << "<hr><p>webserv/1.0 CGI</p></body></html>\n";
 
-    size_t colon_pos = line.find(':');
-    if (colon_pos != std::string::npos) {
-      std::string header_name = line.substr(0, colon_pos);
-      if (header_name != "Status") {
-        response << line << "\r\n";
-      }
+  HttpResponse response(error_code);
+  response.set_header("Content-Type", "text/html");
+  response.set_body(body.str());
+  return response;
+}
+
+// ---------------- CgiOutputStream -----------------
+
+std::vector<pid_t> CgiOutputStream::exiting;
+
+CgiOutputStream::CgiOutputStream(int fd, pid_t pid, int input_fd,
+                                 const std::string &input)
+    : fd(fd), pid(pid), input_fd(input_fd), input(input), input_sent(0),
+      head_complete(false), eof(false) {
+  // Only this side of the pipes: the script keeps blocking descriptors
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  if (input_fd >= 0)
+    fcntl(input_fd, F_SETFL, fcntl(input_fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+CgiOutputStream::~CgiOutputStream() {
+  close_input();
+  if (fd >= 0)
+    close(fd);
+  // Response abandoned before the script finished
+  finish_process(true);
+}
+
+bool CgiOutputStream::read_headers() {
+  if (head_complete)
+    return true;
+  write_input();
+
+  char buffer[BUFFER_SIZE];
+  while (find_header_end(head) == std::string::npos &&
+         head.size() < MAX_HEADER_SIZE) {
+    ssize_t bytes_read = ::read(fd, buffer, sizeof(buffer));
+    if (bytes_read > 0) {
+      head.append(buffer, bytes_read);
+      continue;
     }
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return false;
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+    if (bytes_read < 0)
+      std::cerr << "Error reading CGI output: " << strerror(errno) << std::endl;
+    close(fd);
+    fd = -1;
+    eof = true;
+    finish_process(false);
+    break;
   }
+  // A script that answers before reading all of its input gets no more
+  head_complete = true;
+  close_input();
+  return true;
+}
 
-  if (!has_content_type) {
-    response << "Content-type: text/html\r\n";
+// Nonblocking: whatever fits in the pipe now, the rest on its next POLLOUT
+void CgiOutputStream::write_input() {
+  while (input_fd >= 0 && input_sent < input.size()) {
+    ssize_t bytes_written = write(input_fd, input.data() + input_sent,
+                                  input.size() - input_sent);
+    if (bytes_written > 0) {
+      input_sent += bytes_written;
+      continue;
+    }
+    if (bytes_written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    if (bytes_written < 0 && errno == EINTR)
+      continue;
+    // EPIPE: the script exited without reading its input
+    std::cerr << "Error writing to CGI input: " << strerror(errno) << std::endl;
+    break;
   }
+  close_input();
+}
 
-  response << "Content-Length: " << body.length() << "\r\n";
-  response << "\r\n";
-  response << body;
-  return response.str();
+void CgiOutputStream::close_input() {
+  if (input_fd < 0)
+    return;
+  close(input_fd);
+  input_fd = -1;
+  input.clear();
 }
-bool CgiHandler::wait_for_process(pid_t pid, int timeout_seconds) {
-  time_t start_time = time(NULL);
 
-  while (time(NULL) - start_time < timeout_seconds) {
-    int status;
-    pid_t result = waitpid(pid, &status, WNOHANG);
+const std::string &CgiOutputStream::get_head() const { return head; }
 
-    if (result == pid)
-      return true;
-    else if (result == -1)
-      return false;
-    usleep(100000); // 100 ms
+bool CgiOutputStream::at_eof() const { return eof; }
+
+int CgiOutputStream::output_fd() const { return fd; }
+
+int CgiOutputStream::input_wait_fd() const { return input_fd; }
+
+bool CgiOutputStream::read(std::string &output, size_t max_bytes,
+                           bool &done) {
+  done = false;
+  if (fd < 0) {
+    done = true;
+    return true;
+  }
+  char buffer[BUFFER_SIZE];
+  size_t want = max_bytes < sizeof(buffer) ? max_bytes : sizeof(buffer);
+  ssize_t bytes_read = ::read(fd, buffer, want);
+  if (bytes_read > 0) {
+    output.append(buffer, bytes_read);
+    return true;
+  }
+  if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return true; // Script has not written more yet
+  if (bytes_read < 0) {
+    std::cerr << "Error reading CGI output: " << strerror(errno) << std::endl;
+    return false;
   }
-  return false;
+  close(fd);
+  fd = -1;
+  finish_process(false);
+  done = true;
+  return true;
 }
 
-std::string CgiHandler::create_cgi_errror(int error_code,
-                                          const std::string &message) {
-  std::ostringstream response;
-  std::string status_message;
+int CgiOutputStream::wait_fd() const { return fd; }
+
+// Reap the script if it has exited. One still running is killed when its
+// response was abandoned, and left to reap_children() either way: the loop
+// never waits for a child.
+void CgiOutputStream::finish_process(bool kill_running) {
+  if (pid <= 0)
+    return;
+  if (waitpid(pid, NULL, WNOHANG) == 0) {
+    if (kill_running)
+      kill(pid, SIGKILL);
+    exiting.push_back(pid);
+  }
+  pid = -1;
+}
 
-  switch (error_code) {
-  case 404:
-    status_message = "Not Found";
-    break;
-  case 403:
-    status_message = "Forbidden";
-    break;
-  case 500:
-    status_message = "Internal Server Error";
-    break;
-  case 504:
-    status_message = "Gateway Timeout";
-    break;
-  default:
-    status_message = "Error";
-    break;
+void CgiOutputStream::reap_children() {
+  for (size_t i = 0; i < exiting.size();) {
+    if (waitpid(exiting[i], NULL, WNOHANG) == 0) {
+      ++i;
+      continue;
+    }
+    exiting[i] = exiting.back();
+    exiting.pop_back();
   }
-  std::ostringstream body;
-  body << "<!DOCTYPE html>\n";
-  body << "<html><head><title>" << error_code << " " << status_message
-       << "      </title></head>\n";
-  body << "<body><h1>" << error_code << " " << status_message << "</h1>\n";
-  body << "<p>" << message << "</p>\n";
-  body << "<hr><p>webserv/1.0 CGI</p></body></html>\n";
-  response << "HTTP/1.1 " << error_code << " " << status_message << "\r\n";
-  response << "Content-Type: text/html\r\n";
-  response << "Content-Length: " << body.str().length() << "\r\n";
-  response << "\r\n";
-  response << body.str();
-  return response.str();
 }
@@ -0,0 +1,40 @@
+#include "../../includes/http/http_date.hpp"
+#include <cstring>
+
+std::string format_http_date(time_t value) {
+  struct tm tm_value;
+  gmtime_r(&value, &tm_value);
+  char buffer[64];
+  size_t length = strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT",
+                           &tm_value);
+  return std::string(buffer, length);
+}
+
+const std::string &current_http_date() {
+  static time_t cached_at = 0;
+  static std::string cached_date;
+  time_t now = time(NULL);
+  if (now != cached_at) {
+    cached_date = format_http_date(now);
+    cached_at = now;
+  }
+  return cached_date;
+}
+
+bool parse_http_date(const std::string &text, time_t &value) {
+  static const char *formats[] = {
+      "%a, %d %b %Y %H:%M:%S GMT", // IMF-fixdate
+      "%A, %d-%b-%y %H:%M:%S GMT", // RFC 850
+      "%a %b %e %H:%M:%S %Y"       // asctime()
+  };
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+    struct tm tm_value;
+    std::memset(&tm_value, 0, sizeof(tm_value));
+    const char *end = strptime(text.c_str(), formats[i], &tm_value);
+    if (end != NULL && *end == '\0') {
+      value = timegm(&tm_value);
+      return value != static_cast<time_t>(-1);
+    }
+  }
+  return false;
+}
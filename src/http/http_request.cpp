@@ -13,6 +13,7 @@
 #include "../../includes/http/http_request.hpp"
 #include <cctype>  // for isdigit, tolower
 #include <cstdlib> // for atoi
+#include <strings.h> // for strncasecmp
 
 HttpRequest::HttpRequest()
     : method(UNKNOWN), state(PARSING_REQUEST_LINE), port(80), error_code(0) {}
@@ -90,6 +91,38 @@ bool HttpRequest::is_chunked() const {
   return transfer_encoding.find("chunked") != std::string::npos;
 }
 
+bool HttpRequest::has_connection_option(const std::string &option) const {
+  std::string connection = get_header("Connection");
+  size_t pos = 0;
+  while (pos < connection.size()) {
+    size_t end = connection.find(',', pos);
+    if (end == std::string::npos)
+      end = connection.size();
+    size_t first = pos;
+    size_t last = end;
+    while (first < last &&
+           (connection[first] == ' ' || connection[first] == '\t'))
+      ++first;
+    while (last > first &&
+           (connection[last - 1] == ' ' || connection[last - 1] == '\t'))
+      --last;
+    if (last - first == option.size() &&
+        strncasecmp(connection.c_str() + first, option.c_str(),
+                    option.size()) == 0)
+      return true;
+    pos = end + 1;
+  }
+  return false;
+}
+
+bool HttpRequest::is_keep_alive() const {
+  if (has_connection_option("close"))
+    return false;
+  if (http_version == "HTTP/1.1")
+    return true;
+  return has_connection_option("keep-alive");
+}
+
 void HttpRequest::set_method(HttpMethod method) { this->method = method; }
 
 void HttpRequest::set_uri(const std::string &uri) {
@@ -0,0 +1,142 @@
+#include "../../includes/http/http_response.hpp"
+#include "../../includes/http/header_writer.hpp"
+#include <strings.h>
+
+HttpResponse::HttpResponse(int status_code)
+    : status_code(status_code), header_only(false) {}
+
+HttpResponse::~HttpResponse() {}
+
+int HttpResponse::get_status_code() const { return status_code; }
+
+const char *HttpResponse::get_reason_phrase() const {
+  if (!reason_phrase.empty())
+    return reason_phrase.c_str();
+  return get_status_message(status_code);
+}
+
+void HttpResponse::set_status(int status_code,
+                              const std::string &reason_phrase) {
+  this->status_code = status_code;
+  this->reason_phrase = reason_phrase;
+}
+
+const char *HttpResponse::get_status_message(int status_code) {
+  const char *reason = status_reason(status_code);
+  return reason ? reason : "Unknown Status";
+}
+
+bool HttpResponse::has_reason_phrase() const { return !reason_phrase.empty(); }
+
+const HttpResponse::HeaderList &HttpResponse::get_headers() const {
+  return headers;
+}
+
+bool HttpResponse::has_header(const std::string &name) const {
+  for (HeaderList::const_iterator it = headers.begin(); it != headers.end();
+       ++it) {
+    if (strcasecmp(it->first.c_str(), name.c_str()) == 0)
+      return true;
+  }
+  return false;
+}
+
+std::string HttpResponse::get_header(const std::string &name) const {
+  for (HeaderList::const_iterator it = headers.begin(); it != headers.end();
+       ++it) {
+    if (strcasecmp(it->first.c_str(), name.c_str()) == 0)
+      return it->second;
+  }
+  return "";
+}
+
+// Replace every existing value, keeping the position of the first one
+void HttpResponse::set_header(const std::string &name,
+                              const std::string &value) {
+  bool replaced = false;
+  for (HeaderList::iterator it = headers.begin(); it != headers.end();) {
+    if (strcasecmp(it->first.c_str(), name.c_str()) != 0) {
+      ++it;
+    } else if (!replaced) {
+      it->second = value;
+      replaced = true;
+      ++it;
+    } else {
+      it = headers.erase(it);
+    }
+  }
+  if (!replaced)
+    headers.push_back(std::make_pair(name, value));
+}
+
+// Append without replacing (Set-Cookie and other repeatable fields)
+void HttpResponse::add_header(const std::string &name,
+                              const std::string &value) {
+  headers.push_back(std::make_pair(name, value));
+}
+
+void HttpResponse::remove_header(const std::string &name) {
+  for (HeaderList::iterator it = headers.begin(); it != headers.end();) {
+    if (strcasecmp(it->first.c_str(), name.c_str()) == 0)
+      it = headers.erase(it);
+    else
+      ++it;
+  }
+}
+
+const std::vector<BodySegment> &HttpResponse::get_body() const { return body; }
+
+void HttpResponse::set_body(const std::string &content) {
+  body.clear();
+  if (!content.empty())
+    body.push_back(BodySegment::from_data(content));
+}
+
+void HttpResponse::set_body(const BodySegment &segment) {
+  body.clear();
+  body.push_back(segment);
+}
+
+void HttpResponse::append_body(const BodySegment &segment) {
+  body.push_back(segment);
+}
+
+void HttpResponse::clear_body() { body.clear(); }
+
+bool HttpResponse::has_body() const {
+  for (size_t i = 0; i < body.size(); ++i) {
+    if (body[i].type == BODY_STREAM || body[i].length > 0)
+      return true;
+  }
+  return false;
+}
+
+void HttpResponse::set_header_only(bool header_only) {
+  this->header_only = header_only;
+}
+
+bool HttpResponse::is_header_only() const { return header_only; }
+
+bool HttpResponse::has_known_length() const {
+  for (size_t i = 0; i < body.size(); ++i) {
+    if (body[i].type == BODY_STREAM)
+      return false;
+  }
+  return true;
+}
+
+size_t HttpResponse::get_content_length() const {
+  size_t length = 0;
+  for (size_t i = 0; i < body.size(); ++i)
+    length += body[i].length;
+  return length;
+}
+
+bool HttpResponse::read_body(std::string &output) const {
+  output.reserve(output.size() + get_content_length());
+  for (size_t i = 0; i < body.size(); ++i) {
+    if (!body[i].read_into(output))
+      return false;
+  }
+  return true;
+}
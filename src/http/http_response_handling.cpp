@@ -11,7 +11,14 @@
 /* ************************************************************************** */
 
 #include "../../includes/http/http_response_handling.hpp"
-#include <dirent.h>
+#include "../../includes/http/autoindex.hpp"
+#include "../../includes/http/error_pages.hpp"
+#include "../../includes/http/gzip_filter.hpp"
+#include "../../includes/http/http_date.hpp"
+#include "../../includes/http/mime_types.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 #include <sys/stat.h>
@@ -22,33 +29,32 @@ HttpResponseHandling::HttpResponseHandling(const ServerConfig *server_config)
 
 HttpResponseHandling::~HttpResponseHandling() {}
 
-std::string
+HttpResponse
 HttpResponseHandling::handle_request(const HttpRequest &request,
                                      const RouteResult &route_result) {
-  // Only serve directory listing automatically for GET requests
-  if (request.get_method() == GET && route_result.is_directory &&
+  // Only serve directory listing automatically for GET (and HEAD) requests
+  if ((request.get_method() == GET || request.get_method() == HEAD) &&
+      route_result.is_directory &&
       route_result.should_list_directory) {
-    return serve_directory_listing(route_result.file_path, request.get_path());
+    return serve_directory_listing(route_result.file_path, request,
+                                   route_result.location);
   }
 
   // Redirection: if router requested redirect, emit 3xx with Location
   if (route_result.is_redirect && !route_result.redirect_location.empty() &&
       route_result.http_status_code >= 300 &&
       route_result.http_status_code <= 399) {
-    std::ostringstream response_stream;
-    response_stream << "HTTP/1.1 " << route_result.http_status_code << " "
-                    << get_status_message(route_result.http_status_code)
-                    << "\r\n";
-    response_stream << "Location: " << route_result.redirect_location << "\r\n";
-    response_stream << "Content-Length: 0\r\n";
-    response_stream << "Server: webserv/1.0\r\n";
-    response_stream << "\r\n";
-    return response_stream.str();
+    HttpResponse response(route_result.http_status_code);
+    response.set_header("Location", route_result.redirect_location);
+    return response;
   }
 
   switch (request.get_method()) {
   case GET:
+  case HEAD:
     return handle_get_request(request, route_result);
+  case OPTIONS:
+    return handle_options_request(route_result);
   case POST:
     return handle_post_request(request, route_result);
   case DELETE:
@@ -58,21 +64,30 @@ HttpResponseHandling::handle_request(const HttpRequest &request,
   }
 }
 
-std::string
-HttpResponseHandling::handle_get_request(const HttpRequest & /*request*/,
+HttpResponse
+HttpResponseHandling::handle_get_request(const HttpRequest &request,
                                          const RouteResult &route_result) {
   const std::string &file_path = route_result.file_path;
   if (file_path.empty()) {
     return build_error_response(404, "Not Found");
   }
-  if (!file_exists(file_path)) {
+  FileInfo info = FileCache::instance().get_info(file_path);
+  if (!info.exists) {
     return build_error_response(404, "Not Found");
   }
-  if (is_directory(file_path)) {
+  if (info.is_directory) {
     // If we reach here with a directory, autoindex must be false; respond 403
     return build_error_response(403, "Forbidden");
   }
-  return serve_file(file_path);
+  return serve_file(file_path, request, route_result.location);
+}
+
+HttpResponse
+HttpResponseHandling::handle_options_request(const RouteResult &route_result) {
+  HttpResponse response(200);
+  if (route_result.location)
+    response.set_header("Allow", route_result.location->allow_header);
+  return response;
 }
 
 static std::string basename_only(const std::string &name) {
@@ -134,7 +149,7 @@ static std::string dedup_filename(const std::string &dir,
   return candidate;
 }
 
-std::string
+HttpResponse
 HttpResponseHandling::handle_post_request(const HttpRequest &request,
                                           const RouteResult &route_result) {
   const LocationConfig *loc = route_result.location;
@@ -167,6 +182,7 @@ HttpResponseHandling::handle_post_request(const HttpRequest &request,
       if (!write_file_bytes(out_path, files[i].data)) {
         return build_error_response(500, "Failed to save uploaded file");
       }
+      FileCache::instance().invalidate(out_path);
       if (!first)
         summary << ",";
       first = false;
@@ -183,285 +199,469 @@ HttpResponseHandling::handle_post_request(const HttpRequest &request,
   return build_response(200, "text/plain", body);
 }
 
-std::string
+HttpResponse
 HttpResponseHandling::handle_delete_request(const HttpRequest &request,
                                             const RouteResult &route_result) {
   (void)request;
   std::string file_path = route_result.file_path;
-  if (!file_exists(file_path))
+  FileCache &cache = FileCache::instance();
+  FileInfo info = cache.get_info(file_path);
+  if (!info.exists)
     return build_error_response(404, "File not found");
-  if (is_directory(file_path))
+  if (info.is_directory)
     return build_error_response(403, "Cannot delete a directory");
 
-  if (unlink(file_path.c_str()) == 0) {
+  // The cached lookup may be a moment old: unlink() has the last word
+  int result = unlink(file_path.c_str());
+  int saved_errno = errno;
+  cache.invalidate(file_path);
+  if (result == 0) {
     std::string body = "File deleted successfully!";
     return build_response(200, "text/plain", body);
-  } else {
-    return build_error_response(500, "Failed to delete file");
   }
+  if (saved_errno == ENOENT)
+    return build_error_response(404, "File not found");
+  if (saved_errno == EISDIR)
+    return build_error_response(403, "Cannot delete a directory");
+  return build_error_response(500, "Failed to delete file");
 }
 
-std::string HttpResponseHandling::serve_file(const std::string &file_path) {
-  std::string content = read_file(file_path);
-  if (content.empty())
-    return build_error_response(500, "Failed to read file");
+HttpResponse HttpResponseHandling::serve_file(const std::string &file_path,
+                                              const HttpRequest &request,
+                                              const LocationConfig *location) {
+  FileCache &cache = FileCache::instance();
+
+  // gzip_static: send a precompressed sibling (file.br / file.gz) instead
+  std::string body_path = file_path;
+  HttpResponse::HeaderList extra_headers;
+  if (location && location->gzip_static) {
+    extra_headers.push_back(std::make_pair("Vary", "Accept-Encoding"));
+    std::string encoding = select_static_encoding(request, file_path, body_path);
+    if (!encoding.empty())
+      extra_headers.push_back(std::make_pair("Content-Encoding", encoding));
+  }
+  FileInfo info = cache.get_info(body_path);
+
+  // Revalidation hit: answer from metadata without touching the contents
+  if (info.exists && is_not_modified(request, info))
+    return build_not_modified_response(info, extra_headers);
+
+  // The type follows the requested name, not a .gz/.br variant's
+  const std::string &mime_type =
+      body_path == file_path ? *info.mime_type
+                             : MimeTypes::instance().lookup(file_path);
+  // HEAD: the headers a GET would get, from the cached stat() alone
+  if (request.get_method() == HEAD && info.exists) {
+    HttpResponse response =
+        build_file_response(200, mime_type, info, extra_headers);
+    response.set_header("Content-Length", std::to_string(info.size));
+    return response;
+  }
 
-  std::string mime_type = get_mime_type(file_path);
-  return build_response(200, mime_type, content);
-}
-std::string
-HttpResponseHandling::serve_directory_listing(const std::string &directory_path,
-                                              const std::string &uri) {
-  std::string index_path = directory_path;
-  if (index_path[index_path.length() - 1] != '/')
-    index_path += "/";
-  index_path += "index.html";
-  if (file_exists(index_path)) {
-    return serve_file(index_path);
+  if (info.exists && request.has_header("Range") &&
+      range_applies(request, info)) {
+    std::vector<std::pair<off_t, off_t> > ranges;
+    if (parse_byte_ranges(request.get_header("Range"), info.size, ranges)) {
+      if (ranges.empty()) {
+        std::ostringstream content_range;
+        content_range << "bytes */" << info.size;
+        HttpResponse response =
+            build_file_response(416, "text/plain", info, extra_headers);
+        response.set_header("Content-Range", content_range.str());
+        response.set_body("Range Not Satisfiable");
+        return response;
+      }
+      return serve_file_ranges(body_path, info, mime_type, ranges,
+                               extra_headers);
+    }
   }
 
-  // Generate Bootstrap directory listing
-  std::string body;
-  body += "<!DOCTYPE html>\n";
-  body += "<html lang=\"en\"><head>";
-  body += "<meta charset=\"UTF-8\">";
-  body += "<meta name=\"viewport\" content=\"width=device-width, "
-          "initial-scale=1.0\">";
-  body += "<title>Index of " + uri + "</title>";
-  body += "<link "
-          "href=\"https://cdn.jsdelivr.net/npm/bootstrap@5.3.0/dist/css/"
-          "bootstrap.min.css\" rel=\"stylesheet\">";
-  body += "<link "
-          "href=\"https://cdn.jsdelivr.net/npm/bootstrap-icons@1.10.0/font/"
-          "bootstrap-icons.css\" rel=\"stylesheet\">";
-  body += "</head><body class=\"bg-light\">";
-  body += "<div class=\"container mt-4\">";
-  body += "<div class=\"row justify-content-center\">";
-  body += "<div class=\"col-lg-10\">";
-  body += "<div class=\"card shadow-sm\">";
-  body += "<div class=\"card-header bg-primary text-white\">";
-  body +=
-      "<h1 class=\"card-title mb-0\"><i class=\"bi bi-folder\"></i> Index of " +
-      uri + "</h1>";
-  body += "</div>";
-  body += "<div class=\"card-body p-0\">";
-  body += "<div class=\"table-responsive\">";
-  body += "<table class=\"table table-hover mb-0\">";
-  body += "<thead class=\"table-light\">";
-  body += "<tr><th><i class=\"bi bi-file-earmark\"></i> Name</th><th><i "
-          "class=\"bi bi-hdd\"></i> Size</th><th><i class=\"bi "
-          "bi-info-circle\"></i> Type</th></tr>";
-  body += "</thead><tbody>";
-
-  // Add parent directory link if not root
-  if (uri != "/") {
-    std::string parent_uri = uri;
-    if (parent_uri.size() > 1 && parent_uri[parent_uri.size() - 1] == '/') {
-      parent_uri = parent_uri.substr(0, parent_uri.size() - 1);
+  // Large files are sent from a shared mapping instead of being copied
+  if (cache.should_map(info)) {
+    std::shared_ptr<const MappedFile> mapping = cache.map_file(body_path, info);
+    if (mapping) {
+      HttpResponse response =
+          build_file_response(200, mime_type, info, extra_headers);
+      response.set_body(
+          BodySegment::from_mapping(mapping, 0, mapping->get_length()));
+      return response;
     }
-    size_t last_slash = parent_uri.find_last_of('/');
-    if (last_slash != std::string::npos) {
-      parent_uri = parent_uri.substr(0, last_slash + 1);
-    } else {
-      parent_uri = "/";
+  }
+
+  // Small files are copied; larger ones (over the mapping cap, or that
+  // failed to map) go out with sendfile() rather than onto the heap
+  if (!info.exists || cache.should_copy(info)) {
+    std::string content;
+    if (!cache.read_file(body_path, content))
+      return build_error_response(500, "Failed to read file");
+
+    HttpResponse response =
+        build_file_response(200, mime_type, info, extra_headers);
+    response.set_body(content);
+    return response;
+  }
+
+  std::shared_ptr<const OpenFile> file = cache.open_file(body_path);
+  if (!file)
+    return build_error_response(500, "Failed to read file");
+  HttpResponse response = build_file_response(200, mime_type, info, extra_headers);
+  response.set_body(
+      BodySegment::from_file(file, 0, static_cast<size_t>(info.size)));
+  return response;
+}
+
+// Pick the best precompressed variant the client accepts. Sibling lookups go
+// through the file cache, so a missing .br/.gz costs no stat() per request.
+std::string HttpResponseHandling::select_static_encoding(
+    const HttpRequest &request, const std::string &file_path,
+    std::string &variant_path) {
+  std::string accept_encoding = request.get_header("Accept-Encoding");
+  if (accept_encoding.empty())
+    return "";
+
+  static const char *codings[] = {"br", "gzip"};
+  static const char *suffixes[] = {".br", ".gz"};
+  FileCache &cache = FileCache::instance();
+  for (size_t i = 0; i < sizeof(codings) / sizeof(codings[0]); ++i) {
+    if (accepted_encoding_quality(accept_encoding, codings[i]) <= 0)
+      continue;
+    std::string candidate = file_path + suffixes[i];
+    FileInfo info = cache.get_info(candidate);
+    if (info.exists && !info.is_directory) {
+      variant_path = candidate;
+      return codings[i];
     }
-    body += "<tr><td><a href=\"" + parent_uri +
-            "\" class=\"text-decoration-none\">";
-    body += "<i class=\"bi bi-arrow-up-left text-primary\"></i> ../</a></td>";
-    body += "<td><span class=\"text-muted\">-</span></td>";
-    body += "<td><span class=\"badge bg-secondary\">Directory</span></td></tr>";
   }
+  return "";
+}
 
-  // Read directory contents
-  DIR *dir = opendir(directory_path.c_str());
-  if (dir != NULL) {
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-      std::string name = entry->d_name;
+// If-Range: only serve the ranges if the client's copy is still current,
+// otherwise fall back to the full representation
+bool HttpResponseHandling::range_applies(const HttpRequest &request,
+                                         const FileInfo &file_info) {
+  if (!request.has_header("If-Range"))
+    return true;
+  std::string validator = request.get_header("If-Range");
+  if (!validator.empty() && validator[0] == '"')
+    return validator == file_info.etag; // Strong comparison only
+  if (validator.compare(0, 2, "W/") == 0)
+    return false;
+  time_t date;
+  return parse_http_date(validator, date) && date == file_info.mtime;
+}
 
-      // Skip . and .. entries
-      if (name == "." || name == "..") {
+// Parse "bytes=a-b,c-,-n". Returns false if the header must be ignored
+// (syntax error, other unit, too many ranges); an empty result means none of
+// the ranges can be satisfied.
+bool HttpResponseHandling::parse_byte_ranges(
+    const std::string &header, off_t file_size,
+    std::vector<std::pair<off_t, off_t> > &ranges) {
+  if (header.compare(0, 6, "bytes=") != 0)
+    return false;
+  std::string specs = header.substr(6);
+  size_t count = 0;
+  size_t pos = 0;
+  while (pos <= specs.size()) {
+    size_t comma = specs.find(',', pos);
+    if (comma == std::string::npos)
+      comma = specs.size();
+    std::string spec = specs.substr(pos, comma - pos);
+    pos = comma + 1;
+    size_t start = spec.find_first_not_of(" \t");
+    if (start == std::string::npos)
+      continue; // Empty list elements are allowed
+    spec = spec.substr(start, spec.find_last_not_of(" \t") - start + 1);
+    if (++count > MAX_RANGES)
+      return false;
+
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos)
+      return false;
+    std::string first_str = spec.substr(0, dash);
+    std::string last_str = spec.substr(dash + 1);
+    if (first_str.find_first_not_of("0123456789") != std::string::npos ||
+        last_str.find_first_not_of("0123456789") != std::string::npos ||
+        (first_str.empty() && last_str.empty()))
+      return false;
+
+    off_t first;
+    off_t last;
+    if (first_str.empty()) {
+      // Suffix range: the last N bytes
+      off_t suffix = static_cast<off_t>(std::strtoll(last_str.c_str(), NULL, 10));
+      if (suffix == 0 || file_size == 0)
         continue;
-      }
+      first = suffix >= file_size ? 0 : file_size - suffix;
+      last = file_size - 1;
+    } else {
+      first = static_cast<off_t>(std::strtoll(first_str.c_str(), NULL, 10));
+      last = last_str.empty()
+                 ? file_size - 1
+                 : static_cast<off_t>(std::strtoll(last_str.c_str(), NULL, 10));
+      if (!last_str.empty() && last < first)
+        return false;
+      if (first >= file_size)
+        continue;
+      if (last >= file_size)
+        last = file_size - 1;
+    }
+    ranges.push_back(std::make_pair(first, last));
+  }
+  return count > 0;
+}
 
-      std::string full_path = directory_path;
-      if (full_path[full_path.size() - 1] != '/') {
-        full_path += "/";
-      }
-      full_path += name;
-
-      struct stat file_stat;
-      if (stat(full_path.c_str(), &file_stat) == 0) {
-        std::string file_uri = uri;
-        if (file_uri[file_uri.size() - 1] != '/') {
-          file_uri += "/";
-        }
-        file_uri += name;
-
-        bool is_dir = S_ISDIR(file_stat.st_mode);
-        std::string display_name = name;
-        std::string icon_class = is_dir ? "bi-folder-fill text-warning"
-                                        : "bi-file-earmark text-info";
-
-        // Format file size
-        std::string size_str;
-        if (is_dir) {
-          size_str = "<span class=\"text-muted\">-</span>";
-        } else {
-          off_t size = file_stat.st_size;
-          if (size < 1024) {
-            std::ostringstream ss;
-            ss << size << " B";
-            size_str = ss.str();
-          } else if (size < 1024 * 1024) {
-            std::ostringstream ss;
-            ss << (size / 1024) << " KB";
-            size_str = ss.str();
-          } else {
-            std::ostringstream ss;
-            ss << (size / (1024 * 1024)) << " MB";
-            size_str = ss.str();
-          }
-        }
-
-        std::string badge_class = is_dir ? "bg-warning text-dark" : "bg-info";
-        std::string type_str = is_dir ? "Directory" : "File";
-
-        body += "<tr><td><a href=\"" + file_uri +
-                "\" class=\"text-decoration-none\">";
-        body += "<i class=\"bi " + icon_class + "\"></i> " + display_name +
-                "</a></td>";
-        body += "<td>" + size_str + "</td>";
-        body += "<td><span class=\"badge " + badge_class + "\">" + type_str +
-                "</span></td></tr>";
+// 206 response whose body segments point into the file, so ranges are sent
+// from the mapping or with sendfile() instead of being sliced out of a string
+HttpResponse HttpResponseHandling::serve_file_ranges(
+    const std::string &file_path, const FileInfo &file_info,
+    const std::string &mime_type,
+    const std::vector<std::pair<off_t, off_t> > &ranges,
+    const HttpResponse::HeaderList &extra_headers) {
+  FileCache &cache = FileCache::instance();
+  std::shared_ptr<const MappedFile> mapping;
+  std::shared_ptr<const OpenFile> file;
+  if (cache.should_map(file_info))
+    mapping = cache.map_file(file_path, file_info);
+  if (!mapping)
+    file = cache.open_file(file_path);
+  if (!mapping && !file)
+    return build_error_response(500, "Failed to read file");
+
+  std::vector<BodySegment> segments;
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    size_t offset = static_cast<size_t>(ranges[i].first);
+    size_t length = static_cast<size_t>(ranges[i].second - ranges[i].first + 1);
+    if (mapping)
+      segments.push_back(BodySegment::from_mapping(mapping, offset, length));
+    else
+      segments.push_back(BodySegment::from_file(file, offset, length));
+  }
+
+  if (ranges.size() == 1) {
+    std::ostringstream content_range;
+    content_range << "bytes " << ranges[0].first << "-" << ranges[0].second
+                  << "/" << file_info.size;
+    HttpResponse response =
+        build_file_response(206, mime_type, file_info, extra_headers);
+    response.set_header("Content-Range", content_range.str());
+    response.set_body(segments[0]);
+    return response;
+  }
+
+  // multipart/byteranges: each part gets its own Content-Type/Content-Range
+  static unsigned long boundary_counter = 0;
+  std::ostringstream boundary_stream;
+  boundary_stream << std::hex << time(NULL) << ++boundary_counter;
+  std::string boundary = boundary_stream.str();
+
+  HttpResponse response =
+      build_file_response(206, "multipart/byteranges; boundary=" + boundary,
+                          file_info, extra_headers);
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    std::ostringstream part_header;
+    if (i > 0)
+      part_header << "\r\n";
+    part_header << "--" << boundary << "\r\n";
+    part_header << "Content-Type: " << mime_type << "\r\n";
+    part_header << "Content-Range: bytes " << ranges[i].first << "-"
+                << ranges[i].second << "/" << file_info.size << "\r\n\r\n";
+    response.append_body(BodySegment::from_data(part_header.str()));
+    response.append_body(segments[i]);
+  }
+  response.append_body(BodySegment::from_data("\r\n--" + boundary + "--\r\n"));
+  return response;
+}
+
+bool HttpResponseHandling::is_not_modified(const HttpRequest &request,
+                                           const FileInfo &file_info) {
+  // If-None-Match takes precedence over If-Modified-Since (RFC 7232 6)
+  if (request.has_header("If-None-Match")) {
+    std::string tags = request.get_header("If-None-Match");
+    size_t pos = 0;
+    while (pos < tags.size()) {
+      size_t comma = tags.find(',', pos);
+      if (comma == std::string::npos)
+        comma = tags.size();
+      std::string tag = tags.substr(pos, comma - pos);
+      size_t start = tag.find_first_not_of(" \t");
+      size_t end = tag.find_last_not_of(" \t");
+      if (start != std::string::npos) {
+        tag = tag.substr(start, end - start + 1);
+        // Weak comparison: a W/ prefix does not matter for GET
+        if (tag.compare(0, 2, "W/") == 0)
+          tag = tag.substr(2);
+        if (tag == "*" || tag == file_info.etag)
+          return true;
       }
+      pos = comma + 1;
     }
-    closedir(dir);
+    return false;
+  }
+
+  if (request.has_header("If-Modified-Since")) {
+    time_t since;
+    if (parse_http_date(request.get_header("If-Modified-Since"), since))
+      return file_info.mtime <= since;
   }
+  return false;
+}
+
+HttpResponse HttpResponseHandling::build_not_modified_response(
+    const FileInfo &file_info, const HttpResponse::HeaderList &extra_headers) {
+  HttpResponse response(304);
+  response.set_header("ETag", file_info.etag);
+  response.set_header("Last-Modified", file_info.last_modified);
+  for (size_t i = 0; i < extra_headers.size(); ++i)
+    response.add_header(extra_headers[i].first, extra_headers[i].second);
+  return response;
+}
 
-  body += "</tbody></table>";
-  body += "</div></div>";
-  body += "<div class=\"card-footer text-muted text-center\">";
-  body += "<small><i class=\"bi bi-gear\"></i> webserv/1.0</small>";
-  body += "</div></div></div></div></div>";
-  body += "<script "
-          "src=\"https://cdn.jsdelivr.net/npm/bootstrap@5.3.0/dist/js/"
-          "bootstrap.bundle.min.js\"></script>";
-  body += "</body></html>";
-
-  return build_response(200, "text/html", body);
+HttpResponse
+HttpResponseHandling::serve_directory_listing(const std::string &directory_path,
+                                              const HttpRequest &request,
+                                              const LocationConfig *location) {
+  std::string index_path = directory_path;
+  if (index_path[index_path.length() - 1] != '/')
+    index_path += "/";
+  index_path += "index.html";
+  FileInfo index_info = FileCache::instance().get_info(index_path);
+  if (index_info.exists && !index_info.is_directory) {
+    return serve_file(index_path, request, location);
+  }
+
+  // ?format=json / ?page=N override the location defaults
+  AutoindexRequest listing;
+  listing.directory_path = directory_path;
+  listing.uri = request.get_path();
+  listing.format = location && location->autoindex_json ? AUTOINDEX_JSON
+                                                        : AUTOINDEX_HTML;
+  listing.page = 1;
+  listing.page_size = location ? location->autoindex_page_size : 0;
+  std::string format = get_query_parameter(request, "format");
+  if (format == "json")
+    listing.format = AUTOINDEX_JSON;
+  else if (format == "html")
+    listing.format = AUTOINDEX_HTML;
+  std::string page = get_query_parameter(request, "page");
+  if (listing.page_size > 0 && !page.empty() &&
+      page.find_first_not_of("0123456789") == std::string::npos) {
+    // Clamp to the last page whose first entry is still addressable, so
+    // (page - 1) * page_size cannot overflow
+    size_t last_page = SIZE_MAX / listing.page_size;
+    errno = 0;
+    unsigned long long value = std::strtoull(page.c_str(), NULL, 10);
+    if (errno == ERANGE || value > last_page)
+      listing.page = last_page;
+    else
+      listing.page = static_cast<size_t>(value);
+    if (listing.page == 0)
+      listing.page = 1;
+  }
+
+  HttpResponse response(200);
+  response.set_header("Content-Type", listing.format == AUTOINDEX_JSON
+                                          ? "application/json"
+                                          : "text/html; charset=utf-8");
+
+  // Unchanged directory: the listing rendered last time is still valid
+  FileInfo dir_info = FileCache::instance().get_info(directory_path);
+  std::shared_ptr<const std::string> cached = AutoindexCache::instance().get(
+      AutoindexCache::make_key(listing), dir_info.inode, dir_info.mtime);
+  if (cached) {
+    response.set_body(BodySegment::from_buffer(cached));
+    return response;
+  }
+
+  std::shared_ptr<AutoindexStream> stream(
+      new AutoindexStream(listing, dir_info.inode, dir_info.mtime));
+  if (!stream->open()) {
+    if (errno == EACCES)
+      return build_error_response(403, "Forbidden");
+    return build_error_response(404, "Not Found");
+  }
+  response.set_body(BodySegment::from_stream(stream));
+  return response;
 }
 
+// Value of name=value in the query string ("" if absent)
 std::string
+HttpResponseHandling::get_query_parameter(const HttpRequest &request,
+                                          const std::string &name) {
+  const std::string &query = request.get_query_string();
+  size_t pos = 0;
+  while (pos <= query.size()) {
+    size_t amp = query.find('&', pos);
+    if (amp == std::string::npos)
+      amp = query.size();
+    size_t eq = query.find('=', pos);
+    if (eq != std::string::npos && eq < amp &&
+        query.compare(pos, eq - pos, name) == 0)
+      return query.substr(eq + 1, amp - eq - 1);
+    pos = amp + 1;
+  }
+  return "";
+}
+
+HttpResponse
 HttpResponseHandling::build_response(int status_code,
                                      const std::string &content_type,
                                      const std::string &content) {
-  std::ostringstream response_stream;
-  response_stream << "HTTP/1.1 " << status_code << " "
-                  << get_status_message(status_code) << "\r\n";
-  response_stream << "Content-Type: " << content_type << "\r\n";
-  response_stream << "Content-Length: " << content.size() << "\r\n";
-  response_stream << "Server: webserv/1.0\r\n";
-  response_stream << "\r\n";
-  response_stream << content;
-  return response_stream.str();
+  HttpResponse response(status_code);
+  response.set_header("Content-Type", content_type);
+  response.set_body(content);
+  return response;
 }
-std::string
+
+HttpResponse HttpResponseHandling::build_file_response(
+    int status_code, const std::string &content_type,
+    const FileInfo &file_info, const HttpResponse::HeaderList &extra_headers) {
+  HttpResponse response(status_code);
+  response.set_header("Content-Type", content_type);
+  // Validators for file responses, used by clients to revalidate
+  response.set_header("ETag", file_info.etag);
+  response.set_header("Last-Modified", file_info.last_modified);
+  response.set_header("Accept-Ranges", "bytes");
+  for (size_t i = 0; i < extra_headers.size(); ++i)
+    response.add_header(extra_headers[i].first, extra_headers[i].second);
+  return response;
+}
+
+HttpResponse
 HttpResponseHandling::build_error_response(int status_code,
                                            const std::string &message) {
-  // Try custom error page from server config
-  std::string custom_path = resolve_error_page_path(status_code);
-  if (!custom_path.empty() && file_exists(custom_path) &&
-      !is_directory(custom_path)) {
-    std::string content = read_file(custom_path);
-    return build_response(status_code, "text/html", content);
+  HttpResponse response(status_code);
+  response.set_header("Content-Type", "text/html");
+  if (!server_config || !server_config->error_page_cache) {
+    response.set_body(
+        ErrorPageCache::render_default_page(status_code, message));
+    return response;
   }
 
-  // Fallback generic page
-  std::ostringstream body;
-  body << "<!DOCTYPE html>\n";
-  body << "<html><head><title>" << status_code << " " << message
-       << "</title></head>\n";
-  body << "<body><h1>" << status_code << " " << message << "</h1>\n";
-  body << "<hr><p>webserv/1.0</p></body></html>\n";
-  return build_response(status_code, "text/html", body.str());
+  // Custom error page from server config, else the generic page; both are
+  // rendered once and shared by every response
+  ErrorPageCache &pages = *server_config->error_page_cache;
+  std::shared_ptr<const std::string> body = pages.get_custom_page(status_code);
+  if (!body)
+    body = pages.get_generated_page(status_code, message);
+  response.set_body(BodySegment::from_buffer(body));
+  return response;
 }
 
-std::string HttpResponseHandling::get_mime_type(const std::string &file_path) {
-  size_t dot_pos = file_path.find_last_of('.');
-  if (dot_pos == std::string::npos)
-    return "application/octet-stream"; // Default binary type
-
-  std::string extension = file_path.substr(dot_pos + 1);
-
-  if (extension == "html" || extension == "htm")
-    return "text/html";
-  if (extension == "css")
-    return "text/css";
-  if (extension == "js")
-    return "application/javascript";
-  if (extension == "jpg" || extension == "jpeg")
-    return "image/jpeg";
-  if (extension == "png")
-    return "image/png";
-  if (extension == "gif")
-    return "image/gif";
-  if (extension == "txt")
-    return "text/plain";
-
-  return "application/octet-stream"; // Default binary type
-}
-std::string HttpResponseHandling::get_status_message(int status_code) {
-  switch (status_code) {
-  case 200:
-    return "OK";
-  case 201:
-    return "Created";
-  case 204:
-    return "No Content";
-  case 301:
-    return "Moved Permanently";
-  case 302:
-    return "Found";
-  case 303:
-    return "See Other";
-  case 307:
-    return "Temporary Redirect";
-  case 308:
-    return "Permanent Redirect";
-  case 400:
-    return "Bad Request";
-  case 403:
-    return "Forbidden";
-  case 404:
-    return "Not Found";
-  case 405:
-    return "Method Not Allowed";
-  case 500:
-    return "Internal Server Error";
-  default:
-    return "Unknown Status";
+void HttpResponseHandling::preload_error_pages(
+    std::vector<ServerConfig> &servers) {
+  for (size_t i = 0; i < servers.size(); ++i) {
+    std::shared_ptr<ErrorPageCache> pages(new ErrorPageCache());
+    HttpResponseHandling responder(&servers[i]);
+    for (std::map<int, std::string>::const_iterator it =
+             servers[i].error_pages.begin();
+         it != servers[i].error_pages.end(); ++it) {
+      std::string path = responder.resolve_error_page_path(it->first);
+      if (!path.empty())
+        pages->add_custom_page(it->first, path);
+    }
+    servers[i].error_page_cache = pages;
   }
 }
-bool HttpResponseHandling::file_exists(const std::string &path) {
-  return access(path.c_str(), F_OK) == 0;
-}
-bool HttpResponseHandling::is_directory(const std::string &path) {
-  struct stat path_status; // stat is used to get file status
-  if (stat(path.c_str(), &path_status) != 0)
-    return false;
-  return S_ISDIR(path_status.st_mode);
-}
-std::string HttpResponseHandling::read_file(const std::string &path) {
-  std::ifstream file(path.c_str(),
-                     std::ios::binary); // std::ios::in | std::ios::binary
-  if (!file.is_open())
-    return "";
-
-  std::ostringstream buffer;
-  buffer << file.rdbuf();
-  return buffer.str();
-}
 
 // Resolve configured error page path against server locations
 std::string HttpResponseHandling::resolve_error_page_path(int status_code) {
@@ -490,37 +690,11 @@ const LocationConfig *
 HttpResponseHandling::find_best_location_for_uri(const std::string &uri) {
   if (!server_config)
     return NULL;
-  const LocationConfig *best = NULL;
-  size_t best_len = 0;
-  for (std::vector<LocationConfig>::const_iterator it =
-           server_config->locations.begin();
-       it != server_config->locations.end(); ++it) {
-    const std::string &p = it->path;
-    if (uri.size() >= p.size() && uri.substr(0, p.size()) == p) {
-      bool valid = false;
-      if (uri.size() == p.size())
-        valid = true;
-      else if (!p.empty() && p[p.size() - 1] == '/')
-        valid = true;
-      else if (uri[p.size()] == '/')
-        valid = true;
-      if (valid && p.size() > best_len) {
-        best = &(*it);
-        best_len = p.size();
-      }
-    }
-  }
+  const LocationConfig *best =
+      Router::find_matching_location(*server_config, uri);
   // If no match, try root location "/" if present
-  if (!best) {
-    for (std::vector<LocationConfig>::const_iterator it =
-             server_config->locations.begin();
-         it != server_config->locations.end(); ++it) {
-      if (it->path == "/") {
-        best = &(*it);
-        break;
-      }
-    }
-  }
+  if (!best)
+    best = Router::find_matching_location(*server_config, "/");
   return best;
 }
 
@@ -0,0 +1,115 @@
+#include "../../includes/http/location_tree.hpp"
+#include <map>
+#include <memory>
+
+namespace {
+
+// Mutable tree used while inserting; flattened into the Node array after
+struct BuildNode {
+  std::string label;
+  int location;
+  std::map<unsigned char, std::unique_ptr<BuildNode> > children;
+
+  BuildNode() : location(LocationTree::NO_LOCATION) {}
+};
+
+void insert(BuildNode *node, std::string_view key, int location) {
+  while (!key.empty()) {
+    unsigned char first = static_cast<unsigned char>(key[0]);
+    std::unique_ptr<BuildNode> &slot = node->children[first];
+    if (!slot) {
+      slot.reset(new BuildNode());
+      slot->label.assign(key.data(), key.size());
+      slot->location = location;
+      return;
+    }
+    std::string_view label(slot->label);
+    size_t common = 0;
+    while (common < label.size() && common < key.size() &&
+           label[common] == key[common])
+      ++common;
+    if (common < label.size()) {
+      // Split the edge: the shared part becomes a node of its own
+      std::unique_ptr<BuildNode> middle(new BuildNode());
+      middle->label.assign(label.data(), common);
+      slot->label.erase(0, common);
+      unsigned char rest = static_cast<unsigned char>(slot->label[0]);
+      middle->children[rest] = std::move(slot);
+      slot = std::move(middle);
+    }
+    node = slot.get();
+    key.remove_prefix(common);
+  }
+  // Duplicate paths: the first location wins, as with a linear scan
+  if (node->location == LocationTree::NO_LOCATION)
+    node->location = location;
+}
+
+} // namespace
+
+LocationTree::LocationTree(const std::vector<LocationConfig> &locations) {
+  BuildNode root;
+  for (size_t i = 0; i < locations.size(); ++i)
+    insert(&root, locations[i].path, static_cast<int>(i));
+
+  // Breadth-first flattening keeps each node's children adjacent
+  std::vector<const BuildNode *> order(1, &root);
+  Node root_node = {0, 0, 0, 0, root.location};
+  nodes.push_back(root_node);
+  for (size_t i = 0; i < order.size(); ++i) {
+    const BuildNode *source = order[i];
+    nodes[i].first_child = nodes.size();
+    nodes[i].child_count = source->children.size();
+    for (std::map<unsigned char, std::unique_ptr<BuildNode> >::const_iterator
+             it = source->children.begin();
+         it != source->children.end(); ++it) {
+      const BuildNode *child = it->second.get();
+      Node node = {labels.size(), child->label.size(), 0, 0, child->location};
+      labels += child->label;
+      nodes.push_back(node);
+      order.push_back(child);
+    }
+  }
+}
+
+LocationTree::~LocationTree() {}
+
+int LocationTree::find(std::string_view path) const {
+  int best = NO_LOCATION;
+  size_t depth = 0;
+  const Node *node = &nodes[0];
+  while (true) {
+    // A location matches if it is the whole path, ends with '/', or is
+    // followed by '/' in the path ("/img" matches "/img/a", not "/imgs")
+    if (node->location != NO_LOCATION &&
+        (depth == path.size() || (depth > 0 && path[depth - 1] == '/') ||
+         path[depth] == '/'))
+      best = node->location;
+    if (depth == path.size())
+      break;
+    node = find_child(*node, static_cast<unsigned char>(path[depth]));
+    if (!node || path.compare(depth, node->label_length, labels,
+                              node->label_offset, node->label_length) != 0)
+      break;
+    depth += node->label_length;
+  }
+  return best;
+}
+
+const LocationTree::Node *LocationTree::find_child(const Node &node,
+                                                   unsigned char first) const {
+  size_t low = node.first_child;
+  size_t high = node.first_child + node.child_count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    unsigned char label_first =
+        static_cast<unsigned char>(labels[nodes[middle].label_offset]);
+    if (label_first == first)
+      return &nodes[middle];
+    if (label_first < first)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return NULL;
+}
@@ -0,0 +1,48 @@
+#include "../../includes/http/mime_types.hpp"
+#include <cctype>
+
+MimeTypes::MimeTypes() : default_type("application/octet-stream") {
+  load_builtin_types();
+}
+
+MimeTypes &MimeTypes::instance() {
+  static MimeTypes mime_types;
+  return mime_types;
+}
+
+void MimeTypes::configure(const TypeMap &types,
+                          const std::string &default_type) {
+  if (types.empty())
+    load_builtin_types();
+  else
+    this->types = types;
+  this->default_type = default_type;
+}
+
+const std::string &MimeTypes::lookup(const std::string &path) const {
+  size_t dot = path.find_last_of("./");
+  if (dot == std::string::npos || path[dot] != '.' || dot + 1 == path.size())
+    return default_type;
+
+  std::string extension = path.substr(dot + 1);
+  for (size_t i = 0; i < extension.size(); ++i)
+    extension[i] = tolower(extension[i]);
+  TypeMap::const_iterator it = types.find(extension);
+  return it == types.end() ? default_type : it->second;
+}
+
+const std::string &MimeTypes::get_default_type() const { return default_type; }
+
+// Used when the config has no types block
+void MimeTypes::load_builtin_types() {
+  types.clear();
+  types["html"] = "text/html";
+  types["htm"] = "text/html";
+  types["css"] = "text/css";
+  types["js"] = "application/javascript";
+  types["jpg"] = "image/jpeg";
+  types["jpeg"] = "image/jpeg";
+  types["png"] = "image/png";
+  types["gif"] = "image/gif";
+  types["txt"] = "text/plain";
+}
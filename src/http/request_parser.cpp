@@ -163,6 +163,10 @@ bool RequestParser::parse_method(HttpRequest &request,
     request.set_method(POST);
   else if (method_str == "DELETE")
     request.set_method(DELETE);
+  else if (method_str == "HEAD")
+    request.set_method(HEAD);
+  else if (method_str == "OPTIONS")
+    request.set_method(OPTIONS);
   else
     request.set_method(UNKNOWN);
   return true;
@@ -263,7 +267,8 @@ bool RequestParser::is_valid_http_version(const std::string &version) {
 }
 
 bool RequestParser::is_valid_method(const std::string &method) {
-  return (method == "GET" || method == "POST" || method == "DELETE");
+  return (method == "GET" || method == "POST" || method == "DELETE" ||
+          method == "HEAD" || method == "OPTIONS");
 }
 
 bool RequestParser::is_valid_uri(const std::string &uri) {
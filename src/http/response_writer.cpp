@@ -0,0 +1,297 @@
+#include "../../includes/http/response_writer.hpp"
+#include "../../includes/http/header_writer.hpp"
+#include "../../includes/networking/buffer_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+ResponseWriter::ResponseWriter()
+    : head_sent(0), stream_chunk_sent(0), close_after(false), chunked(false),
+      waiting_fd(-1) {}
+
+ResponseWriter::~ResponseWriter() {}
+
+void ResponseWriter::start(const HttpResponse &response, bool allow_chunked) {
+  clear();
+  BufferPool::instance().acquire(head, INITIAL_HEAD_CAPACITY);
+  int status = response.get_status_code();
+  // 1xx, 204 and 304 never carry a body, whatever the handler attached
+  bool has_body = status >= 200 && status != 204 && status != 304;
+  chunked = has_body && allow_chunked && !response.has_known_length();
+  serialize_head(response);
+  if (!has_body || response.is_header_only())
+    return;
+  if (!chunked) {
+    body.assign(response.get_body().begin(), response.get_body().end());
+    return;
+  }
+
+  // Frame the fixed segments here; stream output is framed as it is pulled
+  const std::vector<BodySegment> &segments = response.get_body();
+  for (size_t i = 0; i < segments.size(); ++i) {
+    if (segments[i].type != BODY_STREAM && segments[i].length == 0)
+      continue;
+    if (segments[i].type != BODY_STREAM)
+      body.push_back(BodySegment::from_data(chunk_size_line(segments[i].length)));
+    body.push_back(segments[i]);
+    if (segments[i].type != BODY_STREAM)
+      body.push_back(BodySegment::from_data("\r\n"));
+  }
+  body.push_back(BodySegment::from_data("0\r\n\r\n"));
+}
+
+void ResponseWriter::clear() {
+  head.clear();
+  head_sent = 0;
+  body.clear();
+  stream_chunk.clear();
+  stream_chunk_sent = 0;
+  close_after = false;
+  chunked = false;
+  waiting_fd = -1;
+}
+
+void ResponseWriter::release_buffers() {
+  clear();
+  BufferPool::instance().release(head);
+  BufferPool::instance().release(stream_chunk);
+}
+
+bool ResponseWriter::has_pending_output() const {
+  if (head_sent < head.size() || stream_chunk_sent < stream_chunk.size())
+    return true;
+  for (std::deque<BodySegment>::const_iterator it = body.begin();
+       it != body.end(); ++it) {
+    if (it->type == BODY_STREAM ? static_cast<bool>(it->stream)
+                                : it->length > 0)
+      return true;
+  }
+  return false;
+}
+
+bool ResponseWriter::should_close() const { return close_after; }
+
+int ResponseWriter::get_wait_fd() const { return waiting_fd; }
+
+ssize_t ResponseWriter::write_to(int fd) {
+  waiting_fd = -1;
+  if (head_sent < head.size())
+    return send_head(fd);
+
+  while (!body.empty()) {
+    BodySegment &segment = body.front();
+    ssize_t sent;
+    if (segment.type == BODY_STREAM) {
+      sent = send_stream(fd, segment);
+    } else if (segment.length == 0) {
+      sent = 0;
+    } else {
+      sent = send_segment(fd, segment);
+      if (sent == 0) {
+        // File shrank under us: the promised Content-Length cannot be met
+        errno = EIO;
+        return -1;
+      }
+      if (sent > 0) {
+        segment.offset += sent;
+        segment.length -= sent;
+      }
+    }
+    if (sent != 0)
+      return sent;
+    body.pop_front(); // Segment (or stream) exhausted
+  }
+  return 0;
+}
+
+// Status line and header block, formatted into the reused head buffer.
+// Content-Length is always computed here from the body so handlers cannot
+// get it wrong; only a HEAD answer with no body to measure keeps the one
+// the handler stated. A body of unknown length is sent chunked, or
+// delimited by closing the connection for HTTP/1.0 clients. The Connection
+// header is written last so that a forced close always wins over the
+// handler's value.
+void ResponseWriter::serialize_head(const HttpResponse &response) {
+  int status = response.get_status_code();
+  HeaderWriter writer(head);
+  writer.status_line(status, response.has_reason_phrase()
+                                 ? response.get_reason_phrase()
+                                 : NULL);
+
+  bool has_date = false;
+  bool has_server = false;
+  const std::string *connection = NULL;
+  const std::string *stated_length = NULL;
+  const HttpResponse::HeaderList &headers = response.get_headers();
+  for (HttpResponse::HeaderList::const_iterator it = headers.begin();
+       it != headers.end(); ++it) {
+    const char *name = it->first.c_str();
+    if (strcasecmp(name, "Content-Length") == 0) {
+      stated_length = &it->second;
+      continue;
+    }
+    if (strcasecmp(name, "Date") == 0)
+      has_date = true;
+    else if (strcasecmp(name, "Server") == 0)
+      has_server = true;
+    else if (strcasecmp(name, "Connection") == 0) {
+      connection = &it->second;
+      continue;
+    }
+    writer.header(it->first, it->second);
+  }
+
+  if (status >= 200 && status != 204 && status != 304) {
+    if (response.is_header_only() && !response.has_body()) {
+      // HEAD answered from metadata: the handler states the length
+      if (stated_length)
+        writer.header("Content-Length", *stated_length);
+    } else if (response.has_known_length()) {
+      writer.header("Content-Length", 14, response.get_content_length());
+    } else if (chunked) {
+      writer.header("Transfer-Encoding", 17, "chunked", 7);
+    } else if (!response.is_header_only()) {
+      close_after = true;
+    }
+  }
+  if (connection && strcasecmp(connection->c_str(), "close") == 0)
+    close_after = true;
+  if (close_after)
+    writer.header("Connection", 10, "close", 5);
+  else if (connection)
+    writer.header("Connection", *connection);
+  if (!has_date)
+    writer.date_header();
+  if (!has_server)
+    writer.header("Server", 6, "webserv/1.0", 11);
+  writer.end();
+}
+
+// The header block and the in-memory body segments after it go out in one
+// sendmsg(): a small response then leaves as a single packet, instead of a
+// head the client acknowledges late (delayed ACK) and a body that Nagle
+// holds back until that acknowledgement arrives
+ssize_t ResponseWriter::send_head(int fd) {
+  struct iovec iov[MAX_HEAD_IOV];
+  iov[0].iov_base = const_cast<char *>(head.data() + head_sent);
+  iov[0].iov_len = head.size() - head_sent;
+  int count = 1;
+  for (std::deque<BodySegment>::const_iterator it = body.begin();
+       it != body.end() && count < MAX_HEAD_IOV; ++it) {
+    const char *data = segment_data(*it);
+    if (!data)
+      break;
+    if (it->length == 0)
+      continue;
+    iov[count].iov_base = const_cast<char *>(data + it->offset);
+    iov[count].iov_len = it->length;
+    ++count;
+  }
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = iov;
+  message.msg_iovlen = count;
+  ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+  if (sent <= 0)
+    return sent;
+
+  size_t rest = static_cast<size_t>(sent);
+  size_t head_part = std::min(rest, head.size() - head_sent);
+  head_sent += head_part;
+  rest -= head_part;
+  if (head_sent == head.size()) {
+    head.clear();
+    head_sent = 0;
+  }
+  for (std::deque<BodySegment>::iterator it = body.begin(); rest > 0; ++it) {
+    size_t part = std::min(rest, it->length);
+    it->offset += part;
+    it->length -= part;
+    rest -= part;
+  }
+  return sent;
+}
+
+// Bytes of a segment held in memory; NULL for files and streams
+const char *ResponseWriter::segment_data(const BodySegment &segment) {
+  switch (segment.type) {
+  case BODY_DATA:
+    return segment.data.data();
+  case BODY_BUFFER:
+    return segment.buffer->data();
+  case BODY_MAPPING:
+    return segment.mapping->get_data();
+  default:
+    return NULL;
+  }
+}
+
+// Send as much of one segment as the socket accepts, without copying mapped
+// or file-backed data through an intermediate buffer
+ssize_t ResponseWriter::send_segment(int fd, BodySegment &segment) {
+  switch (segment.type) {
+  case BODY_BUFFER:
+    return send(fd, segment.buffer->data() + segment.offset, segment.length,
+                MSG_NOSIGNAL);
+  case BODY_MAPPING:
+    return send(fd, segment.mapping->get_data() + segment.offset,
+                segment.length, MSG_NOSIGNAL);
+  case BODY_FILE: {
+    off_t offset = static_cast<off_t>(segment.offset);
+    return sendfile(fd, segment.file->get_fd(), &offset, segment.length);
+  }
+  default:
+    return send(fd, segment.data.data() + segment.offset, segment.length,
+                MSG_NOSIGNAL);
+  }
+}
+
+// Pull the next piece from the stream once the previous one is on the wire.
+// Returns 0 when the stream is finished.
+ssize_t ResponseWriter::send_stream(int fd, BodySegment &segment) {
+  if (stream_chunk_sent == stream_chunk.size()) {
+    stream_chunk.clear();
+    stream_chunk_sent = 0;
+    if (!segment.stream)
+      return 0;
+    bool done = false;
+    if (!segment.stream->read(stream_chunk, STREAM_CHUNK_SIZE, done)) {
+      errno = EIO;
+      return -1;
+    }
+    if (done)
+      segment.stream.reset(); // Nothing follows this chunk
+    if (stream_chunk.empty()) {
+      if (!segment.stream)
+        return 0;
+      // Stream has nothing ready yet: wait on its descriptor
+      waiting_fd = segment.stream->wait_fd();
+      errno = EAGAIN;
+      return -1;
+    }
+    if (chunked) {
+      stream_chunk.insert(0, chunk_size_line(stream_chunk.size()));
+      stream_chunk.append("\r\n", 2);
+    }
+  }
+  ssize_t sent = send(fd, stream_chunk.data() + stream_chunk_sent,
+                      stream_chunk.size() - stream_chunk_sent, MSG_NOSIGNAL);
+  if (sent > 0)
+    stream_chunk_sent += sent;
+  return sent;
+}
+
+// "<hex length>\r\n" starting a chunk
+std::string ResponseWriter::chunk_size_line(size_t length) {
+  char line[24];
+  std::to_chars_result result = std::to_chars(line, line + 20, length, 16);
+  result.ptr[0] = '\r';
+  result.ptr[1] = '\n';
+  return std::string(line, result.ptr + 2 - line);
+}
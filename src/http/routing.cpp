@@ -11,8 +11,9 @@
 /* ************************************************************************** */
 
 #include "../../includes/http/routing.hpp"
+#include "../../includes/http/file_cache.hpp"
+#include "../../includes/http/location_tree.hpp"
 #include <iostream>
-#include <sys/stat.h>
 
 Router::Router() {}
 
@@ -20,7 +21,8 @@ Router::~Router() {}
 
 RouteResult Router::route_request(const ServerConfig &server,
                                   const HttpRequest &request) {
-  std::string uri = request.get_uri();
+  // Route on the path only; the query string is not part of the file name
+  std::string uri = request.get_path();
   HttpMethod method = request.get_method();
 
   std::cout << "Routing request: " << method_to_string(method) << " " << uri
@@ -58,9 +60,11 @@ RouteResult Router::route_request(const ServerConfig &server,
   if (!is_method_allowed(*location, method)) {
     std::cout << "Method " << method_to_string(method)
               << " not allowed for location " << location->path << std::endl;
-    return create_error_result(ROUTE_METHOD_NOT_ALLOWED, 405,
-                               "Method " + method_to_string(method) +
-                                   " not allowed");
+    RouteResult result = create_error_result(
+        ROUTE_METHOD_NOT_ALLOWED, 405,
+        "Method " + method_to_string(method) + " not allowed");
+    result.location = location; // For the Allow header
+    return result;
   }
 
   std::cout << "Method " << method_to_string(method) << " is allowed"
@@ -89,9 +93,11 @@ RouteResult Router::route_request(const ServerConfig &server,
     return result;
   }
 
-  // Check if path exists and determine type
-  if (path_exists(result.file_path)) {
-    result.is_directory = is_directory(result.file_path);
+  // Check if path exists and determine type (through the stat cache)
+  FileCache &cache = FileCache::instance();
+  FileInfo info = cache.get_info(result.file_path);
+  if (info.exists) {
+    result.is_directory = info.is_directory;
 
     if (result.is_directory) {
       std::cout << "Path is a directory" << std::endl;
@@ -104,7 +110,8 @@ RouteResult Router::route_request(const ServerConfig &server,
           std::string index_path = join_paths(result.file_path, *it);
           std::cout << "Checking index file: " << index_path << std::endl;
 
-          if (path_exists(index_path) && !is_directory(index_path)) {
+          FileInfo index_info = cache.get_info(index_path);
+          if (index_info.exists && !index_info.is_directory) {
             std::cout << "Found index file: " << index_path << std::endl;
             result.file_path = index_path;
             result.is_directory = false;
@@ -145,60 +152,53 @@ RouteResult Router::route_request(const ServerConfig &server,
 }
 
 const LocationConfig *Router::find_matching_location(const ServerConfig &server,
-                                                     const std::string &uri) {
-  const LocationConfig *best_match = NULL;
-  size_t longest_match = 0;
-
-  // Implement longest prefix matching (like nginx)
-  for (std::vector<LocationConfig>::const_iterator it =
-           server.locations.begin();
-       it != server.locations.end(); ++it) {
-
-    const std::string &location_path = it->path;
-
-    // Check if URI starts with this location path
-    if (uri.substr(0, location_path.length()) == location_path) {
-      // For exact match or if location ends with / or URI has / after location
-      bool is_valid_match = false;
-
-      if (uri.length() == location_path.length()) {
-        // Exact match
-        is_valid_match = true;
-      } else if (location_path == "/") {
-        // Root location matches everything
-        is_valid_match = true;
-      } else if (location_path[location_path.length() - 1] == '/') {
-        // Location ends with slash
-        is_valid_match = true;
-      } else if (uri[location_path.length()] == '/') {
-        // Next character in URI is slash
-        is_valid_match = true;
-      }
-
-      if (is_valid_match && location_path.length() > longest_match) {
-        longest_match = location_path.length();
-        best_match = &(*it);
-      }
-    }
-  }
-
-  return best_match;
+                                                     std::string_view uri) {
+  if (!server.location_tree)
+    return NULL;
+  int index = server.location_tree->find(uri);
+  if (index == LocationTree::NO_LOCATION)
+    return NULL;
+  return &server.locations[index];
 }
 
 bool Router::is_method_allowed(const LocationConfig &location,
                                HttpMethod method) {
-  std::string method_str = method_to_string(method);
-
-  // Check if method is in allow_methods list
-  for (std::vector<std::string>::const_iterator it =
-           location.allow_methods.begin();
-       it != location.allow_methods.end(); ++it) {
-    if (*it == method_str) {
-      return true;
+  return (location.methods & (1u << method)) != 0;
+}
+
+unsigned int Router::method_mask(const std::vector<std::string> &methods) {
+  static const HttpMethod known[] = {GET, POST, DELETE, HEAD, OPTIONS};
+  unsigned int mask = 0;
+  for (size_t i = 0; i < methods.size(); ++i) {
+    for (size_t j = 0; j < sizeof(known) / sizeof(known[0]); ++j) {
+      if (methods[i] == method_to_string(known[j]))
+        mask |= 1u << known[j];
     }
   }
+  // OPTIONS only describes the location; HEAD is GET without the body
+  mask |= 1u << OPTIONS;
+  if (mask & (1u << GET))
+    mask |= 1u << HEAD;
+  return mask;
+}
 
-  return false;
+std::string Router::allowed_methods(const LocationConfig &location) {
+  const std::vector<std::string> &methods = location.allow_methods;
+  bool has_get = false, has_head = false, has_options = false;
+  std::string allow;
+  for (size_t i = 0; i < methods.size(); ++i) {
+    if (!allow.empty())
+      allow += ", ";
+    allow += methods[i];
+    has_get = has_get || methods[i] == "GET";
+    has_head = has_head || methods[i] == "HEAD";
+    has_options = has_options || methods[i] == "OPTIONS";
+  }
+  if (has_get && !has_head)
+    allow += ", HEAD";
+  if (!has_options)
+    allow += allow.empty() ? "OPTIONS" : ", OPTIONS";
+  return allow;
 }
 
 std::string Router::resolve_file_path(const LocationConfig &location,
@@ -252,19 +252,6 @@ std::string Router::join_paths(const std::string &root,
   return normalize_path(result);
 }
 
-bool Router::path_exists(const std::string &path) {
-  struct stat st;
-  return stat(path.c_str(), &st) == 0;
-}
-
-bool Router::is_directory(const std::string &path) {
-  struct stat st;
-  if (stat(path.c_str(), &st) == 0) {
-    return S_ISDIR(st.st_mode);
-  }
-  return false;
-}
-
 std::string Router::method_to_string(HttpMethod method) {
   switch (method) {
   case GET:
@@ -273,6 +260,10 @@ std::string Router::method_to_string(HttpMethod method) {
     return "POST";
   case DELETE:
     return "DELETE";
+  case HEAD:
+    return "HEAD";
+  case OPTIONS:
+    return "OPTIONS";
   default:
     return "UNKNOWN";
   }
@@ -0,0 +1,35 @@
+#include "../../includes/networking/buffer_pool.hpp"
+
+BufferPool::BufferPool() {}
+
+BufferPool::~BufferPool() {}
+
+BufferPool &BufferPool::instance() {
+  static BufferPool pool;
+  return pool;
+}
+
+void BufferPool::acquire(std::string &buffer, size_t capacity) {
+  if (buffer.capacity() >= capacity)
+    return;
+  if (!buffers.empty()) {
+    buffer.swap(buffers.back());
+    buffers.pop_back();
+  }
+  buffer.clear();
+  if (buffer.capacity() < capacity)
+    buffer.reserve(capacity);
+}
+
+void BufferPool::release(std::string &buffer) {
+  std::string storage;
+  storage.swap(buffer);
+  // Nothing to keep for a buffer that never left its inline storage
+  if (storage.capacity() <= std::string().capacity() ||
+      storage.capacity() > MAX_POOLED_CAPACITY ||
+      buffers.size() >= MAX_POOLED_BUFFERS)
+    return;
+  storage.clear();
+  buffers.push_back(std::string());
+  buffers.back().swap(storage);
+}
@@ -13,13 +13,28 @@
 #include "../../includes/networking/client_connection.hpp"
 #include "../../includes/http/http_request.hpp"
 #include "../../includes/http/http_response_handling.hpp"
+#include "../../includes/networking/buffer_pool.hpp"
+#include "../../includes/networking/socket_address.hpp"
 #include "../../includes/webserv.hpp"
 
-ClientConnection::ClientConnection(int fd, int server_fd)
+ClientConnection::ClientConnection(int fd, int server_fd,
+                                   const std::string &listen_address,
+                                   const struct sockaddr *peer)
     : socket_fd(fd), state(READING), last_activity(time(NULL)),
-      server_socket_fd(server_fd) {}
-
-ClientConnection::~ClientConnection() { close_connection(); }
+      server_socket_fd(server_fd), listen_address(listen_address),
+      remote_address(format_socket_host(peer)),
+      remote_port(socket_address_port(peer)),
+      has_client_key(make_client_key(peer, client_key)), rejected_status(0),
+      requests_served(0), idle(false), keepalive_timeout(0),
+      cached_server(NULL) {}
+
+ClientConnection::~ClientConnection() {
+  close_connection();
+  if (counted_in)
+    counted_in->release_connection(client_key);
+  BufferPool::instance().release(buffer);
+  response_writer.release_buffers();
+}
 
 int ClientConnection::get_socket_fd() const { return socket_fd; }
 
@@ -31,6 +46,32 @@ const std::string &ClientConnection::get_buffer() const { return buffer; }
 
 int ClientConnection::get_server_socket_fd() const { return server_socket_fd; }
 
+const std::string &ClientConnection::get_listen_address() const {
+  return listen_address;
+}
+
+const std::string &ClientConnection::get_local_address() {
+  if (local_address.empty()) {
+    struct sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    if (getsockname(socket_fd, (struct sockaddr *)&address, &length) == 0)
+      local_address = format_socket_address((struct sockaddr *)&address);
+  }
+  return local_address;
+}
+
+const std::string &ClientConnection::get_remote_address() const {
+  return remote_address;
+}
+
+int ClientConnection::get_remote_port() const { return remote_port; }
+
+const ClientKey *ClientConnection::get_client_key() const {
+  return has_client_key ? &client_key : NULL;
+}
+
+int ClientConnection::get_rejected_status() const { return rejected_status; }
+
 void ClientConnection::set_state(ConnectionState new_state) {
   state = new_state;
   update_activity();
@@ -39,12 +80,79 @@ void ClientConnection::set_state(ConnectionState new_state) {
 void ClientConnection::update_activity() { last_activity = time(NULL); }
 
 void ClientConnection::append_to_buffer(const std::string &data) {
+  if (buffer.empty())
+    BufferPool::instance().acquire(buffer, INITIAL_BUFFER_CAPACITY);
   buffer += data;
+  idle = false;
   update_activity();
 }
 
 void ClientConnection::clear_buffer() { buffer.clear(); }
 
+void ClientConnection::count_in(const std::shared_ptr<LimitZone> &zone) {
+  counted_in = zone;
+}
+
+void ClientConnection::reject(int status) { rejected_status = status; }
+
+void ClientConnection::send_response(const HttpResponse &response,
+                                     bool allow_chunked) {
+  response_writer.start(response, allow_chunked);
+  set_state(WRITING);
+}
+
+ResponseWriter &ClientConnection::get_response_writer() {
+  return response_writer;
+}
+
+bool ClientConnection::has_pending_output() const {
+  return response_writer.has_pending_output();
+}
+
+size_t ClientConnection::count_request() { return ++requests_served; }
+
+void ClientConnection::set_keepalive_timeout(time_t timeout_seconds) {
+  keepalive_timeout = timeout_seconds;
+}
+
+void ClientConnection::begin_keepalive() {
+  idle = true;
+  BufferPool::instance().release(buffer);
+  response_writer.release_buffers();
+  set_state(READING);
+}
+
+bool ClientConnection::is_idle() const { return idle; }
+
+time_t ClientConnection::get_keepalive_timeout() const {
+  return keepalive_timeout;
+}
+
+const std::shared_ptr<const RuntimeConfig> &
+ClientConnection::get_config() const {
+  return config;
+}
+
+void ClientConnection::set_config(
+    const std::shared_ptr<const RuntimeConfig> &config) {
+  this->config = config;
+  cached_host.clear();
+  cached_server = NULL;
+}
+
+const ServerConfig *
+ClientConnection::get_cached_server(std::string_view host) const {
+  if (cached_server && host == cached_host)
+    return cached_server;
+  return NULL;
+}
+
+void ClientConnection::cache_server(std::string_view host,
+                                    const ServerConfig *server) {
+  cached_host.assign(host.data(), host.size());
+  cached_server = server;
+}
+
 bool ClientConnection::is_timed_out(time_t timeout_seconds) const {
   return (time(NULL) - last_activity) > timeout_seconds;
 }
@@ -11,17 +11,41 @@
 /* ************************************************************************** */
 
 #include "../../includes/networking/event_loop.hpp"
+#include "../../includes/http/gzip_filter.hpp"
+#include "../../includes/http/header_writer.hpp"
 #include "../../includes/http/http_response_handling.hpp"
 #include "../includes/http/http_cgi_handler.hpp"
 #include "webserv.hpp" // IWYU pragma: keep
 #include <algorithm>
+#include <climits>
+#include <cstdlib>
 #include <ctime> // for time()
+#include <netinet/tcp.h>
+#include <sys/wait.h>
 
-EventLoop::EventLoop(SocketManager &sm, time_t timeout)
-    : socket_manager(sm), running(false), timeout_seconds(timeout) {}
+const char *const EventLoop::UPGRADE_READY_ENV = "WEBSERV_UPGRADE_READY_FD";
+
+int EventLoop::signal_pipe[2] = {-1, -1};
+
+EventLoop::EventLoop(SocketManager &sm,
+                     const std::shared_ptr<const RuntimeConfig> &config)
+    : socket_manager(sm), config(config), upgrade_pid(-1),
+      upgrade_ready_fd(-1), draining(false), drain_deadline(0),
+      accept_paused(false), accept_resume_at(0), next_timeout_at(-1),
+      running(false) {
+  if (signal_pipe[0] < 0 && pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) < 0)
+    log_error("Failed to create signal pipe: " + std::string(strerror(errno)));
+}
 
 EventLoop::~EventLoop() {
   stop();
+  if (upgrade_ready_fd >= 0)
+    close(upgrade_ready_fd);
+  for (int i = 0; i < 2; ++i) {
+    if (signal_pipe[i] >= 0)
+      close(signal_pipe[i]);
+    signal_pipe[i] = -1;
+  }
   // Clean up all client connections
   for (std::map<int, ClientConnection *>::iterator it = clients.begin();
        it != clients.end(); ++it) {
@@ -41,22 +65,28 @@ void EventLoop::run() {
     return;
   }
 
+  if (signal_pipe[0] < 0) {
+    std::cerr << "Signal pipe not available" << std::endl;
+    return;
+  }
+
   running = true;
   setup_poll_fds();
+  add_to_poll(signal_pipe[0], POLLIN);
 
+  report_connection_budget();
   std::cout << "Event loop started. Listening for connections..." << std::endl;
 
   while (running) {
-    // Clean up timed out clients
-    cleanup_timed_out_clients();
+    // Clean up timed out clients, then sleep until the next one could
+    // time out (signals and the drain deadline wake the loop too)
+    int poll_timeout = cleanup_timed_out_clients();
 
-    // Wait for events with a timeout
-    int poll_result =
-        poll(&poll_fds[0], poll_fds.size(), 1000); // 1 second timeout
+    int poll_result = poll(&poll_fds[0], poll_fds.size(), poll_timeout);
 
     if (poll_result < 0) {
       if (errno == EINTR) {
-        // Interrupted by signal, continue
+        // Interrupted by signal: the signal pipe is readable on next poll()
         continue;
       }
       log_error("poll() failed");
@@ -66,103 +96,287 @@ void EventLoop::run() {
     if (poll_result > 0) {
       handle_events(poll_result);
     }
+
+    // Exit as soon as the last response is out, or at the deadline
+    if (draining) {
+      close_idle_clients();
+      if (clients.empty()) {
+        std::cout << "All connections drained" << std::endl;
+        running = false;
+      } else if (time(NULL) >= drain_deadline) {
+        std::cout << "Shutdown timeout reached, closing " << clients.size()
+                  << " connection(s)" << std::endl;
+        running = false;
+      }
+    }
   }
 
+  // Stopped without draining; after a drain the listeners are gone already
+  socket_manager.remove_socket_files();
   std::cout << "Event loop stopped" << std::endl;
 }
 
 void EventLoop::stop() { running = false; }
 
+// Memory an open connection costs here, before the kernel's socket buffers.
+// Request and response buffers are pooled and released while idle.
+void EventLoop::report_connection_budget() const {
+  const MainConfig &limits = config->get_main_config();
+  size_t per_connection = sizeof(ClientConnection) + sizeof(struct pollfd) +
+                          sizeof(int) + // poll slot
+                          4 * sizeof(void *); // clients map node
+  std::cout << "Per-connection memory: " << per_connection
+            << " bytes idle (ClientConnection " << sizeof(ClientConnection)
+            << ", of which HttpRequest " << sizeof(HttpRequest)
+            << " and RequestParser " << sizeof(RequestParser)
+            << "), plus up to " << limits.client_header_buffer_size
+            << " bytes of request buffer while reading" << std::endl;
+  std::cout << "worker_connections " << limits.worker_connections << ": ~"
+            << (per_connection * limits.worker_connections + 1023) / 1024
+            << " KiB for idle connections" << std::endl;
+}
+
 void EventLoop::shutdown_gracefully() {
+  if (draining)
+    return;
   std::cout << "Beginning graceful shutdown..." << std::endl;
+  socket_manager.remove_socket_files();
+  begin_drain();
+}
 
-  // Stop accepting new connections
-  running = false;
+bool EventLoop::is_running() const { return running; }
 
-  // Send "Connection: close" responses to all active clients
-  std::cout << "Closing " << clients.size() << " active client connections..."
-            << std::endl;
+void EventLoop::set_config_loader(
+    const std::function<std::shared_ptr<const RuntimeConfig>()> &loader) {
+  config_loader = loader;
+}
 
-  for (std::map<int, ClientConnection *>::iterator it = clients.begin();
-       it != clients.end(); ++it) {
-    int client_fd = it->first;
-    ClientConnection *client = it->second;
-
-    // If client has pending data to write, let it finish
-    if (client->get_state() == WRITING && !client->get_buffer().empty()) {
-      // Send a brief "server shutting down" message after current response
-      std::string shutdown_msg = "\r\n<!-- Server shutting down -->\r\n";
-      client->append_to_buffer(shutdown_msg);
-    } else if (client->get_state() == READING) {
-      // Send a graceful shutdown response
-      std::string shutdown_response = "HTTP/1.1 503 Service Unavailable\r\n"
-                                      "Content-Type: text/plain\r\n"
-                                      "Content-Length: 26\r\n"
-                                      "Connection: close\r\n"
-                                      "Server: webserv/1.0\r\n"
-                                      "\r\n"
-                                      "Server is shutting down...";
-
-      client->clear_buffer();
-      client->append_to_buffer(shutdown_response);
-      client->set_state(WRITING);
+void EventLoop::post_signal(int sig) {
+  int saved_errno = errno;
+  unsigned char byte = static_cast<unsigned char>(sig);
+  if (signal_pipe[1] >= 0 && write(signal_pipe[1], &byte, 1) < 0) {
+    // Pipe full: signals already pending will wake the loop
+  }
+  errno = saved_errno;
+}
+
+// Act on the signals posted since the last poll(). SIGINT stops at once;
+// SIGTERM and SIGUSR1 drain, and stop at once if already draining.
+void EventLoop::handle_signals() {
+  unsigned char sig;
+  while (read(signal_pipe[0], &sig, 1) == 1) {
+    switch (sig) {
+    case SIGCHLD:
+      CgiOutputStream::reap_children();
+      break;
+    case SIGHUP:
+      reload_config();
+      break;
+    case SIGUSR2:
+      start_upgrade();
+      break;
+    case SIGINT:
+      std::cout << "Received SIGINT (Ctrl+C), shutting down..." << std::endl;
+      stop();
+      break;
+    case SIGTERM:
+    case SIGUSR1:
+      std::cout << "Received " << (sig == SIGTERM ? "SIGTERM" : "SIGUSR1")
+                << std::endl;
+      if (!draining) {
+        shutdown_gracefully();
+        break;
+      }
+      std::cout << "Already draining, shutting down now..." << std::endl;
+      stop();
+      break;
+    default:
+      std::cout << "Received signal " << static_cast<int>(sig)
+                << ", shutting down..." << std::endl;
+      stop();
+      break;
     }
+  }
+}
+
+void EventLoop::set_upgrade_command(const std::vector<std::string> &command) {
+  upgrade_command = command;
+}
 
-    std::cout << "Notifying client " << client_fd << " of shutdown"
+void EventLoop::notify_upgrade_ready() {
+  const char *value = getenv(UPGRADE_READY_ENV);
+  if (!value)
+    return;
+  int fd = atoi(value);
+  unsetenv(UPGRADE_READY_ENV);
+  if (fd <= STDERR_FILENO)
+    return;
+  if (write(fd, "R", 1) != 1)
+    std::cerr << "Failed to notify the previous process: " << strerror(errno)
               << std::endl;
+  close(fd);
+}
+
+// Fork and exec the (replaced) binary with the listening sockets inherited.
+// This process keeps accepting until the new one reports it is listening,
+// so a binary that fails to start costs nothing.
+void EventLoop::start_upgrade() {
+  if (upgrade_command.empty())
+    return;
+  if (draining || upgrade_pid > 0) {
+    std::cerr << "Upgrade already in progress" << std::endl;
+    return;
   }
 
-  // Give clients a brief moment to receive shutdown messages
-  std::cout << "Allowing time for client notifications..." << std::endl;
+  int ready_pipe[2];
+  if (pipe2(ready_pipe, O_CLOEXEC) < 0) {
+    log_error("Failed to create upgrade pipe: " +
+              std::string(strerror(errno)));
+    return;
+  }
+  std::string listeners = socket_manager.describe_listeners();
+  std::vector<char *> argv;
+  for (size_t i = 0; i < upgrade_command.size(); ++i)
+    argv.push_back(const_cast<char *>(upgrade_command[i].c_str()));
+  argv.push_back(NULL);
+
+  std::cout << "Starting new binary " << upgrade_command[0] << std::endl;
+  pid_t pid = fork();
+  if (pid < 0) {
+    log_error("Failed to fork for upgrade: " + std::string(strerror(errno)));
+    close(ready_pipe[0]);
+    close(ready_pipe[1]);
+    return;
+  }
+  if (pid == 0) {
+    // Everything else is close-on-exec: clients, CGI pipes, files
+    socket_manager.set_inheritable(true);
+    fcntl(ready_pipe[1], F_SETFD, 0);
+    setenv(SocketManager::LISTENERS_ENV, listeners.c_str(), 1);
+    setenv(UPGRADE_READY_ENV, std::to_string(ready_pipe[1]).c_str(), 1);
+    execvp(argv[0], &argv[0]);
+    std::cerr << "Failed to exec " << argv[0] << ": " << strerror(errno)
+              << std::endl;
+    _exit(127);
+  }
 
-  // Process any pending writes for a short time
-  time_t shutdown_start = time(NULL);
-  while (time(NULL) - shutdown_start < 2 && !clients.empty()) {
-    int poll_result = poll(&poll_fds[0], poll_fds.size(), 100); // 100ms timeout
+  close(ready_pipe[1]);
+  fcntl(ready_pipe[0], F_SETFL, O_NONBLOCK);
+  upgrade_pid = pid;
+  upgrade_ready_fd = ready_pipe[0];
+  add_to_poll(upgrade_ready_fd, POLLIN);
+}
 
-    if (poll_result > 0) {
-      // Handle only POLLOUT events to send shutdown messages
-      for (size_t i = 0; i < poll_fds.size() && poll_result > 0; ++i) {
-        if (poll_fds[i].revents & POLLOUT) {
-          handle_client_write(poll_fds[i].fd);
-          poll_result--;
-        }
-      }
-    }
+// A byte means the new process is listening; EOF means it exited first
+void EventLoop::handle_upgrade_ready() {
+  char byte;
+  ssize_t bytes_read = read(upgrade_ready_fd, &byte, 1);
+  if (bytes_read < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+  end_upgrade();
+  if (bytes_read <= 0) {
+    // The pipe closes as the process exits, so this returns at once
+    int status;
+    waitpid(upgrade_pid, &status, 0);
+    std::cerr << "New binary (pid " << upgrade_pid
+              << ") failed to start, still serving" << std::endl;
+    upgrade_pid = -1;
+    return;
+  }
+  std::cout << "New binary (pid " << upgrade_pid
+            << ") is ready, handing over the listeners" << std::endl;
+  begin_drain();
+}
 
-    // Remove clients that have finished sending their shutdown messages
-    std::vector<int> finished_clients;
-    for (std::map<int, ClientConnection *>::iterator it = clients.begin();
-         it != clients.end(); ++it) {
-      if (it->second->get_buffer().empty()) {
-        finished_clients.push_back(it->first);
-      }
-    }
+void EventLoop::end_upgrade() {
+  remove_from_poll(upgrade_ready_fd);
+  close(upgrade_ready_fd);
+  upgrade_ready_fd = -1;
+}
 
-    for (std::vector<int>::iterator it = finished_clients.begin();
-         it != finished_clients.end(); ++it) {
-      remove_client(*it);
-    }
-  }
+// Stop accepting. After an upgrade the new process holds the same sockets,
+// so connections still queued in the backlog are accepted there. Requests
+// in progress finish here with Connection: close; idle keep-alive
+// connections are closed right away.
+void EventLoop::begin_drain() {
+  draining = true;
+  drain_deadline =
+      time(NULL) + config->get_main_config().shutdown_timeout;
+  const std::vector<int> &server_sockets = socket_manager.get_server_sockets();
+  for (size_t i = 0; i < server_sockets.size(); ++i)
+    remove_from_poll(server_sockets[i]);
+  socket_manager.close_all_sockets();
+  close_idle_clients();
+  std::cout << "Draining " << clients.size() << " connection(s)" << std::endl;
+}
 
-  // Force close any remaining clients
-  std::vector<int> remaining_clients;
+// Kept-alive connections between requests; clients retry those safely
+void EventLoop::close_idle_clients() {
+  std::vector<int> idle_clients;
   for (std::map<int, ClientConnection *>::iterator it = clients.begin();
        it != clients.end(); ++it) {
-    remaining_clients.push_back(it->first);
+    if (it->second->is_idle() && it->second->get_state() == READING)
+      idle_clients.push_back(it->first);
   }
+  for (size_t i = 0; i < idle_clients.size(); ++i)
+    remove_client(idle_clients[i]);
+}
 
-  for (std::vector<int>::iterator it = remaining_clients.begin();
-       it != remaining_clients.end(); ++it) {
-    std::cout << "Force closing client " << *it << std::endl;
-    remove_client(*it);
+// New requests use the new snapshot; requests in flight finish on the one
+// their connection holds. Listeners on unchanged ports are kept, so no
+// connection is refused while the config changes.
+void EventLoop::reload_config() {
+  if (!config_loader || draining)
+    return;
+  std::cout << "Reloading configuration..." << std::endl;
+  std::shared_ptr<const RuntimeConfig> next = config_loader();
+  if (!next) {
+    std::cerr << "Reload failed, keeping the current configuration"
+              << std::endl;
+    return;
   }
 
-  std::cout << "All client connections closed." << std::endl;
-  std::cout << "Graceful shutdown completed." << std::endl;
-}
+  std::vector<std::string> old_addresses = socket_manager.get_addresses();
+  std::map<std::string, ListenOptions> new_listeners =
+      next->get_listen_options();
+  std::vector<std::string> opened;
+  for (std::map<std::string, ListenOptions>::const_iterator it =
+           new_listeners.begin();
+       it != new_listeners.end(); ++it) {
+    if (std::find(old_addresses.begin(), old_addresses.end(), it->first) !=
+        old_addresses.end())
+      continue;
+    if (!socket_manager.open_listener(it->first, it->second)) {
+      // All or nothing: undo and stay on the current configuration
+      for (size_t j = 0; j < opened.size(); ++j) {
+        remove_from_poll(socket_manager.get_socket_fd_for_address(opened[j]));
+        socket_manager.close_listener(opened[j]);
+      }
+      std::cerr << "Reload failed, keeping the current configuration"
+                << std::endl;
+      return;
+    }
+    opened.push_back(it->first);
+    add_to_poll(socket_manager.get_socket_fd_for_address(it->first), POLLIN);
+  }
+  for (size_t i = 0; i < old_addresses.size(); ++i) {
+    std::map<std::string, ListenOptions>::const_iterator kept =
+        new_listeners.find(old_addresses[i]);
+    if (kept != new_listeners.end()) {
+      socket_manager.update_listener(kept->first, kept->second);
+      continue;
+    }
+    remove_from_poll(socket_manager.get_socket_fd_for_address(old_addresses[i]));
+    socket_manager.close_listener(old_addresses[i]);
+  }
 
-bool EventLoop::is_running() const { return running; }
+  next->apply_process_settings();
+  config = next;
+  next_timeout_at = time(NULL); // Timeouts may have changed: rescan
+  std::cout << "Configuration reloaded (" << opened.size()
+            << " listener(s) added, " << socket_manager.get_addresses().size()
+            << " active)" << std::endl;
+}
 
 void EventLoop::handle_events(int poll_result) {
   for (size_t i = 0; i < poll_fds.size() && poll_result > 0; ++i) {
@@ -172,6 +386,29 @@ void EventLoop::handle_events(int poll_result) {
 
     poll_result--;
 
+    // Signals and the new binary's answer may close listeners and idle
+    // clients, so leave the remaining events to the next poll()
+    if (poll_fds[i].fd == signal_pipe[0]) {
+      handle_signals();
+      break;
+    }
+    if (poll_fds[i].fd == upgrade_ready_fd) {
+      handle_upgrade_ready();
+      break;
+    }
+
+    // A CGI script wrote output or has room for more input
+    if (cgi_waiters.count(poll_fds[i].fd)) {
+      handle_cgi_event(poll_fds[i].fd);
+      continue;
+    }
+
+    // A streamed body has more data (or hit EOF): resume the client write
+    if (stream_waiters.count(poll_fds[i].fd)) {
+      resume_stream_waiter(poll_fds[i].fd);
+      continue;
+    }
+
     if (poll_fds[i].revents & POLLERR) {
       handle_client_error(poll_fds[i].fd);
     } else if (poll_fds[i].revents & POLLHUP) {
@@ -180,43 +417,142 @@ void EventLoop::handle_events(int poll_result) {
       if (is_server_socket(poll_fds[i].fd)) {
         handle_new_connection(poll_fds[i].fd);
       } else {
-        handle_client_read(poll_fds[i].fd);
+        int client_fd = poll_fds[i].fd;
+        handle_client_read(client_fd);
+        schedule_timeout(client_fd);
       }
     } else if (poll_fds[i].revents & POLLOUT) {
-      handle_client_write(poll_fds[i].fd);
+      int client_fd = poll_fds[i].fd;
+      handle_client_write(client_fd);
+      schedule_timeout(client_fd);
     }
   }
 }
 
+// Accept the connections queued on a listener, up to ACCEPT_BATCH per
+// wakeup so a connection storm cannot starve established clients
 void EventLoop::handle_new_connection(int server_fd) {
-  struct sockaddr_in client_addr;
-  socklen_t client_addr_len = sizeof(client_addr);
+  for (int accepted = 0; accepted < ACCEPT_BATCH; ++accepted) {
+    struct sockaddr_storage client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+
+    // Non-blocking, and kept out of CGI scripts and upgraded binaries
+    int client_fd =
+        accept4(server_fd, (struct sockaddr *)&client_addr, &client_addr_len,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd < 0) {
+      if (errno == EMFILE || errno == ENFILE) {
+        // The connection stays queued; retry once descriptors free up
+        log_error("accept() failed: " + std::string(strerror(errno)));
+        pause_accepting();
+      } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+                 errno != ECONNABORTED) {
+        log_error("accept() failed: " + std::string(strerror(errno)));
+      }
+      return;
+    }
 
-  int client_fd =
-      accept(server_fd, (struct sockaddr *)&client_addr, &client_addr_len);
-  if (client_fd < 0) {
-    log_error("accept() failed");
-    return;
+    // Check if we've reached the maximum number of clients
+    if (clients.size() >= config->get_main_config().worker_connections) {
+      std::cout << "Maximum number of clients reached, rejecting connection"
+                << std::endl;
+      close(client_fd);
+      continue;
+    }
+
+    // Responses go out in several writes (headers, then file data): do not
+    // let Nagle hold back the last partial segment
+    if (client_addr.ss_family != AF_UNIX &&
+        config->get_main_config().tcp_nodelay) {
+      int nodelay = 1;
+      setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay,
+                 sizeof(nodelay));
+    }
+
+    ClientConnection *client =
+        add_client(client_fd, server_fd, (struct sockaddr *)&client_addr);
+    std::cout << "New client connected (fd: " << client_fd << ", from "
+              << client->get_remote_address();
+    if (client->get_remote_port() >= 0)
+      std::cout << ":" << client->get_remote_port();
+    std::cout << ")" << std::endl;
+    limit_connection(client);
   }
+}
 
-  // Set client socket to non-blocking
-  int flags = fcntl(client_fd, F_GETFL, 0);
-  if (flags < 0 || fcntl(client_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
-    log_error("Failed to set client socket non-blocking");
-    close(client_fd);
+// A client over its limit_conn is answered limit_conn_status right away,
+// without waiting for its request, so it gives its slot back at once
+void EventLoop::limit_connection(ClientConnection *client) {
+  const std::shared_ptr<LimitZone> &zone = config->get_conn_limit_zone();
+  const ClientKey *key = client->get_client_key();
+  if (!zone || !key)
     return;
-  }
+  const MainConfig &main_config = config->get_main_config();
+  if (zone->acquire_connection(*key, main_config.limit_conn))
+    client->count_in(zone);
+  else
+    reject_client(client, main_config.limit_conn_status);
+}
 
-  // Check if we've reached the maximum number of clients
-  if (clients.size() >= MAX_CLIENTS) {
-    std::cout << "Maximum number of clients reached, rejecting connection"
-              << std::endl;
-    close(client_fd);
+static uint64_t monotonic_ms() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+void EventLoop::limit_request(ClientConnection *client) {
+  const std::shared_ptr<LimitZone> &zone = config->get_req_limit_zone();
+  const ClientKey *key = client->get_client_key();
+  if (!zone || !key)
     return;
-  }
+  const MainConfig &main_config = config->get_main_config();
+  if (!zone->allow_request(*key, main_config.limit_req_burst, monotonic_ms()))
+    reject_client(client, main_config.limit_req_status);
+}
+
+void EventLoop::reject_client(ClientConnection *client, int status) {
+  client->reject(status);
+  std::cout << "Rejecting client " << client->get_remote_address()
+            << " over its limit with " << status << std::endl;
+  const char *reason = status_reason(status);
+  HttpResponse response(status);
+  response.set_header("Content-Type", "text/plain");
+  response.set_header("Connection", "close");
+  response.set_body(reason ? reason : "Request Rejected");
+  send_response(client->get_socket_fd(), response);
+}
+
+// The request of a rejected client was never read. Closing with it still
+// queued would send an RST, which may make the client drop the answer:
+// send a FIN first and discard what has arrived.
+void EventLoop::discard_input(int client_fd) {
+  shutdown(client_fd, SHUT_WR);
+  if (read_buffer.empty())
+    read_buffer.resize(config->get_main_config().client_header_buffer_size);
+  for (int reads = 0; reads < DISCARD_READS; ++reads)
+    if (recv(client_fd, &read_buffer[0], read_buffer.size(), 0) <= 0)
+      break;
+}
+
+// Out of descriptors: stop polling the listeners (they would stay readable
+// and spin the loop) until a client leaves or a second has passed
+void EventLoop::pause_accepting() {
+  if (accept_paused)
+    return;
+  accept_paused = true;
+  accept_resume_at = time(NULL) + 1;
+  const std::vector<int> &server_sockets = socket_manager.get_server_sockets();
+  for (size_t i = 0; i < server_sockets.size(); ++i)
+    update_poll_events(server_sockets[i], 0);
+}
 
-  add_client(client_fd, server_fd);
-  std::cout << "New client connected (fd: " << client_fd << ")" << std::endl;
+void EventLoop::resume_accepting() {
+  if (!accept_paused)
+    return;
+  accept_paused = false;
+  const std::vector<int> &server_sockets = socket_manager.get_server_sockets();
+  for (size_t i = 0; i < server_sockets.size(); ++i)
+    update_poll_events(server_sockets[i], POLLIN);
 }
 
 void EventLoop::handle_client_read(int client_fd) {
@@ -225,9 +561,12 @@ void EventLoop::handle_client_read(int client_fd) {
     return;
   }
   ClientConnection *client = it->second;
-  char buffer[MAX_BUFFER_SIZE];
+  size_t buffer_size = config->get_main_config().client_header_buffer_size;
+  if (read_buffer.size() != buffer_size)
+    read_buffer.resize(buffer_size);
+  char *buffer = &read_buffer[0];
 
-  ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
+  ssize_t bytes_read = recv(client_fd, buffer, read_buffer.size(), 0);
 
   if (bytes_read <= 0) {
     // Connection closed or error
@@ -235,7 +574,15 @@ void EventLoop::handle_client_read(int client_fd) {
     return;
   }
 
-  buffer[bytes_read] = '\0';
+  // A new request starts on the current config snapshot, and counts
+  // against the client's request rate
+  if (client->get_buffer().empty()) {
+    if (client->get_config() != config)
+      client->set_config(config);
+    limit_request(client);
+    if (client->get_rejected_status())
+      return;
+  }
 
   // Append to client's buffer
   client->append_to_buffer(std::string(buffer, bytes_read));
@@ -250,24 +597,11 @@ void EventLoop::handle_client_read(int client_fd) {
                 << request.get_error_message() << std::endl;
 
       // Build and send error response before closing connection
-      std::string error_response = "HTTP/1.1 ";
-      error_response += std::to_string(request.get_error_code());
-      error_response += " ";
-      error_response += request.get_error_message();
-      error_response += "\r\n";
-      error_response += "Content-Type: text/plain\r\n";
-      error_response += "Content-Length: ";
-      error_response += std::to_string(request.get_error_message().length());
-      error_response += "\r\n";
-      error_response += "Connection: close\r\n";
-      error_response += "Server: webserv/1.0\r\n";
-      error_response += "\r\n";
-      error_response += request.get_error_message();
-
-      client->clear_buffer();
-      client->append_to_buffer(error_response);
-      client->set_state(WRITING);
-      update_poll_events(client_fd, POLLOUT);
+      HttpResponse error_response(request.get_error_code());
+      error_response.set_header("Content-Type", "text/plain");
+      error_response.set_header("Connection", "close");
+      error_response.set_body(request.get_error_message());
+      send_response(client_fd, error_response);
     }
     // Reset client parser state to avoid poisoning subsequent requests
     client->get_request_parser().reset();
@@ -289,27 +623,15 @@ void EventLoop::handle_client_read(int client_fd) {
               static_cast<size_t>(std::strtoul(cl_hdr.c_str(), NULL, 10));
         }
       }
-      if (content_length > 0 && limit > 0 && content_length > limit) {
+      // Safety: the body may also grow beyond the limit (non-length cases).
+      // The rest of the body is never read, so the connection must close.
+      if ((content_length > 0 && limit > 0 && content_length > limit) ||
+          (limit > 0 && request.get_body().size() > limit)) {
         HttpResponseHandling responder(server_config_for_limit);
-        std::string resp =
+        HttpResponse error_response =
             responder.build_error_response(413, "Payload Too Large");
-        client->clear_buffer();
-        client->append_to_buffer(resp);
-        client->set_state(WRITING);
-        update_poll_events(client_fd, POLLOUT);
-        client->get_request_parser().reset();
-        request.clear();
-        return;
-      }
-      // Safety: if body grows beyond limit (for future non-length cases)
-      if (limit > 0 && request.get_body().size() > limit) {
-        HttpResponseHandling responder(server_config_for_limit);
-        std::string resp =
-            responder.build_error_response(413, "Payload Too Large");
-        client->clear_buffer();
-        client->append_to_buffer(resp);
-        client->set_state(WRITING);
-        update_poll_events(client_fd, POLLOUT);
+        error_response.set_header("Connection", "close");
+        send_response(client_fd, error_response);
         client->get_request_parser().reset();
         request.clear();
         return;
@@ -325,25 +647,17 @@ void EventLoop::handle_client_read(int client_fd) {
     const ServerConfig *server_config = select_server_config(client, request);
     if (!server_config) {
       // Server selection failed - send 500 error
-      std::string error_response = "HTTP/1.1 500 Internal Server Error\r\n";
-      error_response += "Content-Type: text/plain\r\n";
-      error_response += "Content-Length: 21\r\n";
-      error_response += "\r\n";
-      error_response += "Server config error!";
-
-      client->clear_buffer();
-      client->append_to_buffer(error_response);
-      client->set_state(WRITING);
-      update_poll_events(client_fd, POLLOUT);
+      HttpResponse error_response(500);
+      error_response.set_header("Content-Type", "text/plain");
+      error_response.set_header("Connection", "close");
+      error_response.set_body("Server config error!");
+      send_response(client_fd, error_response);
 
       client->get_request_parser().reset();
       request.clear();
       return;
     }
 
-    std::cout << "Selected server: " << server_config->server_name << " (port "
-              << server_config->listen_port << ")" << std::endl;
-
     // Enforce client_max_body_size on completed requests as well
     size_t limit = server_config->client_max_body_size;
     size_t content_length = request.get_content_length();
@@ -357,13 +671,10 @@ void EventLoop::handle_client_read(int client_fd) {
     if ((limit > 0 && content_length > limit) ||
         (limit > 0 && request.get_body().size() > limit)) {
       HttpResponseHandling responder(server_config);
-      std::string resp =
+      HttpResponse error_response =
           responder.build_error_response(413, "Payload Too Large");
-
-      client->clear_buffer();
-      client->append_to_buffer(resp);
-      client->set_state(WRITING);
-      update_poll_events(client_fd, POLLOUT);
+      set_persistence(client, request, *server_config, error_response);
+      send_response(client_fd, error_response);
 
       client->get_request_parser().reset();
       request.clear();
@@ -372,15 +683,23 @@ void EventLoop::handle_client_read(int client_fd) {
 
     RouteResult route_result = router.route_request(*server_config, request);
 
-    std::string response;
+    HttpResponse response;
     HttpResponseHandling responder(server_config);
     if (route_result.status == ROUTE_OK) {
-      if (route_result.is_cgi_request) {
+      if (route_result.is_cgi_request && request.get_method() != OPTIONS) {
         std::cout << "Processing CGI request for URI: "
                   << route_result.file_path << std::endl;
         CgiHandler cgi_handler;
-        response = cgi_handler.execute_cgi(request, *route_result.location,
-                                           route_result.file_path);
+        std::shared_ptr<CgiOutputStream> cgi_output;
+        response = cgi_handler.execute_cgi(
+            request, *route_result.location, route_result.file_path,
+            client->get_remote_address(), client->get_remote_port(),
+            cgi_output);
+        if (cgi_output) {
+          start_cgi(client_fd, cgi_output, server_config,
+                    route_result.location->cgi_timeout);
+          return;
+        }
       } else {
         response = responder.handle_request(request, route_result);
       }
@@ -390,14 +709,12 @@ void EventLoop::handle_client_read(int client_fd) {
                                 ? "Error"
                                 : route_result.error_message;
       response = responder.build_error_response(code, message);
+      if (code == 405 && route_result.location)
+        response.set_header("Allow", route_result.location->allow_header);
     }
 
-    client->clear_buffer();
-    client->append_to_buffer(response);
-    client->set_state(WRITING);
-    update_poll_events(client_fd, POLLOUT);
-    client->get_request_parser().reset();
-    request.clear();
+    respond(client, request, *server_config, response,
+            route_result.status == ROUTE_OK && !route_result.is_cgi_request);
   }
   std::cout << "Read " << bytes_read << " bytes from client " << client_fd
             << std::endl;
@@ -410,35 +727,167 @@ void EventLoop::handle_client_write(int client_fd) {
   }
 
   ClientConnection *client = it->second;
-  const std::string &data = client->get_buffer();
+  ResponseWriter &writer = client->get_response_writer();
 
-  if (data.empty()) {
-    // No data to write, switch back to reading
-    client->set_state(READING);
+  ssize_t bytes_sent = writer.write_to(client_fd);
+  if (bytes_sent < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      if (writer.get_wait_fd() >= 0)
+        wait_for_stream(client_fd, writer.get_wait_fd());
+      return;
+    }
+    // Error occurred (or a file shrank below its announced length)
+    remove_client(client_fd);
+    return;
+  }
+  if (bytes_sent > 0)
+    client->update_activity();
+
+  if (!writer.has_pending_output()) {
+    // All data sent; close now if the response said so (or its body is
+    // delimited by the close), otherwise wait idle for the next request
+    if (writer.should_close()) {
+      if (client->get_rejected_status())
+        discard_input(client_fd);
+      remove_client(client_fd);
+      return;
+    }
+    client->begin_keepalive();
     update_poll_events(client_fd, POLLIN);
+  }
+
+  std::cout << "Sent " << bytes_sent << " bytes to client " << client_fd
+            << std::endl;
+}
+
+// Finish the response to a complete request, send it and get ready for
+// the next one
+void EventLoop::respond(ClientConnection *client, HttpRequest &request,
+                        const ServerConfig &server_config,
+                        HttpResponse &response, bool cacheable) {
+  response.set_header_only(request.get_method() == HEAD);
+
+  // Optional on-the-fly compression (gzip on;)
+  GzipFilter gzip_filter(&server_config);
+  gzip_filter.apply(request, response, cacheable);
+
+  set_persistence(client, request, server_config, response);
+  send_response(client->get_socket_fd(), response,
+                request.get_http_version() == "HTTP/1.1");
+  client->get_request_parser().reset();
+  request.clear();
+}
+
+// RFC 7230 section 6.3: decide whether the connection outlives this response
+// and tell the client through the Connection header
+void EventLoop::set_persistence(ClientConnection *client,
+                                const HttpRequest &request,
+                                const ServerConfig &server_config,
+                                HttpResponse &response) {
+  size_t served = client->count_request();
+  bool keep_alive = running && !draining && request.is_keep_alive() &&
+                    server_config.keepalive_timeout > 0 &&
+                    served < server_config.keepalive_requests;
+  if (!keep_alive) {
+    response.set_header("Connection", "close");
     return;
   }
+  client->set_keepalive_timeout(server_config.keepalive_timeout);
+  // HTTP/1.0 clients only persist when told so explicitly
+  if (request.get_http_version() != "HTTP/1.1")
+    response.set_header("Connection", "keep-alive");
+}
 
-  ssize_t bytes_sent = send(client_fd, data.c_str(), data.length(), 0);
+// Hand a response to the client's writer and wait for the socket to drain it
+void EventLoop::send_response(int client_fd, const HttpResponse &response,
+                              bool allow_chunked) {
+  std::map<int, ClientConnection *>::iterator it = clients.find(client_fd);
+  if (it == clients.end())
+    return;
+  it->second->clear_buffer();
+  it->second->send_response(response, allow_chunked);
+  update_poll_events(client_fd, POLLOUT);
+}
 
-  if (bytes_sent < 0) {
-    // Error occurred
-    remove_client(client_fd);
+// The response body is produced by another descriptor (e.g. a CGI pipe):
+// stop polling the client for output until that descriptor is readable
+void EventLoop::wait_for_stream(int client_fd, int stream_fd) {
+  stream_waiters[stream_fd] = client_fd;
+  add_to_poll(stream_fd, POLLIN);
+  update_poll_events(client_fd, 0);
+}
+
+void EventLoop::resume_stream_waiter(int stream_fd) {
+  std::map<int, int>::iterator it = stream_waiters.find(stream_fd);
+  int client_fd = it->second;
+  stream_waiters.erase(it);
+  remove_from_poll(stream_fd);
+  update_poll_events(client_fd, POLLOUT);
+}
+
+// The script runs while the loop serves other clients; its activity counts
+// as the client's, so cgi_timeout is measured from its last output
+void EventLoop::start_cgi(int client_fd,
+                          const std::shared_ptr<CgiOutputStream> &output,
+                          const ServerConfig *server_config, time_t timeout) {
+  PendingCgi &pending = pending_cgi[client_fd];
+  pending.output = output;
+  pending.server_config = server_config;
+  pending.timeout = timeout;
+  update_poll_events(client_fd, 0);
+  watch_cgi(client_fd);
+  clients[client_fd]->update_activity();
+  schedule_timeout(client_fd);
+}
+
+void EventLoop::handle_cgi_event(int pipe_fd) {
+  int client_fd = cgi_waiters[pipe_fd];
+  // read_headers() closes the script's stdin once the body is written
+  unwatch_cgi(client_fd);
+  PendingCgi &pending = pending_cgi[client_fd];
+  clients[client_fd]->update_activity();
+  schedule_timeout(client_fd);
+  if (!pending.output->read_headers()) {
+    watch_cgi(client_fd);
     return;
   }
+  CgiHandler cgi_handler;
+  HttpResponse response = cgi_handler.build_response(pending.output);
+  finish_cgi(client_fd, response);
+}
 
-  if (bytes_sent == static_cast<ssize_t>(data.length())) {
-    // All data sent
-    client->clear_buffer();
-    client->set_state(READING);
-    update_poll_events(client_fd, POLLIN);
-  } else {
-    // Partial send, keep the remaining data
-    client->append_to_buffer(data.substr(bytes_sent));
+// Send the response built from the script's headers (or the 504 for a
+// silent one, whose stream goes with it and kills the script)
+void EventLoop::finish_cgi(int client_fd, HttpResponse &response) {
+  unwatch_cgi(client_fd);
+  std::map<int, PendingCgi>::iterator it = pending_cgi.find(client_fd);
+  const ServerConfig *server_config = it->second.server_config;
+  pending_cgi.erase(it);
+  ClientConnection *client = clients[client_fd];
+  respond(client, client->get_http_request(), *server_config, response,
+          false);
+}
+
+void EventLoop::watch_cgi(int client_fd) {
+  const CgiOutputStream &output = *pending_cgi[client_fd].output;
+  cgi_waiters[output.output_fd()] = client_fd;
+  add_to_poll(output.output_fd(), POLLIN);
+  if (output.input_wait_fd() >= 0) {
+    cgi_waiters[output.input_wait_fd()] = client_fd;
+    add_to_poll(output.input_wait_fd(), POLLOUT);
   }
+}
 
-  std::cout << "Sent " << bytes_sent << " bytes to client " << client_fd
-            << std::endl;
+void EventLoop::unwatch_cgi(int client_fd) {
+  std::map<int, PendingCgi>::iterator it = pending_cgi.find(client_fd);
+  if (it == pending_cgi.end())
+    return;
+  const CgiOutputStream &output = *it->second.output;
+  int fds[2] = {output.output_fd(), output.input_wait_fd()};
+  for (int i = 0; i < 2; ++i) {
+    if (fds[i] >= 0 && cgi_waiters.erase(fds[i]))
+      remove_from_poll(fds[i]);
+  }
 }
 
 void EventLoop::handle_client_error(int client_fd) {
@@ -446,41 +895,126 @@ void EventLoop::handle_client_error(int client_fd) {
   remove_client(client_fd);
 }
 
-void EventLoop::add_client(int client_fd, int server_fd) {
-  ClientConnection *client = new ClientConnection(client_fd, server_fd);
+ClientConnection *EventLoop::add_client(int client_fd, int server_fd,
+                                        const struct sockaddr *peer) {
+  ClientConnection *client = new ClientConnection(
+      client_fd, server_fd, socket_manager.get_address_for_socket(server_fd),
+      peer);
+  client->set_config(config);
   clients[client_fd] = client;
   add_to_poll(client_fd, POLLIN);
+  schedule_timeout(client_fd);
+  return client;
 }
 
 void EventLoop::remove_client(int client_fd) {
   std::map<int, ClientConnection *>::iterator it = clients.find(client_fd);
   if (it != clients.end()) {
+    // Stop watching a stream the client was waiting on; it closes with the
+    // response
+    for (std::map<int, int>::iterator waiter = stream_waiters.begin();
+         waiter != stream_waiters.end(); ++waiter) {
+      if (waiter->second == client_fd) {
+        remove_from_poll(waiter->first);
+        stream_waiters.erase(waiter);
+        break;
+      }
+    }
+    // A script still working for it is killed with its stream
+    unwatch_cgi(client_fd);
+    pending_cgi.erase(client_fd);
     delete it->second;
     clients.erase(it);
     remove_from_poll(client_fd);
+    resume_accepting();
     std::cout << "Client " << client_fd << " disconnected" << std::endl;
   }
 }
 
-void EventLoop::cleanup_timed_out_clients() {
-  std::vector<int> to_remove;
+// Close clients that stayed silent longer than their phase allows. Returns
+// the poll() timeout in ms until the next expiry (-1: nothing to wait for).
+// The clients are only walked once the earliest expiry is due, so a loop
+// iteration does not cost O(connections).
+int EventLoop::cleanup_timed_out_clients() {
+  time_t now = time(NULL);
+  if (accept_paused && now >= accept_resume_at)
+    resume_accepting();
+
+  if (next_timeout_at >= 0 && now >= next_timeout_at) {
+    std::vector<int> to_remove;
+    next_timeout_at = -1;
+    for (std::map<int, ClientConnection *>::iterator it = clients.begin();
+         it != clients.end(); ++it) {
+      time_t limit = client_timeout(it->second);
+      if (it->second->is_timed_out(limit)) {
+        to_remove.push_back(it->first);
+        continue;
+      }
+      // is_timed_out() turns true one second after the limit
+      time_t expiry = it->second->get_last_activity() + limit + 1;
+      if (next_timeout_at < 0 || expiry < next_timeout_at)
+        next_timeout_at = expiry;
+    }
 
-  for (std::map<int, ClientConnection *>::iterator it = clients.begin();
-       it != clients.end(); ++it) {
-    if (it->second->is_timed_out(timeout_seconds)) {
-      to_remove.push_back(it->first);
+    for (std::vector<int>::iterator it = to_remove.begin();
+         it != to_remove.end(); ++it) {
+      if (pending_cgi.count(*it)) {
+        CgiHandler cgi_handler;
+        HttpResponse response = cgi_handler.build_timeout_response();
+        finish_cgi(*it, response);
+        schedule_timeout(*it);
+        continue;
+      }
+      std::cout << "Client " << *it << " timed out" << std::endl;
+      remove_client(*it);
     }
   }
 
-  for (std::vector<int>::iterator it = to_remove.begin(); it != to_remove.end();
-       ++it) {
-    std::cout << "Client " << *it << " timed out" << std::endl;
-    remove_client(*it);
-  }
+  time_t next_expiry = next_timeout_at;
+  if (draining && (next_expiry < 0 || drain_deadline < next_expiry))
+    next_expiry = drain_deadline;
+  if (accept_paused && (next_expiry < 0 || accept_resume_at < next_expiry))
+    next_expiry = accept_resume_at;
+
+  if (next_expiry < 0)
+    return -1;
+  if (next_expiry <= now)
+    return 0;
+  return static_cast<int>(
+      std::min<time_t>(next_expiry - now, INT_MAX / 1000) * 1000);
+}
+
+// A client was active or changed phase: its expiry may now come first
+void EventLoop::schedule_timeout(int client_fd) {
+  std::map<int, ClientConnection *>::iterator it = clients.find(client_fd);
+  if (it == clients.end())
+    return;
+  time_t expiry =
+      it->second->get_last_activity() + client_timeout(it->second) + 1;
+  if (next_timeout_at < 0 || expiry < next_timeout_at)
+    next_timeout_at = expiry;
+}
+
+// Inactivity allowed in the phase the connection is in
+time_t EventLoop::client_timeout(const ClientConnection *client) const {
+  const MainConfig &limits = config->get_main_config();
+  std::map<int, PendingCgi>::const_iterator cgi =
+      pending_cgi.find(client->get_socket_fd());
+  if (cgi != pending_cgi.end())
+    return cgi->second.timeout;
+  // Idle keep-alive connections get their own (usually shorter) timeout
+  if (client->is_idle())
+    return client->get_keepalive_timeout();
+  if (client->get_state() == WRITING)
+    return limits.send_timeout;
+  if (client->get_http_request().get_state() == PARSING_BODY)
+    return limits.client_body_timeout;
+  return limits.client_header_timeout;
 }
 
 void EventLoop::setup_poll_fds() {
   poll_fds.clear();
+  poll_slots.clear();
 
   // Add all server sockets to poll
   const std::vector<int> &server_sockets = socket_manager.get_server_sockets();
@@ -490,32 +1024,44 @@ void EventLoop::setup_poll_fds() {
   }
 }
 
+// poll_slots maps each fd to its entry in poll_fds, so adding, removing
+// and updating an entry is O(1) however many connections are open
 void EventLoop::add_to_poll(int fd, short events) {
+  if (fd < 0)
+    return;
+  if (static_cast<size_t>(fd) >= poll_slots.size())
+    poll_slots.resize(fd + 1, -1);
+  if (poll_slots[fd] >= 0) {
+    poll_fds[poll_slots[fd]].events = events;
+    return;
+  }
   struct pollfd pfd;
   pfd.fd = fd;
   pfd.events = events;
   pfd.revents = 0;
+  poll_slots[fd] = static_cast<int>(poll_fds.size());
   poll_fds.push_back(pfd);
 }
 
+// The last entry moves into the freed slot. During handle_events() it is
+// then skipped for this round and picked up by the next poll().
 void EventLoop::remove_from_poll(int fd) {
-  for (std::vector<struct pollfd>::iterator it = poll_fds.begin();
-       it != poll_fds.end(); ++it) {
-    if (it->fd == fd) {
-      poll_fds.erase(it);
-      break;
-    }
+  if (fd < 0 || static_cast<size_t>(fd) >= poll_slots.size() ||
+      poll_slots[fd] < 0)
+    return;
+  int slot = poll_slots[fd];
+  poll_slots[fd] = -1;
+  if (static_cast<size_t>(slot) != poll_fds.size() - 1) {
+    poll_fds[slot] = poll_fds.back();
+    poll_slots[poll_fds[slot].fd] = slot;
   }
+  poll_fds.pop_back();
 }
 
 void EventLoop::update_poll_events(int fd, short events) {
-  for (std::vector<struct pollfd>::iterator it = poll_fds.begin();
-       it != poll_fds.end(); ++it) {
-    if (it->fd == fd) {
-      it->events = events;
-      break;
-    }
-  }
+  if (fd >= 0 && static_cast<size_t>(fd) < poll_slots.size() &&
+      poll_slots[fd] >= 0)
+    poll_fds[poll_slots[fd]].events = events;
 }
 
 bool EventLoop::is_server_socket(int fd) const {
@@ -531,52 +1077,32 @@ void EventLoop::log_error(const std::string &message) {
 const ServerConfig *
 EventLoop::select_server_config(ClientConnection *client,
                                 const HttpRequest &request) {
-  // Get the server socket that this client connected to
-  int server_socket_fd = client->get_server_socket_fd();
-
-  // Get the base server config for this socket
-  const ServerConfig *base_config =
-      socket_manager.get_config_for_socket(server_socket_fd);
-  if (!base_config) {
-    log_error("No server config found for socket FD: " +
-              std::to_string(server_socket_fd));
-    return NULL;
+  // An absolute-form request target overrides the Host header
+  std::string_view host = request.get_host();
+  if (host.empty()) {
+    const std::map<std::string, std::string> &headers = request.get_headers();
+    std::map<std::string, std::string>::const_iterator it =
+        headers.find("host");
+    if (it != headers.end())
+      host = it->second;
   }
 
-  // Extract Host header from request
-  std::string host_header = request.get_header("host");
-  if (host_header.empty()) {
-    // No Host header - use the default server for this socket
-    std::cout << "No Host header found, using default server: "
-              << base_config->server_name << std::endl;
-    return base_config;
-  }
-
-  // Extract hostname from Host header (remove port if present)
-  // Host header format: "hostname" or "hostname:port"
-  std::string hostname = host_header;
-  size_t colon_pos = hostname.find(':');
-  if (colon_pos != std::string::npos) {
-    hostname = hostname.substr(0, colon_pos);
-  }
-
-  // Search all servers bound to this socket for a matching server_name
-  const std::vector<ServerConfig> *servers_on_socket =
-      socket_manager.get_servers_for_socket(server_socket_fd);
-  if (servers_on_socket) {
-    for (std::vector<ServerConfig>::const_iterator it =
-             servers_on_socket->begin();
-         it != servers_on_socket->end(); ++it) {
-      if (it->server_name == hostname) {
-        std::cout << "Host header '" << hostname << "' matches server_name '"
-                  << it->server_name << "'" << std::endl;
-        return &(*it);
-      }
-    }
+  // Keep-alive clients almost always repeat the same Host
+  const ServerConfig *server = client->get_cached_server(host);
+  if (server)
+    return server;
+
+  // The listener may be gone after a reload; its address is kept per client
+  const RuntimeConfig &snapshot = *client->get_config();
+  const std::string &listen_address = client->get_listen_address();
+  std::string local_address;
+  if (snapshot.serves_specific_addresses(listen_address))
+    local_address = client->get_local_address();
+  server = snapshot.resolve_server(listen_address, local_address, host);
+  if (!server) {
+    log_error("No server config found for " + listen_address);
+    return NULL;
   }
-  // No match found - use default server (first server for this port)
-  std::cout << "Host header '" << hostname
-            << "' did not match any server on this port, using default: "
-            << base_config->server_name << std::endl;
-  return base_config;
+  client->cache_server(host, server);
+  return server;
 }
@@ -0,0 +1,150 @@
+#include "../../includes/networking/limit_zone.hpp"
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <netinet/in.h>
+#include <random>
+
+bool ClientKey::operator==(const ClientKey &other) const {
+  return memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+}
+
+bool make_client_key(const struct sockaddr *address, ClientKey &key) {
+  if (address->sa_family == AF_INET6) {
+    memcpy(key.bytes, &((const struct sockaddr_in6 *)address)->sin6_addr,
+           sizeof(key.bytes));
+    return true;
+  }
+  if (address->sa_family == AF_INET) {
+    memset(key.bytes, 0, 10);
+    key.bytes[10] = 0xff;
+    key.bytes[11] = 0xff;
+    memcpy(key.bytes + 12, &((const struct sockaddr_in *)address)->sin_addr,
+           4);
+    return true;
+  }
+  return false;
+}
+
+LimitZone::LimitZone(const std::string &name, size_t size, uint64_t rate)
+    : name(name), size(size), rate(rate), mask(0) {
+  // Largest power of two that fits the budget
+  size_t capacity = 1;
+  while (capacity * 2 * sizeof(Slot) <= size)
+    capacity *= 2;
+  slots.resize(capacity);
+  memset(&slots[0], 0, capacity * sizeof(Slot));
+  mask = capacity - 1;
+  std::random_device random;
+  seed = (static_cast<uint64_t>(random()) << 32) | random();
+  std::cout << "Limit zone '" << name << "': " << capacity << " clients in "
+            << capacity * sizeof(Slot) << " bytes" << std::endl;
+}
+
+LimitZone::~LimitZone() {}
+
+std::shared_ptr<LimitZone> LimitZone::obtain(const std::string &name,
+                                             size_t size, uint64_t rate) {
+  static std::map<std::string, std::weak_ptr<LimitZone> > zones;
+  std::shared_ptr<LimitZone> zone = zones[name].lock();
+  if (!zone || zone->size != size || zone->rate != rate) {
+    zone.reset(new LimitZone(name, size, rate));
+    zones[name] = zone;
+  }
+  return zone;
+}
+
+bool LimitZone::acquire_connection(const ClientKey &key, size_t limit) {
+  bool claimed;
+  Slot *slot = find(key, 0, true, claimed);
+  if (!slot || slot->value >= limit)
+    return false;
+  ++slot->value;
+  return true;
+}
+
+void LimitZone::release_connection(const ClientKey &key) {
+  bool claimed;
+  Slot *slot = find(key, 0, false, claimed);
+  if (slot && slot->value > 0)
+    --slot->value;
+}
+
+// Leaky bucket: the level drains at rate and each request adds one; a
+// request that would take it above burst is refused and not counted
+bool LimitZone::allow_request(const ClientKey &key, size_t burst,
+                              uint64_t now_ms) {
+  bool claimed;
+  Slot *slot = find(key, now_ms, true, claimed);
+  if (!slot)
+    return false;
+  if (claimed)
+    return true;
+  uint64_t elapsed = now_ms > slot->last_ms ? now_ms - slot->last_ms : 0;
+  if (elapsed > MAX_ELAPSED_MS)
+    elapsed = MAX_ELAPSED_MS;
+  int64_t excess = static_cast<int64_t>(slot->value) -
+                   static_cast<int64_t>(rate * elapsed / 1000) + 1000;
+  if (excess < 0)
+    excess = 0;
+  if (static_cast<uint64_t>(excess) > burst * 1000)
+    return false;
+  slot->value = static_cast<uint32_t>(excess);
+  slot->last_ms = now_ms;
+  return true;
+}
+
+const std::string &LimitZone::get_name() const { return name; }
+
+size_t LimitZone::get_size() const { return size; }
+
+uint64_t LimitZone::get_rate() const { return rate; }
+
+size_t LimitZone::get_capacity() const { return slots.size(); }
+
+// Slots only ever go from unused to used, so a key is never stored past
+// an unused slot of its probe sequence and the search can stop there.
+// With claim, a missing key takes the first reusable slot it passed.
+LimitZone::Slot *LimitZone::find(const ClientKey &key, uint64_t now_ms,
+                                 bool claim, bool &claimed) {
+  claimed = false;
+  size_t index = hash(key);
+  Slot *reusable = NULL;
+  for (size_t i = 0; i < MAX_PROBES; ++i) {
+    Slot &slot = slots[(index + i) & mask];
+    if (slot.used && slot.key == key)
+      return &slot;
+    if (!reusable && is_reusable(slot, now_ms))
+      reusable = &slot;
+    if (!slot.used)
+      break;
+  }
+  if (!claim || !reusable)
+    return NULL;
+  reusable->key = key;
+  reusable->value = 0;
+  reusable->used = 1;
+  reusable->last_ms = now_ms;
+  claimed = true;
+  return reusable;
+}
+
+bool LimitZone::is_reusable(const Slot &slot, uint64_t now_ms) const {
+  if (!slot.used || slot.value == 0)
+    return true;
+  if (rate == 0)
+    return false;
+  uint64_t elapsed = now_ms > slot.last_ms ? now_ms - slot.last_ms : 0;
+  if (elapsed > MAX_ELAPSED_MS)
+    elapsed = MAX_ELAPSED_MS;
+  return static_cast<uint64_t>(slot.value) * 1000 <= rate * elapsed;
+}
+
+size_t LimitZone::hash(const ClientKey &key) const {
+  uint64_t high, low;
+  memcpy(&high, key.bytes, 8);
+  memcpy(&low, key.bytes + 8, 8);
+  uint64_t h = (high ^ seed) * 0x9e3779b97f4a7c15ULL;
+  h = (h ^ low ^ (h >> 29)) * 0xbf58476d1ce4e5b9ULL;
+  return static_cast<size_t>(h ^ (h >> 32));
+}
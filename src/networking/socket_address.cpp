@@ -0,0 +1,193 @@
+#include "../../includes/networking/socket_address.hpp"
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <cstring>
+#include <sys/un.h>
+
+static const char UNIX_PREFIX[] = "unix:";
+static const size_t UNIX_PREFIX_LENGTH = sizeof(UNIX_PREFIX) - 1;
+
+static bool parse_port(const std::string &text, int &port) {
+  if (text.empty() || text.size() > 5 ||
+      text.find_first_not_of("0123456789") != std::string::npos)
+    return false;
+  port = std::atoi(text.c_str());
+  return port >= 1 && port <= 65535;
+}
+
+// Split "host:port" / "[host]:port" / "port"; host is empty for a bare port
+static bool split_listen_value(const std::string &value, std::string &host,
+                               int &port, bool &ipv6) {
+  ipv6 = false;
+  if (!value.empty() && value[0] == '[') {
+    size_t close = value.find("]:");
+    if (close == std::string::npos)
+      return false;
+    host = value.substr(1, close - 1);
+    ipv6 = true;
+    return parse_port(value.substr(close + 2), port);
+  }
+  size_t colon = value.rfind(':');
+  if (colon == std::string::npos) {
+    host.clear();
+    return parse_port(value, port);
+  }
+  host = value.substr(0, colon);
+  return !host.empty() && parse_port(value.substr(colon + 1), port);
+}
+
+bool normalize_listen_address(const std::string &value,
+                              std::string &canonical) {
+  if (is_unix_listen_address(value)) {
+    // sun_path needs room for the terminating NUL
+    size_t length = value.size() - UNIX_PREFIX_LENGTH;
+    if (length == 0 || length >= sizeof(((struct sockaddr_un *)0)->sun_path))
+      return false;
+    canonical = value;
+    return true;
+  }
+  std::string host;
+  int port;
+  bool ipv6;
+  if (!split_listen_value(value, host, port, ipv6))
+    return false;
+
+  struct sockaddr_storage storage;
+  memset(&storage, 0, sizeof(storage));
+  if (ipv6) {
+    struct sockaddr_in6 *address = (struct sockaddr_in6 *)&storage;
+    address->sin6_family = AF_INET6;
+    address->sin6_port = htons(port);
+    if (inet_pton(AF_INET6, host.c_str(), &address->sin6_addr) != 1)
+      return false;
+  } else {
+    struct sockaddr_in *address = (struct sockaddr_in *)&storage;
+    address->sin_family = AF_INET;
+    address->sin_port = htons(port);
+    if (host.empty() || host == "*")
+      address->sin_addr.s_addr = htonl(INADDR_ANY);
+    else if (inet_pton(AF_INET, host.c_str(), &address->sin_addr) != 1)
+      return false;
+  }
+  canonical = format_socket_address((struct sockaddr *)&storage);
+  return !canonical.empty();
+}
+
+bool resolve_listen_address(const std::string &canonical,
+                            struct sockaddr_storage &address,
+                            socklen_t &length) {
+  memset(&address, 0, sizeof(address));
+  if (is_unix_listen_address(canonical)) {
+    struct sockaddr_un *un = (struct sockaddr_un *)&address;
+    std::string path = unix_socket_path(canonical);
+    if (path.empty() || path.size() >= sizeof(un->sun_path))
+      return false;
+    un->sun_family = AF_UNIX;
+    memcpy(un->sun_path, path.c_str(), path.size() + 1);
+    length = sizeof(*un);
+    return true;
+  }
+  std::string host;
+  int port;
+  bool ipv6;
+  if (!split_listen_value(canonical, host, port, ipv6))
+    return false;
+  if (ipv6) {
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&address;
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port = htons(port);
+    length = sizeof(*in6);
+    return inet_pton(AF_INET6, host.c_str(), &in6->sin6_addr) == 1;
+  }
+  struct sockaddr_in *in = (struct sockaddr_in *)&address;
+  in->sin_family = AF_INET;
+  in->sin_port = htons(port);
+  length = sizeof(*in);
+  return inet_pton(AF_INET, host.c_str(), &in->sin_addr) == 1;
+}
+
+std::string format_socket_address(const struct sockaddr *address) {
+  char text[INET6_ADDRSTRLEN];
+  if (address->sa_family == AF_INET) {
+    const struct sockaddr_in *in = (const struct sockaddr_in *)address;
+    if (!inet_ntop(AF_INET, &in->sin_addr, text, sizeof(text)))
+      return std::string();
+    return std::string(text) + ":" + std::to_string(ntohs(in->sin_port));
+  }
+  if (address->sa_family == AF_INET6) {
+    const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)address;
+    if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr)) {
+      if (!inet_ntop(AF_INET, &in6->sin6_addr.s6_addr[12], text,
+                     sizeof(text)))
+        return std::string();
+      return std::string(text) + ":" + std::to_string(ntohs(in6->sin6_port));
+    }
+    if (!inet_ntop(AF_INET6, &in6->sin6_addr, text, sizeof(text)))
+      return std::string();
+    return "[" + std::string(text) + "]:" +
+           std::to_string(ntohs(in6->sin6_port));
+  }
+  if (address->sa_family == AF_UNIX) {
+    const struct sockaddr_un *un = (const struct sockaddr_un *)address;
+    return UNIX_PREFIX + std::string(un->sun_path, strnlen(un->sun_path,
+                                                           sizeof(un->sun_path)));
+  }
+  return std::string();
+}
+
+std::string format_socket_host(const struct sockaddr *address) {
+  char text[INET6_ADDRSTRLEN];
+  if (address->sa_family == AF_INET) {
+    const struct sockaddr_in *in = (const struct sockaddr_in *)address;
+    if (inet_ntop(AF_INET, &in->sin_addr, text, sizeof(text)))
+      return text;
+  } else if (address->sa_family == AF_INET6) {
+    const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)address;
+    if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr)) {
+      if (inet_ntop(AF_INET, &in6->sin6_addr.s6_addr[12], text, sizeof(text)))
+        return text;
+    } else if (inet_ntop(AF_INET6, &in6->sin6_addr, text, sizeof(text))) {
+      return text;
+    }
+  } else if (address->sa_family == AF_UNIX) {
+    return UNIX_PREFIX;
+  }
+  return std::string();
+}
+
+int socket_address_port(const struct sockaddr *address) {
+  if (address->sa_family == AF_INET)
+    return ntohs(((const struct sockaddr_in *)address)->sin_port);
+  if (address->sa_family == AF_INET6)
+    return ntohs(((const struct sockaddr_in6 *)address)->sin6_port);
+  return -1;
+}
+
+bool is_ipv6_listen_address(const std::string &canonical) {
+  return !canonical.empty() && canonical[0] == '[';
+}
+
+bool is_unix_listen_address(const std::string &canonical) {
+  return canonical.compare(0, UNIX_PREFIX_LENGTH, UNIX_PREFIX) == 0;
+}
+
+int listen_address_port(const std::string &canonical) {
+  if (is_unix_listen_address(canonical))
+    return -1;
+  size_t colon = canonical.rfind(':');
+  if (colon == std::string::npos)
+    return -1;
+  return std::atoi(canonical.c_str() + colon + 1);
+}
+
+std::string unix_socket_path(const std::string &canonical) {
+  return canonical.substr(UNIX_PREFIX_LENGTH);
+}
+
+std::string wildcard_listen_address(const std::string &canonical) {
+  if (is_unix_listen_address(canonical))
+    return canonical;
+  std::string port = std::to_string(listen_address_port(canonical));
+  return is_ipv6_listen_address(canonical) ? "[::]:" + port
+                                           : "0.0.0.0:" + port;
+}
@@ -11,16 +11,23 @@
 /* ************************************************************************** */
 
 #include "../../includes/networking/socket_manager.hpp"
+#include "../../includes/networking/socket_address.hpp"
+#include <algorithm>
 #include <cerrno>
+#include <cstdlib>
 #include <cstring>
-#include <set>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <sys/stat.h>
+
+const char *const SocketManager::LISTENERS_ENV = "WEBSERV_LISTENERS";
 
 SocketManager::SocketManager() : initialized(false) {}
 
 SocketManager::~SocketManager() { close_all_sockets(); }
 
 bool SocketManager::initialize_sockets(
-    const std::vector<ServerConfig> &servers) {
+    const std::map<std::string, ListenOptions> &listeners) {
   if (initialized) {
     std::cerr << "Sockets already initialized" << std::endl;
     return false;
@@ -28,30 +35,16 @@ bool SocketManager::initialize_sockets(
 
   bool all_success = true;
 
-  std::set<int> opened_ports;
-  for (std::vector<ServerConfig>::const_iterator it = servers.begin();
-       it != servers.end(); ++it) {
-    int port = it->listen_port;
-    if (opened_ports.count(port) == 0) {
-      if (!setup_server_socket(*it)) {
-        std::cerr << "Failed to setup socket for server on port " << port
-                  << std::endl;
-        all_success = false;
-        continue;
-      }
-      opened_ports.insert(port);
-      int fd = server_sockets.back();
-      port_to_socket_fd[port] = fd;
-    }
-    // Find socket fd for this port and append server config to its list
-    int fd_for_port = port_to_socket_fd[port];
-    socket_to_server_list[fd_for_port].push_back(*it);
-    // Also set base config for fd if not set
-    if (socket_to_config.find(fd_for_port) == socket_to_config.end()) {
-      socket_to_config[fd_for_port] = *it;
-    }
+  for (std::map<std::string, ListenOptions>::const_iterator it =
+           listeners.begin();
+       it != listeners.end(); ++it) {
+    if (!open_listener(it->first, it->second))
+      all_success = false;
   }
 
+  // Inherited sockets for addresses the new config no longer has
+  close_inherited_sockets();
+
   if (all_success && !server_sockets.empty()) {
     initialized = true;
     std::cout << "Successfully initialized " << server_sockets.size()
@@ -61,36 +54,147 @@ bool SocketManager::initialize_sockets(
   return all_success;
 }
 
-const std::vector<int> &SocketManager::get_server_sockets() const {
-  return server_sockets;
+bool SocketManager::open_listener(const std::string &address,
+                                  const ListenOptions &options) {
+  if (address_to_socket_fd.count(address))
+    return true;
+  std::map<std::string, int>::iterator inherited =
+      inherited_sockets.find(address);
+  if (inherited != inherited_sockets.end()) {
+    int fd = inherited->second;
+    inherited_sockets.erase(inherited);
+    // listen() again takes the backlog of this configuration
+    listen_socket(fd, options.backlog);
+    apply_listen_options(fd, address, options, NULL);
+    server_sockets.push_back(fd);
+    address_to_socket_fd[address] = fd;
+    socket_fd_to_address[fd] = address;
+    address_options[address] = options;
+    std::cout << "Adopted inherited listener on " << address << " (fd: " << fd
+              << ")" << std::endl;
+    return true;
+  }
+  if (!setup_server_socket(address, options)) {
+    std::cerr << "Failed to setup socket for server on " << address
+              << std::endl;
+    return false;
+  }
+  int fd = server_sockets.back();
+  address_to_socket_fd[address] = fd;
+  socket_fd_to_address[fd] = address;
+  address_options[address] = options;
+  return true;
 }
 
-const ServerConfig *SocketManager::get_config_for_socket(int socket_fd) const {
-  std::map<int, ServerConfig>::const_iterator it =
-      socket_to_config.find(socket_fd);
-  if (it != socket_to_config.end()) {
-    return &(it->second);
+void SocketManager::update_listener(const std::string &address,
+                                    const ListenOptions &options) {
+  std::map<std::string, int>::iterator it = address_to_socket_fd.find(address);
+  if (it == address_to_socket_fd.end())
+    return;
+  ListenOptions &current = address_options[address];
+  if (current.backlog != options.backlog &&
+      listen_socket(it->second, options.backlog))
+    std::cout << "Listen backlog on " << address << " is now "
+              << options.backlog << std::endl;
+  if (current.reuseport != options.reuseport ||
+      current.ipv6only != options.ipv6only)
+    std::cerr << "Warning: reuseport and ipv6only on " << address
+              << " only change when the listener is reopened" << std::endl;
+  apply_listen_options(it->second, address, options, &current);
+  current = options;
+}
+
+void SocketManager::close_listener(const std::string &address) {
+  std::map<std::string, int>::iterator it = address_to_socket_fd.find(address);
+  if (it == address_to_socket_fd.end())
+    return;
+  int fd = it->second;
+  close(fd);
+  if (is_unix_listen_address(address))
+    unlink(unix_socket_path(address).c_str());
+  server_sockets.erase(
+      std::find(server_sockets.begin(), server_sockets.end(), fd));
+  socket_fd_to_address.erase(fd);
+  address_options.erase(address);
+  address_to_socket_fd.erase(it);
+  std::cout << "Closed listener on " << address << " (fd: " << fd << ")"
+            << std::endl;
+}
+
+std::vector<std::string> SocketManager::get_addresses() const {
+  std::vector<std::string> addresses;
+  for (std::map<std::string, int>::const_iterator it =
+           address_to_socket_fd.begin();
+       it != address_to_socket_fd.end(); ++it)
+    addresses.push_back(it->first);
+  return addresses;
+}
+
+void SocketManager::adopt_inherited_sockets() {
+  const char *value = getenv(LISTENERS_ENV);
+  if (!value)
+    return;
+  std::istringstream entries(value);
+  std::string entry;
+  while (std::getline(entries, entry, ';')) {
+    // "address:fd"; older binaries pass a bare port as the address
+    size_t colon = entry.rfind(':');
+    std::string address;
+    if (colon == std::string::npos ||
+        !normalize_listen_address(entry.substr(0, colon), address))
+      continue;
+    int fd = atoi(entry.substr(colon + 1).c_str());
+    if (fd <= STDERR_FILENO || !is_listener_for_address(fd, address)) {
+      std::cerr << "Ignoring inherited socket " << entry << std::endl;
+      continue;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    set_non_blocking(fd);
+    inherited_sockets[address] = fd;
   }
-  return NULL;
+  // Not for CGI scripts, nor for a later upgrade of this process
+  unsetenv(LISTENERS_ENV);
 }
 
-const std::vector<ServerConfig> *
-SocketManager::get_servers_for_socket(int socket_fd) const {
-  std::map<int, std::vector<ServerConfig>>::const_iterator it =
-      socket_to_server_list.find(socket_fd);
-  if (it != socket_to_server_list.end()) {
-    return &(it->second);
+std::string SocketManager::describe_listeners() const {
+  std::ostringstream out;
+  for (std::map<std::string, int>::const_iterator it =
+           address_to_socket_fd.begin();
+       it != address_to_socket_fd.end(); ++it) {
+    if (it != address_to_socket_fd.begin())
+      out << ';';
+    out << it->first << ':' << it->second;
   }
-  return NULL;
+  return out.str();
+}
+
+void SocketManager::set_inheritable(bool inheritable) {
+  for (std::vector<int>::iterator it = server_sockets.begin();
+       it != server_sockets.end(); ++it)
+    fcntl(*it, F_SETFD, inheritable ? 0 : FD_CLOEXEC);
 }
 
-int SocketManager::get_socket_fd_for_port(int port) const {
-  std::map<int, int>::const_iterator it = port_to_socket_fd.find(port);
-  if (it != port_to_socket_fd.end())
+const std::vector<int> &SocketManager::get_server_sockets() const {
+  return server_sockets;
+}
+
+int SocketManager::get_socket_fd_for_address(
+    const std::string &address) const {
+  std::map<std::string, int>::const_iterator it =
+      address_to_socket_fd.find(address);
+  if (it != address_to_socket_fd.end())
     return it->second;
   return -1;
 }
 
+std::string SocketManager::get_address_for_socket(int socket_fd) const {
+  std::map<int, std::string>::const_iterator it =
+      socket_fd_to_address.find(socket_fd);
+  if (it != socket_fd_to_address.end())
+    return it->second;
+  return std::string();
+}
+
 void SocketManager::close_all_sockets() {
   for (std::vector<int>::iterator it = server_sockets.begin();
        it != server_sockets.end(); ++it) {
@@ -99,15 +203,54 @@ void SocketManager::close_all_sockets() {
     }
   }
   server_sockets.clear();
-  socket_to_config.clear();
+  address_to_socket_fd.clear();
+  socket_fd_to_address.clear();
+  address_options.clear();
+  close_inherited_sockets();
   initialized = false;
 }
 
+bool SocketManager::is_listener_for_address(
+    int socket_fd, const std::string &address) const {
+  struct stat st;
+  if (fstat(socket_fd, &st) < 0 || !S_ISSOCK(st.st_mode))
+    return false;
+  int listening = 0;
+  socklen_t length = sizeof(listening);
+  if (getsockopt(socket_fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) <
+          0 ||
+      !listening)
+    return false;
+  struct sockaddr_storage bound;
+  length = sizeof(bound);
+  if (getsockname(socket_fd, (struct sockaddr *)&bound, &length) < 0)
+    return false;
+  return format_socket_address((struct sockaddr *)&bound) == address;
+}
+
+void SocketManager::close_inherited_sockets() {
+  for (std::map<std::string, int>::iterator it = inherited_sockets.begin();
+       it != inherited_sockets.end(); ++it) {
+    std::cout << "Closing inherited listener on " << it->first
+              << " (fd: " << it->second << ")" << std::endl;
+    close(it->second);
+  }
+  inherited_sockets.clear();
+}
+
 bool SocketManager::is_initialized() const { return initialized; }
 
-bool SocketManager::setup_server_socket(const ServerConfig &server) {
+bool SocketManager::setup_server_socket(const std::string &address,
+                                        const ListenOptions &options) {
+  struct sockaddr_storage server_addr;
+  socklen_t server_addr_len;
+  if (!resolve_listen_address(address, server_addr, server_addr_len)) {
+    std::cerr << "Invalid listen address " << address << std::endl;
+    return false;
+  }
+
   // Create socket
-  int socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int socket_fd = socket(server_addr.ss_family, SOCK_STREAM, 0);
   if (socket_fd < 0) {
     std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
     return false;
@@ -121,33 +264,187 @@ bool SocketManager::setup_server_socket(const ServerConfig &server) {
     return false;
   }
 
-  // Set non-blocking mode
-  if (!set_non_blocking(socket_fd)) {
+  if (options.reuseport &&
+      setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+    std::cerr << "Failed to set SO_REUSEPORT: " << strerror(errno) << std::endl;
+    close(socket_fd);
+    return false;
+  }
+
+  // Left to the system default, an IPv6 wildcard would also take the IPv4
+  // clients, and clash with a listener on "0.0.0.0" of the same port
+  int v6only = options.ipv6only ? 1 : 0;
+  if (server_addr.ss_family == AF_INET6 &&
+      setsockopt(socket_fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only,
+                 sizeof(v6only)) < 0) {
+    std::cerr << "Failed to set IPV6_V6ONLY: " << strerror(errno) << std::endl;
+    close(socket_fd);
+    return false;
+  }
+
+  // Set non-blocking mode; CGI children must not inherit the listener
+  if (!set_non_blocking(socket_fd) ||
+      fcntl(socket_fd, F_SETFD, FD_CLOEXEC) < 0) {
+    close(socket_fd);
+    return false;
+  }
+
+  // A socket file left behind by a process that is gone would fail bind()
+  if (server_addr.ss_family == AF_UNIX && !remove_stale_socket_file(address)) {
     close(socket_fd);
     return false;
   }
 
   // Bind socket
-  if (!bind_socket(socket_fd, server.listen_port)) {
+  if (!bind_socket(socket_fd, address, server_addr, server_addr_len)) {
     close(socket_fd);
     return false;
   }
+  // bind() created the file under the umask
+  if (server_addr.ss_family == AF_UNIX &&
+      !set_socket_file_mode(address, options.mode)) {
+    close(socket_fd);
+    unlink(unix_socket_path(address).c_str());
+    return false;
+  }
 
   // Start listening
-  if (!listen_socket(socket_fd)) {
+  if (!listen_socket(socket_fd, options.backlog)) {
     close(socket_fd);
     return false;
   }
+  apply_listen_options(socket_fd, address, options, NULL);
 
   // Store socket
   server_sockets.push_back(socket_fd);
 
-  std::cout << "Server socket created and listening on port "
-            << server.listen_port << " (fd: " << socket_fd << ")" << std::endl;
+  std::cout << "Server socket created and listening on " << address
+            << " (fd: " << socket_fd << ")" << std::endl;
 
   return true;
 }
 
+// TCP and buffer options that can change on a listening socket. Accepted
+// sockets inherit them. Options equal to previous are left alone; a failed
+// option is reported and the listener keeps working without it.
+void SocketManager::apply_listen_options(int socket_fd,
+                                         const std::string &address,
+                                         const ListenOptions &options,
+                                         const ListenOptions *previous) {
+  if (is_unix_listen_address(address)) {
+    if (previous && previous->mode != options.mode)
+      set_socket_file_mode(address, options.mode);
+  } else {
+    apply_tcp_options(socket_fd, address, options, previous);
+  }
+  if (options.rcvbuf > 0 && (!previous || previous->rcvbuf != options.rcvbuf) &&
+      setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &options.rcvbuf,
+                 sizeof(options.rcvbuf)) < 0)
+    std::cerr << "Failed to set SO_RCVBUF on " << address << ": "
+              << strerror(errno) << std::endl;
+  if (options.sndbuf > 0 && (!previous || previous->sndbuf != options.sndbuf) &&
+      setsockopt(socket_fd, SOL_SOCKET, SO_SNDBUF, &options.sndbuf,
+                 sizeof(options.sndbuf)) < 0)
+    std::cerr << "Failed to set SO_SNDBUF on " << address << ": "
+              << strerror(errno) << std::endl;
+  log_listen_options(socket_fd, address, options);
+}
+
+void SocketManager::apply_tcp_options(int socket_fd,
+                                      const std::string &address,
+                                      const ListenOptions &options,
+                                      const ListenOptions *previous) {
+  if (!previous || previous->deferred != options.deferred) {
+    int seconds = options.deferred ? DEFER_ACCEPT_SECONDS : 0;
+    if (setsockopt(socket_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds,
+                   sizeof(seconds)) < 0)
+      std::cerr << "Failed to set TCP_DEFER_ACCEPT on " << address << ": "
+                << strerror(errno) << std::endl;
+  }
+  if ((!previous && options.fastopen > 0) ||
+      (previous && previous->fastopen != options.fastopen)) {
+    if (setsockopt(socket_fd, IPPROTO_TCP, TCP_FASTOPEN, &options.fastopen,
+                   sizeof(options.fastopen)) < 0)
+      std::cerr << "Failed to set TCP_FASTOPEN on " << address << ": "
+                << strerror(errno) << std::endl;
+  }
+}
+
+// Unix socket files: permissions, and clean-up of files nobody listens on
+bool SocketManager::set_socket_file_mode(const std::string &address,
+                                         int mode) {
+  std::string path = unix_socket_path(address);
+  if (chmod(path.c_str(), mode) < 0) {
+    std::cerr << "Failed to set the mode of " << path << ": "
+              << strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// An existing socket file is only removed if connecting to it is refused:
+// a running server keeps its file, and other files are never touched
+bool SocketManager::remove_stale_socket_file(const std::string &address) {
+  std::string path = unix_socket_path(address);
+  struct stat st;
+  if (lstat(path.c_str(), &st) < 0)
+    return true;
+  if (!S_ISSOCK(st.st_mode)) {
+    std::cerr << "Cannot listen on " << address
+              << ": the path exists and is not a socket" << std::endl;
+    return false;
+  }
+  struct sockaddr_storage server_addr;
+  socklen_t server_addr_len;
+  resolve_listen_address(address, server_addr, server_addr_len);
+  int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (probe < 0)
+    return false;
+  bool in_use = connect(probe, (struct sockaddr *)&server_addr,
+                        server_addr_len) == 0 ||
+                errno != ECONNREFUSED;
+  close(probe);
+  if (in_use) {
+    std::cerr << "Cannot listen on " << address
+              << ": another process is listening on it" << std::endl;
+    return false;
+  }
+  std::cout << "Removing stale socket file " << path << std::endl;
+  return unlink(path.c_str()) == 0 || errno == ENOENT;
+}
+
+void SocketManager::remove_socket_files() const {
+  for (std::map<std::string, int>::const_iterator it =
+           address_to_socket_fd.begin();
+       it != address_to_socket_fd.end(); ++it) {
+    if (is_unix_listen_address(it->first))
+      unlink(unix_socket_path(it->first).c_str());
+  }
+}
+
+// The options as the kernel applied them (buffer sizes come back doubled)
+void SocketManager::log_listen_options(int socket_fd,
+                                       const std::string &address,
+                                       const ListenOptions &options) const {
+  int rcvbuf = 0, sndbuf = 0;
+  socklen_t length = sizeof(rcvbuf);
+  getsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &length);
+  length = sizeof(sndbuf);
+  getsockopt(socket_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &length);
+  std::cout << "Listener on " << address << ": backlog=" << options.backlog;
+  if (address[0] == '[')
+    std::cout << " ipv6only=" << (options.ipv6only ? "on" : "off");
+  if (options.reuseport)
+    std::cout << " reuseport";
+  if (options.deferred)
+    std::cout << " deferred";
+  if (options.fastopen > 0)
+    std::cout << " fastopen=" << options.fastopen;
+  if (is_unix_listen_address(address))
+    std::cout << " mode=0" << std::oct << options.mode << std::dec;
+  std::cout << " rcvbuf=" << rcvbuf << " sndbuf=" << sndbuf << std::endl;
+}
+
 bool SocketManager::set_non_blocking(int socket_fd) {
   int flags = fcntl(socket_fd, F_GETFL, 0);
   if (flags < 0) {
@@ -164,16 +461,12 @@ bool SocketManager::set_non_blocking(int socket_fd) {
   return true;
 }
 
-bool SocketManager::bind_socket(int socket_fd, int port) {
-  struct sockaddr_in server_addr;
-  memset(&server_addr, 0, sizeof(server_addr));
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_addr.s_addr = INADDR_ANY;
-  server_addr.sin_port = htons(port);
-
-  if (bind(socket_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) <
+bool SocketManager::bind_socket(int socket_fd, const std::string &address,
+                                const struct sockaddr_storage &server_addr,
+                                socklen_t server_addr_len) {
+  if (bind(socket_fd, (const struct sockaddr *)&server_addr, server_addr_len) <
       0) {
-    std::cerr << "Failed to bind socket to port " << port << ": "
+    std::cerr << "Failed to bind socket to " << address << ": "
               << strerror(errno) << std::endl;
     return false;
   }
@@ -181,8 +474,8 @@ bool SocketManager::bind_socket(int socket_fd, int port) {
   return true;
 }
 
-bool SocketManager::listen_socket(int socket_fd) {
-  if (listen(socket_fd, SOMAXCONN) < 0) {
+bool SocketManager::listen_socket(int socket_fd, int backlog) {
+  if (listen(socket_fd, backlog) < 0) {
     std::cerr << "Failed to listen on socket: " << strerror(errno) << std::endl;
     return false;
   }
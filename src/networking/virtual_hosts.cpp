@@ -0,0 +1,83 @@
+#include "../../includes/networking/virtual_hosts.hpp"
+#include <cctype>
+#include <iostream>
+
+VirtualHostTable::VirtualHostTable() : default_server(NULL) {}
+
+VirtualHostTable::VirtualHostTable(
+    const std::vector<const ServerConfig *> &servers)
+    : default_server(servers.empty() ? NULL : servers[0]) {
+  for (size_t i = 0; i < servers.size(); ++i) {
+    for (size_t j = 0; j < servers[i]->server_names.size(); ++j)
+      add_name(servers[i]->server_names[j], servers[i]);
+  }
+}
+
+VirtualHostTable::~VirtualHostTable() {}
+
+// Names are lowercased and checked by the config parser
+void VirtualHostTable::add_name(const std::string &name,
+                                const ServerConfig *server) {
+  std::string_view view(name);
+  if (view.compare(0, 2, "*.") == 0) {
+    add_unique(suffixes, view.substr(1), server);
+  } else if (!view.empty() && view[0] == '.') {
+    // ".example.com" is example.com and all of its subdomains
+    add_unique(exact, view.substr(1), server);
+    add_unique(suffixes, view, server);
+  } else if (view.size() >= 2 && view.compare(view.size() - 2, 2, ".*") == 0) {
+    add_unique(prefixes, view.substr(0, view.size() - 1), server);
+  } else {
+    add_unique(exact, view, server);
+  }
+}
+
+void VirtualHostTable::add_unique(NameMap &map, std::string_view key,
+                                  const ServerConfig *server) {
+  if (!map.insert(std::make_pair(key, server)).second)
+    std::cerr << "Warning: conflicting server name \"" << key
+              << "\", ignored" << std::endl;
+}
+
+const ServerConfig *VirtualHostTable::resolve(std::string_view host) const {
+  // Drop the port ("[v6]:port" keeps its brackets) and a trailing dot
+  size_t colon = host.rfind(':');
+  size_t bracket = host.rfind(']');
+  if (colon != std::string_view::npos &&
+      (bracket == std::string_view::npos ? host.find(':') == colon
+                                         : colon > bracket))
+    host = host.substr(0, colon);
+  if (!host.empty() && host[host.size() - 1] == '.')
+    host.remove_suffix(1);
+  if (host.empty() || host.size() > MAX_HOST_LENGTH)
+    return default_server;
+
+  char buffer[MAX_HOST_LENGTH];
+  for (size_t i = 0; i < host.size(); ++i)
+    buffer[i] = tolower(static_cast<unsigned char>(host[i]));
+  std::string_view name(buffer, host.size());
+
+  NameMap::const_iterator it = exact.find(name);
+  if (it != exact.end())
+    return it->second;
+
+  // Longest suffix first: try from the leftmost dot
+  if (!suffixes.empty()) {
+    for (size_t dot = name.find('.'); dot != std::string_view::npos;
+         dot = name.find('.', dot + 1)) {
+      it = suffixes.find(name.substr(dot));
+      if (it != suffixes.end())
+        return it->second;
+    }
+  }
+  // Longest prefix first: try up to the rightmost dot
+  if (!prefixes.empty()) {
+    for (size_t dot = name.rfind('.'); dot != std::string_view::npos;
+         dot = dot == 0 ? std::string_view::npos : name.rfind('.', dot - 1)) {
+      it = prefixes.find(name.substr(0, dot + 1));
+      if (it != prefixes.end())
+        return it->second;
+    }
+  }
+  return default_server;
+}
@@ -1,11 +1,16 @@
 #include "../../includes/parser.hpp"
+#include "../../includes/networking/socket_address.hpp"
 #include "../../includes/structs/location_config.hpp"
 #include "../../includes/structs/main_config.hpp"
 #include "../../includes/structs/server_config.hpp"
 #include "../../includes/tokenizer.hpp"
+#include <cctype>
+#include <cerrno>
+#include <climits>
 #include <cstdlib>
 #include <set>
 #include <stdexcept>
+#include <sys/socket.h>
 
 namespace {
 void expect(TokenStream &ts, TokenType type, const std::string &msg) {
@@ -24,25 +29,101 @@ bool isFalse(const std::string &val) {
 
 size_t parseSizeWithSuffix(const std::string &str) {
   char *end;
+  errno = 0;
   long long val = std::strtoll(str.c_str(), &end, 10);
   if (end == str.c_str())
     throw std::runtime_error("Parse error: invalid size value '" + str + "'");
+  long long unit = 1;
   if (*end == 'K' || *end == 'k')
-    val *= 1024LL;
+    unit = 1024LL;
   else if (*end == 'M' || *end == 'm')
-    val *= 1024LL * 1024LL;
+    unit = 1024LL * 1024LL;
   else if (*end == 'G' || *end == 'g')
-    val *= 1024LL * 1024LL * 1024LL;
+    unit = 1024LL * 1024LL * 1024LL;
   else if (*end != '\0')
     throw std::runtime_error("Parse error: invalid size suffix in '" + str +
                              "'");
   if (val < 0)
     throw std::runtime_error("Parse error: negative size value");
-  return static_cast<size_t>(val);
+  if (errno == ERANGE || val > LLONG_MAX / unit)
+    throw std::runtime_error("Parse error: size value '" + str +
+                             "' is too large");
+  return static_cast<size_t>(val * unit);
+}
+
+// Time values: plain seconds, or with an 's'/'m'/'h' suffix, up to
+// INT_MAX seconds so that adding one to the current time cannot overflow
+time_t parseSecondsWithSuffix(const std::string &str) {
+  char *end;
+  errno = 0;
+  long long val = std::strtoll(str.c_str(), &end, 10);
+  if (end == str.c_str())
+    throw std::runtime_error("Parse error: invalid time value '" + str + "'");
+  std::string suffix(end);
+  long long unit = 1;
+  if (suffix == "m")
+    unit = 60LL;
+  else if (suffix == "h")
+    unit = 3600LL;
+  else if (!suffix.empty() && suffix != "s")
+    throw std::runtime_error("Parse error: invalid time suffix in '" + str +
+                             "'");
+  if (val < 0)
+    throw std::runtime_error("Parse error: negative time value");
+  if (errno == ERANGE || val > INT_MAX / unit)
+    throw std::runtime_error("Parse error: time value '" + str +
+                             "' is too large");
+  return static_cast<time_t>(val * unit);
+}
+
+// Positive whole numbers within [min, max] (counts, backlog)
+long long parseCount(const std::string &str, long long min, long long max,
+                     const std::string &directive) {
+  if (str.empty() || str.size() > 12 ||
+      str.find_first_not_of("0123456789") != std::string::npos)
+    throw std::runtime_error("Parse error: invalid " + directive + " '" + str +
+                             "'");
+  long long val = std::strtoll(str.c_str(), NULL, 10);
+  if (val < min || val > max)
+    throw std::runtime_error("Parse error: " + directive + " must be between " +
+                             std::to_string(min) + " and " +
+                             std::to_string(max));
+  return val;
+}
+
+// Socket buffer sizes (SO_RCVBUF/SO_SNDBUF take an int)
+int parseSocketBufferSize(const std::string &str,
+                          const std::string &directive) {
+  size_t size = parseSizeWithSuffix(str);
+  if (size < 1 || size > static_cast<size_t>(INT_MAX))
+    throw std::runtime_error("Parse error: invalid " + directive + " '" + str +
+                             "'");
+  return static_cast<int>(size);
+}
+
+// Timeouts that must leave a client at least a second
+time_t parsePositiveSeconds(const std::string &str,
+                            const std::string &directive) {
+  time_t val = parseSecondsWithSuffix(str);
+  if (val < 1)
+    throw std::runtime_error("Parse error: " + directive +
+                             " must be at least 1 second");
+  return val;
 }
 
 // Value validation helpers
-bool isValidPort(int port) { return port >= 1 && port <= 65535; }
+// A wildcard is only allowed as a whole leading or trailing label
+// ("*.example.com", "www.*"); ".example.com" is also accepted
+bool isValidServerName(const std::string &name) {
+  size_t star = name.find('*');
+  if (star == std::string::npos)
+    return !name.empty() && name != ".";
+  if (name.find('*', star + 1) != std::string::npos || name.size() < 3)
+    return false;
+  if (star == 0)
+    return name[1] == '.';
+  return star == name.size() - 1 && name[star - 1] == '.';
+}
 
 bool isValidHttpMethod(const std::string &method) {
   static const std::string valid_methods[] = {
@@ -77,6 +158,10 @@ LocationConfig parseLocation(TokenStream &ts) {
   // Defaults for optional fields
   loc.return_code = 0;
   loc.return_url.clear();
+  loc.gzip_static = false;
+  loc.autoindex_json = false;
+  loc.autoindex_page_size = 0;
+  loc.cgi_timeout = 30;
   bool seen_root = false, seen_autoindex = false, seen_upload_store = false,
        seen_cgi_pass = false;
   std::set<std::string> seen_directives;
@@ -125,6 +210,49 @@ LocationConfig parseLocation(TokenStream &ts) {
               "Parse error: invalid value for autoindex: '" + val + "'");
         expect(ts, TOKEN_SEMICOLON, "; after autoindex");
         ts.next();
+      } else if (directive == "gzip_static") {
+        if (seen_directives.count("gzip_static"))
+          throw std::runtime_error(
+              "Duplicate 'gzip_static' directive in location block");
+        seen_directives.insert("gzip_static");
+        expect(ts, TOKEN_WORD, "gzip_static value");
+        std::string val = ts.next().value;
+        if (isTrue(val))
+          loc.gzip_static = true;
+        else if (isFalse(val))
+          loc.gzip_static = false;
+        else
+          throw std::runtime_error(
+              "Parse error: invalid value for gzip_static: '" + val + "'");
+        expect(ts, TOKEN_SEMICOLON, "; after gzip_static");
+        ts.next();
+      } else if (directive == "autoindex_format") {
+        if (seen_directives.count("autoindex_format"))
+          throw std::runtime_error(
+              "Duplicate 'autoindex_format' directive in location block");
+        seen_directives.insert("autoindex_format");
+        expect(ts, TOKEN_WORD, "autoindex_format value");
+        std::string val = ts.next().value;
+        if (val == "html")
+          loc.autoindex_json = false;
+        else if (val == "json")
+          loc.autoindex_json = true;
+        else
+          throw std::runtime_error(
+              "Parse error: invalid value for autoindex_format: '" + val +
+              "' (must be html or json)");
+        expect(ts, TOKEN_SEMICOLON, "; after autoindex_format");
+        ts.next();
+      } else if (directive == "autoindex_page_size") {
+        if (seen_directives.count("autoindex_page_size"))
+          throw std::runtime_error(
+              "Duplicate 'autoindex_page_size' directive in location block");
+        seen_directives.insert("autoindex_page_size");
+        expect(ts, TOKEN_WORD, "autoindex_page_size value");
+        loc.autoindex_page_size = static_cast<size_t>(
+            parseCount(ts.next().value, 0, 1000000, directive));
+        expect(ts, TOKEN_SEMICOLON, "; after autoindex_page_size");
+        ts.next();
       } else if (directive == "allow_methods") {
         if (seen_directives.count("allow_methods"))
           throw std::runtime_error(
@@ -154,6 +282,15 @@ LocationConfig parseLocation(TokenStream &ts) {
         loc.cgi_pass = ts.next().value;
         expect(ts, TOKEN_SEMICOLON, "; after cgi_pass");
         ts.next();
+      } else if (directive == "cgi_timeout") {
+        if (seen_directives.count("cgi_timeout"))
+          throw std::runtime_error(
+              "Duplicate 'cgi_timeout' directive in location block");
+        seen_directives.insert("cgi_timeout");
+        expect(ts, TOKEN_WORD, "cgi_timeout value");
+        loc.cgi_timeout = parsePositiveSeconds(ts.next().value, "cgi_timeout");
+        expect(ts, TOKEN_SEMICOLON, "; after cgi_timeout");
+        ts.next();
       } else if (directive == "return") {
         // Syntax: return <3xx> <url>;
         expect(ts, TOKEN_WORD, "return status code");
@@ -190,6 +327,22 @@ ServerConfig parseServer(TokenStream &ts) {
        seen_client_max_body_size = false;
   std::set<std::string> seen_directives;
 
+  srv.listen_options.configured = false;
+  srv.listen_options.backlog = SOMAXCONN;
+  srv.listen_options.reuseport = false;
+  srv.listen_options.deferred = false;
+  srv.listen_options.fastopen = 0;
+  srv.listen_options.rcvbuf = 0;
+  srv.listen_options.sndbuf = 0;
+  srv.listen_options.ipv6only = true;
+  srv.listen_options.mode = 0666;
+  srv.keepalive_timeout = 75;
+  srv.keepalive_requests = 1000;
+  srv.gzip = false;
+  srv.gzip_comp_level = 1;
+  srv.gzip_min_length = 256;
+  srv.gzip_types.push_back("text/html");
+
   expect(ts, TOKEN_WORD, "'server'");
   ts.next(); // 'server'
   expect(ts, TOKEN_LBRACE, "'{' after server");
@@ -207,12 +360,60 @@ ServerConfig parseServer(TokenStream &ts) {
               "Duplicate 'listen' directive in server block");
         seen_listen = true;
         expect(ts, TOKEN_WORD, "listen value");
-        int port = std::atoi(ts.next().value.c_str());
-        if (!isValidPort(port)) {
-          throw std::runtime_error("Parse error: invalid port number '" +
-                                   ts.peek().value + "' (must be 1-65535)");
+        // listen 8080; listen 10.0.0.5:80; listen [::]:80; listen unix:/path;
+        std::string value = ts.next().value;
+        if (!normalize_listen_address(value, srv.listen_address))
+          throw std::runtime_error(
+              "Parse error: invalid listen address '" + value +
+              "' (expected port, address:port, [ipv6]:port or unix:path)");
+        bool unix_socket = is_unix_listen_address(srv.listen_address);
+        srv.listen_port = listen_address_port(srv.listen_address);
+        // Optional parameters: listen 8080 backlog=511 deferred;
+        while (ts.peek().type == TOKEN_WORD) {
+          std::string param = ts.next().value;
+          if (param.compare(0, 8, "backlog=") == 0) {
+            srv.listen_options.backlog = static_cast<int>(
+                parseCount(param.substr(8), 1, 65535, "listen backlog"));
+          } else if (param == "reuseport") {
+            srv.listen_options.reuseport = true;
+          } else if (param == "deferred") {
+            srv.listen_options.deferred = true;
+          } else if (param.compare(0, 9, "fastopen=") == 0) {
+            srv.listen_options.fastopen = static_cast<int>(
+                parseCount(param.substr(9), 1, 65535, "listen fastopen"));
+          } else if (param == "ipv6only=on" || param == "ipv6only=off") {
+            if (!is_ipv6_listen_address(srv.listen_address))
+              throw std::runtime_error(
+                  "Parse error: ipv6only only applies to IPv6 addresses");
+            srv.listen_options.ipv6only = (param == "ipv6only=on");
+          } else if (param.compare(0, 7, "rcvbuf=") == 0) {
+            srv.listen_options.rcvbuf =
+                parseSocketBufferSize(param.substr(7), "listen rcvbuf");
+          } else if (param.compare(0, 7, "sndbuf=") == 0) {
+            srv.listen_options.sndbuf =
+                parseSocketBufferSize(param.substr(7), "listen sndbuf");
+          } else if (param.compare(0, 5, "mode=") == 0) {
+            std::string mode = param.substr(5);
+            if (!unix_socket)
+              throw std::runtime_error(
+                  "Parse error: mode only applies to Unix sockets");
+            if (mode.empty() || mode.size() > 4 ||
+                mode.find_first_not_of("01234567") != std::string::npos)
+              throw std::runtime_error("Parse error: invalid listen mode '" +
+                                       mode + "' (octal, e.g. 0660)");
+            srv.listen_options.mode =
+                static_cast<int>(std::strtol(mode.c_str(), NULL, 8)) & 0777;
+          } else {
+            throw std::runtime_error("Parse error: unknown listen parameter '" +
+                                     param + "'");
+          }
+          srv.listen_options.configured = true;
         }
-        srv.listen_port = port;
+        if (unix_socket && (srv.listen_options.reuseport ||
+                            srv.listen_options.deferred ||
+                            srv.listen_options.fastopen > 0))
+          throw std::runtime_error("Parse error: reuseport, deferred and "
+                                   "fastopen do not apply to Unix sockets");
         expect(ts, TOKEN_SEMICOLON, "; after listen");
         ts.next();
       } else if (directive == "server_name") {
@@ -221,7 +422,16 @@ ServerConfig parseServer(TokenStream &ts) {
               "Duplicate 'server_name' directive in server block");
         seen_server_name = true;
         expect(ts, TOKEN_WORD, "server_name value");
-        srv.server_name = ts.next().value;
+        while (ts.peek().type == TOKEN_WORD) {
+          std::string name = ts.next().value;
+          for (size_t i = 0; i < name.size(); ++i)
+            name[i] = tolower(name[i]);
+          if (!isValidServerName(name))
+            throw std::runtime_error("Parse error: invalid server_name '" +
+                                     name + "'");
+          srv.server_names.push_back(name);
+        }
+        srv.server_name = srv.server_names[0];
         expect(ts, TOKEN_SEMICOLON, "; after server_name");
         ts.next();
       } else if (directive == "error_page") {
@@ -236,6 +446,74 @@ ServerConfig parseServer(TokenStream &ts) {
         srv.error_pages[code] = path;
         expect(ts, TOKEN_SEMICOLON, "; after error_page");
         ts.next();
+      } else if (directive == "keepalive_timeout") {
+        if (seen_directives.count("keepalive_timeout"))
+          throw std::runtime_error(
+              "Duplicate 'keepalive_timeout' directive in server block");
+        seen_directives.insert("keepalive_timeout");
+        expect(ts, TOKEN_WORD, "keepalive_timeout value");
+        srv.keepalive_timeout = parseSecondsWithSuffix(ts.next().value);
+        expect(ts, TOKEN_SEMICOLON, "; after keepalive_timeout");
+        ts.next();
+      } else if (directive == "keepalive_requests") {
+        if (seen_directives.count("keepalive_requests"))
+          throw std::runtime_error(
+              "Duplicate 'keepalive_requests' directive in server block");
+        seen_directives.insert("keepalive_requests");
+        expect(ts, TOKEN_WORD, "keepalive_requests value");
+        srv.keepalive_requests = static_cast<size_t>(
+            parseCount(ts.next().value, 1, 1000000000, directive));
+        expect(ts, TOKEN_SEMICOLON, "; after keepalive_requests");
+        ts.next();
+      } else if (directive == "gzip") {
+        if (seen_directives.count("gzip"))
+          throw std::runtime_error("Duplicate 'gzip' directive in server block");
+        seen_directives.insert("gzip");
+        expect(ts, TOKEN_WORD, "gzip value");
+        std::string val = ts.next().value;
+        if (isTrue(val))
+          srv.gzip = true;
+        else if (isFalse(val))
+          srv.gzip = false;
+        else
+          throw std::runtime_error("Parse error: invalid value for gzip: '" +
+                                   val + "'");
+        expect(ts, TOKEN_SEMICOLON, "; after gzip");
+        ts.next();
+      } else if (directive == "gzip_comp_level") {
+        if (seen_directives.count("gzip_comp_level"))
+          throw std::runtime_error(
+              "Duplicate 'gzip_comp_level' directive in server block");
+        seen_directives.insert("gzip_comp_level");
+        expect(ts, TOKEN_WORD, "gzip_comp_level value");
+        srv.gzip_comp_level =
+            static_cast<int>(parseCount(ts.next().value, 1, 9, directive));
+        expect(ts, TOKEN_SEMICOLON, "; after gzip_comp_level");
+        ts.next();
+      } else if (directive == "gzip_min_length") {
+        if (seen_directives.count("gzip_min_length"))
+          throw std::runtime_error(
+              "Duplicate 'gzip_min_length' directive in server block");
+        seen_directives.insert("gzip_min_length");
+        expect(ts, TOKEN_WORD, "gzip_min_length value");
+        srv.gzip_min_length = parseSizeWithSuffix(ts.next().value);
+        expect(ts, TOKEN_SEMICOLON, "; after gzip_min_length");
+        ts.next();
+      } else if (directive == "gzip_types") {
+        if (seen_directives.count("gzip_types"))
+          throw std::runtime_error(
+              "Duplicate 'gzip_types' directive in server block");
+        seen_directives.insert("gzip_types");
+        // text/html is always included, as in nginx
+        while (ts.peek().type == TOKEN_WORD) {
+          std::string type = ts.next().value;
+          for (size_t i = 0; i < type.size(); ++i)
+            type[i] = tolower(type[i]);
+          if (type != "text/html")
+            srv.gzip_types.push_back(type);
+        }
+        expect(ts, TOKEN_SEMICOLON, "; after gzip_types");
+        ts.next();
       } else if (directive == "client_max_body_size") {
         if (seen_client_max_body_size)
           throw std::runtime_error(
@@ -263,15 +541,262 @@ ServerConfig parseServer(TokenStream &ts) {
         "Missing required 'listen' directive in server block");
   return srv;
 }
+// Top-level directives that apply to the whole process
+void parseMainDirective(TokenStream &ts, MainConfig &config,
+                        std::set<std::string> &seen_directives) {
+  std::string directive = ts.next().value;
+  if (seen_directives.count(directive))
+    throw std::runtime_error("Duplicate '" + directive +
+                             "' directive at top level");
+  seen_directives.insert(directive);
+  expect(ts, TOKEN_WORD, directive + " value");
+  std::string value = ts.next().value;
+  if (directive == "mmap_cache_size") {
+    config.mmap_cache_size = parseSizeWithSuffix(value);
+  } else if (directive == "mmap_min_size") {
+    config.mmap_min_size = parseSizeWithSuffix(value);
+  } else if (directive == "file_cache_valid") {
+    config.file_cache_valid = parseSecondsWithSuffix(value);
+  } else if (directive == "gzip_cache_size") {
+    config.gzip_cache_size = parseSizeWithSuffix(value);
+  } else if (directive == "shutdown_timeout") {
+    config.shutdown_timeout = parseSecondsWithSuffix(value);
+  } else if (directive == "worker_connections") {
+    config.worker_connections =
+        static_cast<size_t>(parseCount(value, 1, 1000000, directive));
+  } else if (directive == "worker_rlimit_nofile") {
+    config.worker_rlimit_nofile =
+        static_cast<size_t>(parseCount(value, 1, 16777216, directive));
+  } else if (directive == "tcp_nodelay") {
+    if (isTrue(value))
+      config.tcp_nodelay = true;
+    else if (isFalse(value))
+      config.tcp_nodelay = false;
+    else
+      throw std::runtime_error("Parse error: invalid value for tcp_nodelay: '" +
+                               value + "'");
+  } else if (directive == "client_header_buffer_size") {
+    config.client_header_buffer_size = parseSizeWithSuffix(value);
+    if (config.client_header_buffer_size < 1024 ||
+        config.client_header_buffer_size > 16 * 1024 * 1024)
+      throw std::runtime_error(
+          "Parse error: client_header_buffer_size must be between 1K and 16M");
+  } else if (directive == "client_header_timeout" ||
+             directive == "client_body_timeout" ||
+             directive == "send_timeout") {
+    time_t seconds = parsePositiveSeconds(value, directive);
+    if (directive == "client_header_timeout")
+      config.client_header_timeout = seconds;
+    else if (directive == "client_body_timeout")
+      config.client_body_timeout = seconds;
+    else
+      config.send_timeout = seconds;
+  } else if (directive == "default_type") {
+    if (value.find('/') == std::string::npos)
+      throw std::runtime_error("Parse error: invalid default_type '" + value +
+                               "'");
+    config.default_type = value;
+  } else {
+    throw std::runtime_error("Parse error: unknown top-level directive '" +
+                             directive + "'");
+  }
+  expect(ts, TOKEN_SEMICOLON, "; after " + directive);
+  ts.next();
+}
+
+// "zone=NAME:SIZE" of limit_conn_zone / limit_req_zone
+void parseLimitZoneParam(const std::string &param, LimitZoneConfig &zone,
+                         const std::string &directive) {
+  size_t colon = param.find(':');
+  if (param.compare(0, 5, "zone=") != 0 || colon == std::string::npos ||
+      colon == 5)
+    throw std::runtime_error("Parse error: " + directive +
+                             " needs zone=NAME:SIZE, got '" + param + "'");
+  zone.name = param.substr(5, colon - 5);
+  zone.size = parseSizeWithSuffix(param.substr(colon + 1));
+  if (zone.size < 4096 || zone.size > 1024LL * 1024 * 1024)
+    throw std::runtime_error("Parse error: " + directive +
+                             " size must be between 4K and 1G");
+}
+
+// "rate=10r/s" or "rate=30r/m", kept as requests per second x 1000
+size_t parseLimitRate(const std::string &param) {
+  if (param.compare(0, 5, "rate=") != 0 || param.size() < 9)
+    throw std::runtime_error("Parse error: limit_req_zone needs rate=Nr/s, "
+                             "got '" + param + "'");
+  std::string unit = param.substr(param.size() - 3);
+  if (unit != "r/s" && unit != "r/m")
+    throw std::runtime_error("Parse error: invalid limit_req_zone rate '" +
+                             param.substr(5) + "'");
+  long long requests = parseCount(param.substr(5, param.size() - 8), 1,
+                                  1000000, "limit_req_zone rate");
+  return static_cast<size_t>(unit == "r/s" ? requests * 1000
+                                           : requests * 1000 / 60);
+}
+
+// limit_conn_zone zone=NAME:SIZE;
+// limit_req_zone zone=NAME:SIZE rate=Nr/s;
+// limit_conn NAME N;
+// limit_req zone=NAME [burst=N] [nodelay];
+// limit_conn_status / limit_req_status CODE;
+// Zones are keyed by client address, so limits apply at top level only:
+// they are checked before a request is parsed and its server is known.
+void parseLimitDirective(TokenStream &ts, MainConfig &config,
+                         std::set<std::string> &seen_directives) {
+  std::string directive = ts.next().value;
+  std::vector<std::string> params;
+  while (ts.peek().type == TOKEN_WORD)
+    params.push_back(ts.next().value);
+  expect(ts, TOKEN_SEMICOLON, "; after " + directive);
+  ts.next();
+  if (params.empty())
+    throw std::runtime_error("Parse error: " + directive + " needs a value");
+
+  if (directive == "limit_conn_zone" || directive == "limit_req_zone") {
+    LimitZoneConfig zone;
+    bool request_zone = directive == "limit_req_zone";
+    if (params.size() != (request_zone ? 2u : 1u))
+      throw std::runtime_error("Parse error: invalid number of " + directive +
+                               " parameters");
+    parseLimitZoneParam(params[0], zone, directive);
+    zone.rate = request_zone ? parseLimitRate(params[1]) : 0;
+    for (size_t i = 0; i < config.limit_zones.size(); ++i)
+      if (config.limit_zones[i].name == zone.name)
+        throw std::runtime_error("Parse error: duplicate limit zone '" +
+                                 zone.name + "'");
+    config.limit_zones.push_back(zone);
+    return;
+  }
+
+  if (seen_directives.count(directive))
+    throw std::runtime_error("Duplicate '" + directive +
+                             "' directive at top level");
+  seen_directives.insert(directive);
+  if (directive == "limit_conn") {
+    if (params.size() != 2)
+      throw std::runtime_error("Parse error: limit_conn needs a zone and a "
+                               "number of connections");
+    config.limit_conn_zone = params[0];
+    config.limit_conn =
+        static_cast<size_t>(parseCount(params[1], 1, 65535, directive));
+  } else if (directive == "limit_req") {
+    if (params[0].compare(0, 5, "zone=") != 0 || params[0].size() == 5)
+      throw std::runtime_error("Parse error: limit_req needs zone=NAME");
+    config.limit_req_zone = params[0].substr(5);
+    for (size_t i = 1; i < params.size(); ++i) {
+      if (params[i].compare(0, 6, "burst=") == 0)
+        config.limit_req_burst = static_cast<size_t>(
+            parseCount(params[i].substr(6), 0, 100000, "limit_req burst"));
+      else if (params[i] != "nodelay") // Excess is never delayed anyway
+        throw std::runtime_error("Parse error: invalid limit_req parameter '" +
+                                 params[i] + "'");
+    }
+  } else if (directive == "limit_conn_status" ||
+             directive == "limit_req_status") {
+    if (params.size() != 1)
+      throw std::runtime_error("Parse error: " + directive +
+                               " takes one status code");
+    int status = static_cast<int>(parseCount(params[0], 400, 599, directive));
+    if (directive == "limit_conn_status")
+      config.limit_conn_status = status;
+    else
+      config.limit_req_status = status;
+  } else {
+    throw std::runtime_error("Parse error: unknown top-level directive '" +
+                             directive + "'");
+  }
+}
+
+// limit_conn / limit_req must name a zone of the matching kind
+void validateLimitZones(const MainConfig &config) {
+  bool conn_found = config.limit_conn_zone.empty();
+  bool req_found = config.limit_req_zone.empty();
+  for (size_t i = 0; i < config.limit_zones.size(); ++i) {
+    const LimitZoneConfig &zone = config.limit_zones[i];
+    if (zone.name == config.limit_conn_zone && zone.rate == 0)
+      conn_found = true;
+    if (zone.name == config.limit_req_zone && zone.rate != 0)
+      req_found = true;
+  }
+  if (!conn_found)
+    throw std::runtime_error("Parse error: no limit_conn_zone '" +
+                             config.limit_conn_zone + "' for limit_conn");
+  if (!req_found)
+    throw std::runtime_error("Parse error: no limit_req_zone '" +
+                             config.limit_req_zone + "' for limit_req");
+}
+
+// types { text/html html htm; image/svg+xml svg; ... }
+// Several blocks may be given; a later mapping for an extension wins.
+void parseTypes(TokenStream &ts, MainConfig &config) {
+  ts.next(); // 'types'
+  expect(ts, TOKEN_LBRACE, "'{' after types");
+  ts.next(); // '{'
+  while (ts.peek().type != TOKEN_RBRACE && !ts.eof()) {
+    if (ts.peek().type == TOKEN_COMMENT) {
+      ts.next();
+      continue;
+    }
+    expect(ts, TOKEN_WORD, "MIME type");
+    std::string type = ts.next().value;
+    if (type.find('/') == std::string::npos)
+      throw std::runtime_error("Parse error: invalid MIME type '" + type +
+                               "'");
+    expect(ts, TOKEN_WORD, "extension for " + type);
+    while (ts.peek().type == TOKEN_WORD) {
+      std::string extension = ts.next().value;
+      for (size_t i = 0; i < extension.size(); ++i)
+        extension[i] = tolower(extension[i]);
+      config.mime_types[extension] = type;
+    }
+    expect(ts, TOKEN_SEMICOLON, "; after extensions of " + type);
+    ts.next();
+  }
+  expect(ts, TOKEN_RBRACE, "'}' to close types block");
+  ts.next(); // '}'
+}
 } // namespace
 
 MainConfig parseConfig(const std::vector<Token> &tokens) {
   TokenStream ts(tokens);
   MainConfig config;
+  config.mmap_cache_size = 64 * 1024 * 1024;
+  config.mmap_min_size = 64 * 1024;
+  config.file_cache_valid = 1;
+  config.gzip_cache_size = 16 * 1024 * 1024;
+  config.shutdown_timeout = 30;
+  config.worker_connections = 1000;
+  config.worker_rlimit_nofile = 0;
+  config.tcp_nodelay = true;
+  config.client_header_buffer_size = 8192;
+  config.client_header_timeout = 60;
+  config.client_body_timeout = 60;
+  config.send_timeout = 60;
+  config.limit_conn = 0;
+  config.limit_conn_status = 503;
+  config.limit_req_burst = 0;
+  config.limit_req_status = 503;
+  config.default_type = "application/octet-stream";
+  std::set<std::string> seen_directives;
+  std::set<std::string> addresses_with_options;
   while (!ts.eof()) {
     if (ts.peek().type == TOKEN_WORD && ts.peek().value == "server") {
       ServerConfig srv = parseServer(ts);
+      // Listen options describe the shared socket: one place per address
+      if (srv.listen_options.configured &&
+          !addresses_with_options.insert(srv.listen_address).second)
+        throw std::runtime_error("Parse error: duplicate listen options for " +
+                                 srv.listen_address);
       config.servers.push_back(srv);
+    } else if (ts.peek().type == TOKEN_WORD && ts.peek().value == "types") {
+      parseTypes(ts, config);
+    } else if (ts.peek().type == TOKEN_WORD &&
+               ts.peek().value.compare(0, 6, "limit_") == 0) {
+      parseLimitDirective(ts, config, seen_directives);
+    } else if (ts.peek().type == TOKEN_WORD) {
+      parseMainDirective(ts, config, seen_directives);
+    } else if (ts.peek().type == TOKEN_COMMENT) {
+      ts.next();
     } else if (ts.peek().type == TOKEN_EOF) {
       break;
     } else {
@@ -280,5 +805,6 @@ MainConfig parseConfig(const std::vector<Token> &tokens) {
           ts.peek().value + "'");
     }
   }
+  validateLimitZones(config);
   return config;
 }
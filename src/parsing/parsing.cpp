@@ -12,36 +12,102 @@
 
 #include "../../includes/webserv.hpp"
 
-int parse_config(std::string config_file, std::vector<ServerConfig>& servers)
+static const int MAX_INCLUDE_DEPTH = 8;
+
+static bool read_file_content(const std::string& path, std::string& content)
 {
-    //check if the file exists
-    std::ifstream file(config_file.c_str());
+    std::ifstream file(path.c_str());
     if (!file.is_open())
+        return (false);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+    return (true);
+}
+
+static std::string directory_of(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos)
+        return ("");
+    return (path.substr(0, slash + 1));
+}
+
+// Replace every `include <file>;` statement with the tokens of that file.
+// Relative paths are resolved against the directory of the including file.
+static void expand_includes(const std::vector<Token>& tokens,
+                            const std::string& base_dir,
+                            std::vector<Token>& output, int depth)
+{
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const Token& token = tokens[i];
+        if (token.type == TOKEN_EOF)
+            break;
+        bool statement_start = output.empty()
+            || output.back().type == TOKEN_SEMICOLON
+            || output.back().type == TOKEN_LBRACE
+            || output.back().type == TOKEN_RBRACE
+            || output.back().type == TOKEN_COMMENT;
+        if (token.type != TOKEN_WORD || token.value != "include"
+            || !statement_start) {
+            output.push_back(token);
+            continue;
+        }
+
+        if (i + 2 >= tokens.size() || tokens[i + 1].type != TOKEN_WORD
+            || tokens[i + 2].type != TOKEN_SEMICOLON)
+            throw std::runtime_error("Parse error: expected 'include <file>;'");
+        if (depth >= MAX_INCLUDE_DEPTH)
+            throw std::runtime_error("Parse error: includes nested too deeply");
+        std::string path = tokens[i + 1].value;
+        if (path.empty() || path[0] != '/')
+            path = base_dir + path;
+        std::string content;
+        if (!read_file_content(path, content))
+            throw std::runtime_error("Parse error: cannot open included file '"
+                                     + path + "'");
+        expand_includes(tokenize(content), directory_of(path), output,
+                        depth + 1);
+        i += 2;
+    }
+}
+
+int parse_config(std::string config_file, MainConfig& config)
+{
+    // Read the entire file content
+    std::string content;
+    if (!read_file_content(config_file, content))
     {
         std::cerr << "Error: Config file does not exist" << std::endl;
         return (1);
     }
     
-    // Read the entire file content
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string content = buffer.str();
-    
     try {
-        // Tokenize the content
-        std::vector<Token> tokens = tokenize(content);
+        // Tokenize the content, pulling in included files
+        std::vector<Token> tokens;
+        expand_includes(tokenize(content), directory_of(config_file), tokens, 0);
+        Token eof; eof.type = TOKEN_EOF; eof.value = "";
+        tokens.push_back(eof);
         
         // Parse the tokens into configuration
-        MainConfig config = parseConfig(tokens);
-        
-        // Extract servers from the parsed configuration
-        servers = config.servers;
+        config = parseConfig(tokens);
         
-        std::cout << "Successfully parsed " << servers.size() << " server(s)" << std::endl;
+        std::cout << "Successfully parsed " << config.servers.size() << " server(s)" << std::endl;
         return (0);
     }
     catch (const std::exception& e) {
         std::cerr << "Parse error: " << e.what() << std::endl;
         return (1);
     }
+}
+
+int parse_config(std::string config_file, std::vector<ServerConfig>& servers)
+{
+    MainConfig config;
+    if (parse_config(config_file, config) != 0)
+        return (1);
+
+    // Extract servers from the parsed configuration
+    servers = config.servers;
+    return (0);
 }
\ No newline at end of file
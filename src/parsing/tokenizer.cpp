@@ -1,5 +1,11 @@
 #include "../../includes/webserv.hpp" // IWYU pragma: keep.
 
+// Characters of unquoted words: names, paths, sizes, "key=value"
+// parameters and addresses ("10.0.0.5:80", "[::1]:8080")
+static bool is_word_char(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '/' || c == '.' || c == '_' || c == '-' || c == '+' || c == '*' || c == '=' || c == ':' || c == '[' || c == ']';
+}
+
 std::vector<Token> tokenize(const std::string& input) {
     std::vector<Token> tokens;
     size_t i = 0;
@@ -34,9 +40,9 @@ std::vector<Token> tokenize(const std::string& input) {
             continue;
         }
         // Words (directive names, values, etc.)
-        if (isalnum(input[i]) || input[i] == '/' || input[i] == '.' || input[i] == '_' || input[i] == '-') {
+        if (is_word_char(input[i])) {
             size_t start = i;
-            while (i < input.size() && (isalnum(input[i]) || input[i] == '/' || input[i] == '.' || input[i] == '_' || input[i] == '-')) ++i;
+            while (i < input.size() && is_word_char(input[i])) ++i;
             Token t; t.type = TOKEN_WORD; t.value = input.substr(start, i - start); tokens.push_back(t);
             continue;
         }
@@ -0,0 +1,196 @@
+#include "../includes/runtime_config.hpp"
+#include "../includes/http/file_cache.hpp"
+#include "../includes/http/gzip_filter.hpp"
+#include "../includes/http/http_response_handling.hpp"
+#include "../includes/http/location_tree.hpp"
+#include "../includes/http/mime_types.hpp"
+#include "../includes/http/routing.hpp"
+#include "../includes/networking/socket_address.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+RuntimeConfig::RuntimeConfig(const MainConfig &main_config)
+    : config(main_config) {
+  std::vector<ServerConfig> &servers = config.servers;
+  for (size_t i = 0; i < servers.size(); ++i)
+    compile_server(servers[i]);
+  HttpResponseHandling::preload_error_pages(servers);
+
+  // The server vector is final: listeners can point into it
+  for (size_t i = 0; i < servers.size(); ++i) {
+    Listener &listener = listeners[servers[i].listen_address];
+    if (listener.servers.empty() || servers[i].listen_options.configured)
+      listener.options = servers[i].listen_options;
+    listener.address = servers[i].listen_address;
+    listener.servers.push_back(&servers[i]);
+  }
+  for (std::map<std::string, Listener>::iterator it = listeners.begin();
+       it != listeners.end(); ++it)
+    it->second.hosts = VirtualHostTable(it->second.servers);
+  assign_listener_sockets();
+
+  for (size_t i = 0; i < config.limit_zones.size(); ++i) {
+    const LimitZoneConfig &zone = config.limit_zones[i];
+    if (zone.rate == 0 && zone.name == config.limit_conn_zone)
+      conn_limit_zone = LimitZone::obtain(zone.name, zone.size, zone.rate);
+    else if (zone.rate != 0 && zone.name == config.limit_req_zone)
+      req_limit_zone = LimitZone::obtain(zone.name, zone.size, zone.rate);
+  }
+}
+
+// Bind a specific address only if no wildcard of its port covers it: the
+// wildcard of its family, or for IPv4 a dual-stack (ipv6only=off) "[::]"
+void RuntimeConfig::assign_listener_sockets() {
+  for (std::map<std::string, Listener>::iterator it = listeners.begin();
+       it != listeners.end(); ++it) {
+    it->second.socket_address = it->first;
+    it->second.serves_specific = false;
+  }
+  for (std::map<std::string, Listener>::iterator it = listeners.begin();
+       it != listeners.end(); ++it) {
+    std::string wildcard = wildcard_listen_address(it->first);
+    if (wildcard == it->first)
+      continue;
+    std::map<std::string, Listener>::iterator covering =
+        listeners.find(wildcard);
+    if (covering == listeners.end() && !is_ipv6_listen_address(it->first)) {
+      covering = listeners.find(
+          "[::]:" + std::to_string(listen_address_port(it->first)));
+      if (covering != listeners.end() && covering->second.options.ipv6only)
+        covering = listeners.end();
+    }
+    if (covering == listeners.end())
+      continue;
+    if (it->second.options.configured)
+      std::cerr << "Warning: listen options of " << it->first
+                << " are ignored, its connections are accepted on "
+                << covering->first << std::endl;
+    it->second.socket_address = covering->first;
+    covering->second.serves_specific = true;
+  }
+}
+
+RuntimeConfig::~RuntimeConfig() {}
+
+std::shared_ptr<const RuntimeConfig>
+RuntimeConfig::compile(const MainConfig &config) {
+  return std::shared_ptr<const RuntimeConfig>(new RuntimeConfig(config));
+}
+
+const MainConfig &RuntimeConfig::get_main_config() const { return config; }
+
+const std::vector<ServerConfig> &RuntimeConfig::get_servers() const {
+  return config.servers;
+}
+
+std::map<std::string, ListenOptions>
+RuntimeConfig::get_listen_options() const {
+  std::map<std::string, ListenOptions> options;
+  for (std::map<std::string, Listener>::const_iterator it = listeners.begin();
+       it != listeners.end(); ++it) {
+    if (it->second.socket_address == it->first)
+      options[it->first] = it->second.options;
+  }
+  return options;
+}
+
+const std::shared_ptr<LimitZone> &RuntimeConfig::get_conn_limit_zone() const {
+  return conn_limit_zone;
+}
+
+const std::shared_ptr<LimitZone> &RuntimeConfig::get_req_limit_zone() const {
+  return req_limit_zone;
+}
+
+void RuntimeConfig::apply_process_settings() const {
+  MimeTypes::instance().configure(config.mime_types, config.default_type);
+  FileCache::instance().configure(config.mmap_cache_size, config.mmap_min_size,
+                                  config.file_cache_valid);
+  CompressionCache::instance().configure(config.gzip_cache_size);
+  apply_open_file_limit();
+}
+
+// Raise RLIMIT_NOFILE to worker_rlimit_nofile (the hard limit too, if the
+// process may), then check that worker_connections fits in what we got
+void RuntimeConfig::apply_open_file_limit() const {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) < 0)
+    return;
+  rlim_t wanted = static_cast<rlim_t>(config.worker_rlimit_nofile);
+  if (wanted > 0 && wanted != limit.rlim_cur) {
+    struct rlimit raised = limit;
+    raised.rlim_cur = wanted;
+    if (limit.rlim_max != RLIM_INFINITY && wanted > limit.rlim_max)
+      raised.rlim_max = wanted;
+    if (setrlimit(RLIMIT_NOFILE, &raised) < 0 &&
+        raised.rlim_max != limit.rlim_max) {
+      // Unprivileged: go as far as the hard limit allows
+      raised.rlim_max = limit.rlim_max;
+      raised.rlim_cur = limit.rlim_max;
+      if (setrlimit(RLIMIT_NOFILE, &raised) < 0)
+        std::cerr << "Failed to raise the open file limit: " << strerror(errno)
+                  << std::endl;
+    }
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < wanted)
+      std::cerr << "Warning: open file limit is " << limit.rlim_cur
+                << ", below worker_rlimit_nofile " << wanted << std::endl;
+  }
+  std::cout << "Open file limit: " << limit.rlim_cur << std::endl;
+
+  // Listeners, the signal pipe, files and CGI pipes need descriptors too
+  rlim_t needed = static_cast<rlim_t>(config.worker_connections) + 64;
+  if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < needed)
+    std::cerr << "Warning: worker_connections " << config.worker_connections
+              << " does not fit in the open file limit " << limit.rlim_cur
+              << "; set worker_rlimit_nofile" << std::endl;
+}
+
+bool RuntimeConfig::serves_specific_addresses(
+    const std::string &address) const {
+  std::map<std::string, Listener>::const_iterator it = listeners.find(address);
+  return it != listeners.end() && it->second.serves_specific;
+}
+
+const ServerConfig *
+RuntimeConfig::resolve_server(const std::string &socket_address,
+                              const std::string &local_address,
+                              std::string_view host) const {
+  std::map<std::string, Listener>::const_iterator it = listeners.end();
+  if (!local_address.empty())
+    it = listeners.find(local_address);
+  if (it == listeners.end())
+    it = listeners.find(socket_address);
+  if (it == listeners.end())
+    return NULL;
+  return it->second.hosts.resolve(host);
+}
+
+void RuntimeConfig::compile_server(ServerConfig &server) {
+  for (size_t i = 0; i < server.locations.size(); ++i)
+    compile_location(server.locations[i]);
+  server.location_tree.reset(new LocationTree(server.locations));
+}
+
+void RuntimeConfig::compile_location(LocationConfig &location) {
+  location.methods = Router::method_mask(location.allow_methods);
+  location.allow_header = Router::allowed_methods(location);
+
+  // Index names are joined to directory paths as-is on every request
+  for (size_t i = 0; i < location.index.size(); ++i) {
+    std::string &index = location.index[i];
+    while (!index.empty() && index[0] == '/')
+      index.erase(0, 1);
+  }
+
+  // A missing root is not fatal (it may be created later), but say so now
+  // rather than on the first 404
+  struct stat st;
+  if (!location.root.empty() &&
+      (stat(location.root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)))
+    std::cerr << "Warning: root '" << location.root << "' of location '"
+              << location.path << "' is not a directory" << std::endl;
+}
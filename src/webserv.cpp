@@ -12,46 +12,32 @@
 
 #include "../includes/webserv.hpp"
 #include "../includes/networking/event_loop.hpp"
+#include "../includes/runtime_config.hpp"
 #include <signal.h>
 #include <unistd.h> // for getpid()
 
-// Global pointer to event loop for signal handling
-static EventLoop *g_event_loop = NULL;
 static volatile sig_atomic_t g_shutdown_requested = 0;
 
+// Signals are only recorded here; the event loop acts on them
 void signal_handler(int sig) {
-  g_shutdown_requested = 1;
-
-  switch (sig) {
-  case SIGINT:
-    std::cout << "\nReceived SIGINT (Ctrl+C), shutting down..."
-              << std::endl;
-    if (g_event_loop) {
-      g_event_loop->stop();
-    }
-    break;
-  case SIGTERM:
-    std::cout << "\nReceived SIGTERM, shutting down..." << std::endl;
-    if (g_event_loop) {
-      g_event_loop->stop();
-    }
-    break;
-  case SIGUSR1:
-    std::cout << "\nReceived SIGUSR1, performing shutdown with client "
-                 "notification..."
-              << std::endl;
-    if (g_event_loop) {
-      g_event_loop->shutdown_gracefully();
-    }
-    break;
-  default:
-    std::cout << "\nReceived signal " << sig << ", shutting down..."
-              << std::endl;
-    if (g_event_loop) {
-      g_event_loop->stop();
-    }
-    break;
+  if (sig != SIGHUP && sig != SIGUSR2 && sig != SIGCHLD)
+    g_shutdown_requested = 1;
+  EventLoop::post_signal(sig);
+}
+
+// Parse and compile the config file; NULL (after reporting why) if invalid
+static std::shared_ptr<const RuntimeConfig>
+load_config(const std::string &config_file) {
+  MainConfig config;
+  if (parse_config(config_file, config) != 0) {
+    std::cerr << "Failed to parse configuration file" << std::endl;
+    return std::shared_ptr<const RuntimeConfig>();
   }
+  if (config.servers.empty()) {
+    std::cerr << "No servers found in configuration file" << std::endl;
+    return std::shared_ptr<const RuntimeConfig>();
+  }
+  return RuntimeConfig::compile(config);
 }
 
 int main(int argc, char **argv) {
@@ -63,21 +49,17 @@ int main(int argc, char **argv) {
   std::string config_file = argv[1];
 
   // Parse configuration file
-  std::vector<ServerConfig> servers;
-  int parse_result = parse_config(config_file, servers);
-  if (parse_result != 0) {
-    std::cerr << "Failed to parse configuration file" << std::endl;
+  std::shared_ptr<const RuntimeConfig> runtime_config = load_config(config_file);
+  if (!runtime_config)
     return 1;
-  }
+  runtime_config->apply_process_settings();
 
-  if (servers.empty()) {
-    std::cerr << "No servers found in configuration file" << std::endl;
-    return 1;
-  }
-
-  // Initialize socket manager
+  // Initialize socket manager, taking over the listeners of the process
+  // that started this one if this is a binary upgrade
   SocketManager socket_manager;
-  if (!socket_manager.initialize_sockets(servers)) {
+  socket_manager.adopt_inherited_sockets();
+  if (!socket_manager.initialize_sockets(
+          runtime_config->get_listen_options())) {
     std::cerr << "Failed to initialize server sockets" << std::endl;
     return 1;
   }
@@ -88,27 +70,33 @@ int main(int argc, char **argv) {
             << std::endl;
 
   // Create and run event loop
-  EventLoop event_loop(socket_manager, 60); // 60 second timeout
+  EventLoop event_loop(socket_manager, runtime_config);
 
-  // Set global pointer for signal handling
-  g_event_loop = &event_loop;
+  // SIGHUP re-reads the same file; SIGUSR2 re-executes the same command
+  event_loop.set_config_loader(
+      [config_file]() { return load_config(config_file); });
+  event_loop.set_upgrade_command(std::vector<std::string>(argv, argv + argc));
 
-  // Set up signal handling for graceful shutdown
+  // Set up signal handling: SIGINT stops at once, SIGTERM and SIGUSR1
+  // drain the connections first
   signal(SIGINT, signal_handler);  // Ctrl+C
   signal(SIGTERM, signal_handler); // Termination request
-  signal(SIGUSR1, signal_handler); // User-defined signal for graceful shutdown
+  signal(SIGUSR1, signal_handler); // Graceful shutdown
+  signal(SIGHUP, signal_handler);  // Reload the configuration
+  signal(SIGUSR2, signal_handler); // Upgrade to a new binary
+  signal(SIGCHLD, signal_handler); // A CGI script exited: reap it
+  signal(SIGPIPE, SIG_IGN);        // Peers closing pipes are handled as EPIPE
+
+  // Listening: the previous binary (if any) can stop accepting
+  EventLoop::notify_upgrade_ready();
 
   try {
     event_loop.run();
   } catch (const std::exception &e) {
     std::cerr << "Event loop error: " << e.what() << std::endl;
-    g_event_loop = NULL;
     return 1;
   }
 
-  // Clear global pointer
-  g_event_loop = NULL;
-
   if (g_shutdown_requested) {
     std::cout << "Server shutdown completed." << std::endl;
   }
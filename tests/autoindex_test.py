@@ -0,0 +1,70 @@
+"""Paged directory listings (autoindex_page_size, ?page=N).
+
+Run with ``make test`` (or ``python3 tests/autoindex_test.py`` after
+``make``).
+"""
+
+import http.client
+import json
+import unittest
+
+from harness import Server, free_port
+
+NAMES = ["f%d.txt" % i for i in range(5)]
+
+
+class AutoindexPagingTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.port = free_port()
+        cls.server = Server("""
+server {
+    listen %d;
+    location / {
+        root {root}/www;
+        autoindex on;
+        autoindex_format json;
+        autoindex_page_size 2;
+        allow_methods GET;
+    }
+}
+""" % cls.port, cls.port, dict(("www/d/" + name, b"x") for name in NAMES))
+        cls.server.__enter__()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.server.__exit__(None, None, None)
+
+    def listing(self, page):
+        connection = http.client.HTTPConnection("127.0.0.1", self.port,
+                                                timeout=10)
+        try:
+            connection.request("GET", "/d/?page=" + page)
+            response = connection.getresponse()
+            self.assertEqual(response.status, 200, page)
+            return json.loads(response.read())
+        finally:
+            connection.close()
+
+    def test_pages_cover_the_directory_once(self):
+        names = []
+        for page in ("1", "2", "3"):
+            listing = self.listing(page)
+            self.assertEqual(listing["page"], int(page))
+            names.extend(entry["name"] for entry in listing["entries"])
+        self.assertEqual(sorted(names), NAMES)
+        self.assertNotIn("next_page", self.listing("3"))
+        self.assertEqual(self.listing("0")["page"], 1)
+
+    def test_huge_page_numbers_are_clamped(self):
+        last_page = (2 ** 64 - 1) // 2
+        for page in ("18446744073709551615", "9223372036854775808",
+                     "99999999999999999999999999"):
+            listing = self.listing(page)
+            self.assertEqual(listing["page"], last_page, page)
+            self.assertEqual(listing["entries"], [], page)
+            self.assertNotIn("next_page", listing)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,102 @@
+"""On-the-fly gzip: a HEAD request gets the headers of the matching GET.
+
+Run with ``make test`` (or ``python3 tests/gzip_test.py`` after ``make``).
+"""
+
+import gzip
+import http.client
+import unittest
+
+from harness import Server, free_port
+
+PAGE = b"<p>compressible</p>\n" * 500
+TINY = b"<p>tiny</p>\n"
+
+# Headers that differ between a HEAD and its GET by design: HEAD cannot
+# state the compressed length, and the GET of an uncached body is chunked
+VOLATILE = ("date", "content-length", "transfer-encoding")
+
+
+class GzipHeadTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.port = free_port()
+        cls.zero_min_port = free_port()
+        cls.server = Server("""
+server {
+    listen %d;
+    gzip on;
+    location / {
+        root {root}/www;
+        allow_methods GET HEAD;
+    }
+}
+
+server {
+    listen %d;
+    gzip on;
+    gzip_min_length 0;
+    location / {
+        root {root}/www;
+        allow_methods GET HEAD;
+    }
+}
+""" % (cls.port, cls.zero_min_port), cls.port,
+            {"www/page.html": PAGE, "www/tiny.html": TINY})
+        cls.server.__enter__()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.server.__exit__(None, None, None)
+
+    def request(self, port, method, path):
+        connection = http.client.HTTPConnection("127.0.0.1", port, timeout=10)
+        try:
+            connection.request(method, path,
+                               headers={"Accept-Encoding": "gzip"})
+            response = connection.getresponse()
+            body = response.read()
+            headers = dict((name.lower(), value)
+                           for name, value in response.getheaders())
+            return response.status, headers, body
+        finally:
+            connection.close()
+
+    def compare(self, port, path):
+        get_status, get_headers, get_body = self.request(port, "GET", path)
+        head_status, head_headers, head_body = self.request(port, "HEAD",
+                                                            path)
+        self.assertEqual(head_status, get_status)
+        self.assertEqual(head_body, b"")
+        for name in VOLATILE:
+            get_headers.pop(name, None)
+            head_headers.pop(name, None)
+        self.assertEqual(head_headers, get_headers)
+        return get_headers, get_body
+
+    def test_head_of_compressed_file(self):
+        headers, body = self.compare(self.port, "/page.html")
+        self.assertEqual(headers.get("content-encoding"), "gzip")
+        self.assertEqual(headers.get("vary"), "Accept-Encoding")
+        self.assertTrue(headers.get("etag", "").startswith("W/"))
+        self.assertEqual(gzip.decompress(body), PAGE)
+        _, head_headers, _ = self.request(self.port, "HEAD", "/page.html")
+        self.assertNotIn("content-length", head_headers)
+
+    def test_head_of_file_under_min_length(self):
+        headers, body = self.compare(self.port, "/tiny.html")
+        self.assertNotIn("content-encoding", headers)
+        self.assertEqual(body, TINY)
+        _, head_headers, _ = self.request(self.port, "HEAD", "/tiny.html")
+        self.assertEqual(int(head_headers["content-length"]), len(TINY))
+
+    def test_head_with_zero_min_length(self):
+        headers, _ = self.compare(self.zero_min_port, "/page.html")
+        self.assertEqual(headers.get("content-encoding"), "gzip")
+        _, head_headers, _ = self.request(self.zero_min_port, "HEAD",
+                                          "/page.html")
+        self.assertNotIn("content-length", head_headers)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,130 @@
+"""Run ./webserv on a throwaway config, for the tests and the benchmarks.
+
+The config is written to a temporary directory that also holds the files
+it serves. The server's own output goes to server.log in that directory.
+"""
+
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import tempfile
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
+BINARY = os.path.join(ROOT, "webserv")
+MIME_TYPES = os.path.join(ROOT, "configs", "mime.types")
+
+
+def free_port():
+    """A TCP port nothing listens on right now."""
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+        s.bind(("", 0))
+        return s.getsockname()[1]
+
+
+class Server:
+    """Context manager: ``with Server(config, port) as server:``.
+
+    ``config`` is the text after ``include mime.types;``. ``{root}`` in it
+    is replaced with the temporary directory (see ``path()``). The server
+    is ready once ``wait_for`` (a port, or a Unix socket path) accepts.
+    """
+
+    def __init__(self, config, wait_for, files=None):
+        self.directory = tempfile.mkdtemp(prefix="webserv-test-")
+        self.config = config
+        self.wait_for = wait_for
+        self.files = files or {}
+        self.process = None
+
+    def path(self, name=""):
+        return os.path.join(self.directory, name)
+
+    def __enter__(self):
+        for name, contents in self.files.items():
+            os.makedirs(os.path.dirname(self.path(name)), exist_ok=True)
+            with open(self.path(name), "wb") as f:
+                f.write(contents)
+        config_path = self.path("webserv.conf")
+        with open(config_path, "w") as f:
+            f.write("include %s;\n" % MIME_TYPES)
+            f.write(self.config.replace("{root}", self.directory))
+        self.log = open(self.path("server.log"), "wb")
+        self.process = subprocess.Popen([BINARY, config_path], cwd=ROOT,
+                                        stdout=self.log,
+                                        stderr=subprocess.STDOUT)
+        self._wait_until_ready()
+        return self
+
+    def __exit__(self, *exc):
+        if self.process.poll() is None:
+            self.process.send_signal(signal.SIGINT)
+            try:
+                self.process.wait(5)
+            except subprocess.TimeoutExpired:
+                self.process.kill()
+                self.process.wait()
+        self.log.close()
+        shutil.rmtree(self.directory, ignore_errors=True)
+        return False
+
+    def rss_kb(self, peak=False):
+        """Resident memory now, or the most it has been (peak)."""
+        field = "VmHWM:" if peak else "VmRSS:"
+        with open("/proc/%d/status" % self.process.pid) as f:
+            for line in f:
+                if line.startswith(field):
+                    return int(line.split()[1])
+        return 0
+
+    def connect(self):
+        if isinstance(self.wait_for, int):
+            return socket.create_connection(("127.0.0.1", self.wait_for))
+        s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        s.connect(self.wait_for)
+        return s
+
+    def _wait_until_ready(self):
+        deadline = time.time() + 10
+        while time.time() < deadline:
+            if self.process.poll() is not None:
+                raise RuntimeError("webserv exited with %d, see %s" %
+                                   (self.process.returncode,
+                                    self.path("server.log")))
+            try:
+                self.connect().close()
+                return
+            except OSError:
+                time.sleep(0.05)
+        raise RuntimeError("webserv did not start listening")
+
+
+def read_response(sock, buffer=b""):
+    """Read one response with a Content-Length body from a keep-alive
+    connection. Returns (status, headers, body, rest of the buffer)."""
+    while b"\r\n\r\n" not in buffer:
+        data = sock.recv(65536)
+        if not data:
+            raise ConnectionError("connection closed in the headers")
+        buffer += data
+    head, _, buffer = buffer.partition(b"\r\n\r\n")
+    lines = head.decode("latin-1").split("\r\n")
+    status = int(lines[0].split()[1])
+    headers = {}
+    for line in lines[1:]:
+        name, _, value = line.partition(":")
+        headers[name.strip().lower()] = value.strip()
+    length = int(headers.get("content-length", "0"))
+    while len(buffer) < length:
+        data = sock.recv(max(65536, length - len(buffer)))
+        if not data:
+            raise ConnectionError("connection closed in the body")
+        buffer += data
+    return status, headers, buffer[:length], buffer[length:]
+
+
+def percentile(sorted_values, fraction):
+    index = min(len(sorted_values) - 1, int(len(sorted_values) * fraction))
+    return sorted_values[index]
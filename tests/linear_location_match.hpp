@@ -0,0 +1,30 @@
+#ifndef LINEAR_LOCATION_MATCH_HPP
+#define LINEAR_LOCATION_MATCH_HPP
+
+#include "../includes/http/location_tree.hpp"
+#include <string>
+#include <vector>
+
+// The linear scan Router used before LocationTree, kept as the reference
+// the tree must agree with (and as the baseline of bench/routing_bench)
+inline int linear_find_location(const std::vector<LocationConfig> &locations,
+                                const std::string &uri) {
+  int best_match = LocationTree::NO_LOCATION;
+  size_t longest_match = 0;
+  for (size_t i = 0; i < locations.size(); ++i) {
+    const std::string &location_path = locations[i].path;
+    if (uri.substr(0, location_path.length()) != location_path)
+      continue;
+    bool is_valid_match = uri.length() == location_path.length() ||
+                          location_path == "/" ||
+                          location_path[location_path.length() - 1] == '/' ||
+                          uri[location_path.length()] == '/';
+    if (is_valid_match && location_path.length() > longest_match) {
+      longest_match = location_path.length();
+      best_match = static_cast<int>(i);
+    }
+  }
+  return best_match;
+}
+
+#endif // LINEAR_LOCATION_MATCH_HPP
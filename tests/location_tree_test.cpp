@@ -0,0 +1,141 @@
+// LocationTree must pick the same location as the linear scan it replaced.
+// Run with make test; exits non-zero on the first disagreement.
+
+#include "../includes/http/location_tree.hpp"
+#include "linear_location_match.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+std::vector<LocationConfig> make_locations(const std::vector<std::string> &paths) {
+  std::vector<LocationConfig> locations(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i)
+    locations[i].path = paths[i];
+  return locations;
+}
+
+void check(const std::vector<LocationConfig> &locations,
+           const LocationTree &tree, const std::string &uri) {
+  int expected = linear_find_location(locations, uri);
+  int found = tree.find(uri);
+  if (found == expected)
+    return;
+  if (++failures <= 10) {
+    std::cerr << "FAIL " << uri << ": tree "
+              << (found < 0 ? "none" : locations[found].path) << ", scan "
+              << (expected < 0 ? "none" : locations[expected].path)
+              << std::endl;
+  }
+}
+
+void expect(const std::vector<LocationConfig> &locations,
+            const LocationTree &tree, const std::string &uri,
+            const char *path) {
+  check(locations, tree, uri);
+  int found = tree.find(uri);
+  std::string got = found < 0 ? "none" : locations[found].path;
+  if (got != path && ++failures <= 10)
+    std::cerr << "FAIL " << uri << ": got " << got << ", want " << path
+              << std::endl;
+}
+
+// Path boundaries: a prefix only matches at a '/' or the end of the URI
+void test_boundaries() {
+  std::vector<LocationConfig> locations =
+      make_locations({"/", "/foo", "/foobar", "/images/", "/api", "/api/v1",
+                      "/a/b/c"});
+  LocationTree tree(locations);
+  expect(locations, tree, "/", "/");
+  expect(locations, tree, "/foo", "/foo");
+  expect(locations, tree, "/foo/", "/foo");
+  expect(locations, tree, "/foo/bar", "/foo");
+  expect(locations, tree, "/foobar", "/foobar");
+  expect(locations, tree, "/foobar/x", "/foobar");
+  expect(locations, tree, "/foobarx", "/");
+  expect(locations, tree, "/foox", "/");
+  expect(locations, tree, "/fo", "/");
+  expect(locations, tree, "/images", "/");
+  expect(locations, tree, "/images/", "/images/");
+  expect(locations, tree, "/images/a.png", "/images/");
+  expect(locations, tree, "/api/v1", "/api/v1");
+  expect(locations, tree, "/api/v1x", "/api");
+  expect(locations, tree, "/api/v10/x", "/api");
+  expect(locations, tree, "/a/b", "/");
+  expect(locations, tree, "/a/b/c/d", "/a/b/c");
+}
+
+void test_without_root() {
+  std::vector<LocationConfig> locations = make_locations({"/foo", "/foo/bar/"});
+  LocationTree tree(locations);
+  expect(locations, tree, "/", "none");
+  expect(locations, tree, "/foobar", "none");
+  expect(locations, tree, "/foo/bar", "/foo");
+  expect(locations, tree, "/foo/bar/", "/foo/bar/");
+  expect(locations, tree, "", "none");
+
+  std::vector<LocationConfig> empty;
+  LocationTree empty_tree(empty);
+  expect(empty, empty_tree, "/anything", "none");
+}
+
+// The first of two locations with the same path wins, as with the scan
+void test_duplicates() {
+  std::vector<LocationConfig> locations =
+      make_locations({"/dup", "/dup", "/dup/"});
+  LocationTree tree(locations);
+  if (tree.find("/dup") != 0 || tree.find("/dup/x") != 2) {
+    ++failures;
+    std::cerr << "FAIL duplicate paths" << std::endl;
+  }
+}
+
+// Random paths over a small alphabet, so prefixes and boundaries collide
+std::string random_path(std::mt19937 &rng, size_t max_length) {
+  static const char alphabet[] = "//abc";
+  std::uniform_int_distribution<size_t> length(0, max_length);
+  std::uniform_int_distribution<size_t> pick(0, sizeof(alphabet) - 2);
+  std::string path = "/";
+  for (size_t i = length(rng); i > 0; --i)
+    path += alphabet[pick(rng)];
+  return path;
+}
+
+void test_random() {
+  std::mt19937 rng(12345);
+  for (int round = 0; round < 2000; ++round) {
+    std::uniform_int_distribution<size_t> count(1, 40);
+    std::vector<std::string> paths;
+    for (size_t i = count(rng); i > 0; --i)
+      paths.push_back(random_path(rng, 6));
+    std::vector<LocationConfig> locations = make_locations(paths);
+    LocationTree tree(locations);
+    for (int i = 0; i < 50; ++i)
+      check(locations, tree, random_path(rng, 9));
+    for (size_t i = 0; i < paths.size(); ++i) {
+      check(locations, tree, paths[i]);
+      check(locations, tree, paths[i] + "/");
+      check(locations, tree, paths[i] + "a");
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  test_boundaries();
+  test_without_root();
+  test_duplicates();
+  test_random();
+  if (failures) {
+    std::cerr << failures << " location lookup(s) differ" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "LocationTree agrees with the linear scan" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+"""Byte ranges, If-Range and If-None-Match on static files.
+
+Run with ``make test`` (or ``python3 tests/range_test.py`` after ``make``).
+"""
+
+import email.utils
+import http.client
+import os
+import random
+import unittest
+
+from harness import Server, free_port
+
+# Small files are read into memory, big ones mapped and files over the
+# mapping cap sent with sendfile(): all of them serve ranges
+SMALL = bytes(random.Random(1).getrandbits(8) for _ in range(1000))
+BIG = os.urandom(3 * 1024 * 1024)
+HUGE = os.urandom(12 * 1024 * 1024)
+
+
+class RangeTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.port = free_port()
+        cls.server = Server("""
+mmap_cache_size 8M;
+
+server {
+    listen %d;
+    location / {
+        root {root}/www;
+        allow_methods GET HEAD;
+    }
+}
+""" % cls.port, cls.port, {"www/small.bin": SMALL, "www/big.bin": BIG,
+                                  "www/huge.bin": HUGE})
+        cls.server.__enter__()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.server.__exit__(None, None, None)
+
+    def get(self, path, headers=None, method="GET"):
+        connection = http.client.HTTPConnection("127.0.0.1", self.port,
+                                                timeout=10)
+        try:
+            connection.request(method, path, headers=headers or {})
+            response = connection.getresponse()
+            return response, response.read()
+        finally:
+            connection.close()
+
+    def check_range(self, path, data, spec, first, last):
+        response, body = self.get(path, {"Range": "bytes=" + spec})
+        self.assertEqual(response.status, 206, spec)
+        self.assertEqual(response.getheader("Content-Range"),
+                         "bytes %d-%d/%d" % (first, last, len(data)))
+        self.assertEqual(int(response.getheader("Content-Length")),
+                         last - first + 1)
+        self.assertEqual(body, data[first:last + 1])
+
+    def test_full_response_advertises_ranges(self):
+        response, body = self.get("/small.bin")
+        self.assertEqual(response.status, 200)
+        self.assertEqual(response.getheader("Accept-Ranges"), "bytes")
+        self.assertEqual(body, SMALL)
+
+    def test_file_over_mapping_cap_is_not_copied(self):
+        peak_before = self.server.rss_kb(peak=True)
+        response, body = self.get("/huge.bin")
+        self.assertEqual(response.status, 200)
+        self.assertEqual(body, HUGE)
+        self.assertLess((self.server.rss_kb(peak=True) - peak_before) * 1024,
+                        len(HUGE) // 2)
+
+    def test_single_ranges(self):
+        for path, data in (("/small.bin", SMALL), ("/big.bin", BIG),
+                           ("/huge.bin", HUGE)):
+            size = len(data)
+            self.check_range(path, data, "0-0", 0, 0)
+            self.check_range(path, data, "0-99", 0, 99)
+            self.check_range(path, data, "100-", 100, size - 1)
+            self.check_range(path, data, "-10", size - 10, size - 1)
+            self.check_range(path, data, "-%d" % (size * 2), 0, size - 1)
+            self.check_range(path, data, "%d-%d" % (size - 5, size * 2),
+                             size - 5, size - 1)
+
+    def test_unsatisfiable_range(self):
+        response, _ = self.get("/small.bin", {"Range": "bytes=1000-"})
+        self.assertEqual(response.status, 416)
+        self.assertEqual(response.getheader("Content-Range"), "bytes */1000")
+
+    def test_invalid_ranges_are_ignored(self):
+        for spec in ("bytes=5-2", "bytes=a-b", "items=0-1", "bytes=-"):
+            response, body = self.get("/small.bin", {"Range": spec})
+            self.assertEqual(response.status, 200, spec)
+            self.assertEqual(body, SMALL)
+
+    def test_multiple_ranges(self):
+        for path, data in (("/small.bin", SMALL), ("/big.bin", BIG)):
+            response, body = self.get(path,
+                                      {"Range": "bytes=0-9,500-599,-3"})
+            self.assertEqual(response.status, 206)
+            content_type = response.getheader("Content-Type")
+            self.assertTrue(content_type.startswith(
+                "multipart/byteranges; boundary="))
+            self.assertEqual(int(response.getheader("Content-Length")),
+                             len(body))
+            boundary = content_type.split("boundary=")[1].encode()
+            parts = body.split(b"--" + boundary)
+            self.assertEqual(parts[0], b"")
+            self.assertEqual(parts[-1], b"--\r\n")
+            size = len(data)
+            expected = [(0, 9), (500, 599), (size - 3, size - 1)]
+            self.assertEqual(len(parts) - 2, len(expected))
+            for part, (first, last) in zip(parts[1:-1], expected):
+                head, _, payload = part.partition(b"\r\n\r\n")
+                self.assertIn(b"Content-Range: bytes %d-%d/%d" %
+                              (first, last, size), head)
+                self.assertEqual(payload, data[first:last + 1] + b"\r\n")
+
+    def test_if_range(self):
+        response, _ = self.get("/small.bin")
+        etag = response.getheader("ETag")
+        last_modified = response.getheader("Last-Modified")
+
+        for validator in (etag, last_modified):
+            response, body = self.get("/small.bin", {"Range": "bytes=0-9",
+                                                     "If-Range": validator})
+            self.assertEqual(response.status, 206, validator)
+            self.assertEqual(body, SMALL[:10])
+
+        stale_date = email.utils.formatdate(0, usegmt=True)
+        for validator in ('"stale"', "W/" + etag, stale_date):
+            response, body = self.get("/small.bin", {"Range": "bytes=0-9",
+                                                     "If-Range": validator})
+            self.assertEqual(response.status, 200, validator)
+            self.assertEqual(body, SMALL)
+
+    def test_if_none_match(self):
+        response, _ = self.get("/big.bin")
+        etag = response.getheader("ETag")
+        self.assertTrue(etag.startswith('"'))
+
+        for tags in (etag, "W/" + etag, "*", '"other", ' + etag):
+            response, body = self.get("/big.bin", {"If-None-Match": tags})
+            self.assertEqual(response.status, 304, tags)
+            self.assertEqual(response.getheader("ETag"), etag)
+            self.assertEqual(body, b"")
+
+        response, body = self.get("/big.bin", {"If-None-Match": '"other"'})
+        self.assertEqual(response.status, 200)
+        self.assertEqual(body, BIG)
+
+    def test_if_none_match_wins_over_if_modified_since(self):
+        future = email.utils.formatdate(4102444800, usegmt=True)
+        response, _ = self.get("/small.bin", {"If-Modified-Since": future})
+        self.assertEqual(response.status, 304)
+        response, body = self.get("/small.bin", {"If-None-Match": '"other"',
+                                                 "If-Modified-Since": future})
+        self.assertEqual(response.status, 200)
+        self.assertEqual(body, SMALL)
+
+    def test_head_matches_get(self):
+        response, body = self.get("/big.bin", method="HEAD")
+        self.assertEqual(response.status, 200)
+        self.assertEqual(int(response.getheader("Content-Length")), len(BIG))
+        self.assertEqual(body, b"")
+
+
+if __name__ == "__main__":
+    unittest.main()